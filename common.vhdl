@@ -959,6 +959,17 @@ package common is
         fp_complete    : std_ulogic;
     end record;
 
+    -- Event numbers for the simulation trace, see sim_trace.vhdl
+    constant TRACE_GPR_WRITE  : natural := 1;
+    constant TRACE_GPR_READ   : natural := 2;
+    constant TRACE_CR_WRITE   : natural := 3;
+    constant TRACE_XERC_WRITE : natural := 4;
+    constant TRACE_CR_READ    : natural := 5;
+    constant TRACE_SPR_WRITE  : natural := 6;
+    constant TRACE_EXECUTE    : natural := 7;
+    constant TRACE_RAM_WRITE  : natural := 8;
+    constant TRACE_RAM_READ   : natural := 9;
+
 end common;
 
 package body common is
@@ -15,6 +15,9 @@ entity core is
         EX1_BYPASS : boolean := true;
         HAS_FPU : boolean := true;
         HAS_BTC : boolean := true;
+        HAS_TIME_SKIP : boolean := false;
+        HAS_ICOUNT : boolean := false;
+        HAS_NIA_TRIGGER : boolean := false;
 	ALT_RESET_ADDRESS : std_ulogic_vector(63 downto 0) := (others => '0');
         LOG_LENGTH : natural := 512;
         ICACHE_NUM_LINES : natural := 64;
@@ -167,6 +170,7 @@ architecture behave of core is
     signal dbg_ls_spr_ack : std_ulogic;
     signal dbg_ls_spr_addr : std_ulogic_vector(1 downto 0);
     signal dbg_ls_spr_data : std_ulogic_vector(63 downto 0);
+    signal dbg_cr_data : std_ulogic_vector(31 downto 0);
 
     signal ctrl_debug : ctrl_t;
 
@@ -178,6 +182,8 @@ architecture behave of core is
 
     -- Debug status
     signal dbg_core_is_stopped: std_ulogic;
+    signal dbg_tb_skip : std_ulogic_vector(63 downto 0);
+    signal dbg_tb_skip_valid : std_ulogic;
 
     -- Logging signals
     signal log_data    : std_ulogic_vector(255 downto 0);
@@ -185,6 +191,35 @@ architecture behave of core is
     signal log_wr_addr : std_ulogic_vector(31 downto 0);
     signal log_rd_data : std_ulogic_vector(63 downto 0);
 
+    -- Simulation speed statistics, sim_stats.vhdl
+    component sim_core_stats is
+        generic (
+            CPU_INDEX : natural
+            );
+        port (
+            clk            : in std_ulogic;
+            rst            : in std_ulogic;
+            instr_complete : in std_ulogic
+            );
+    end component;
+
+    -- PC sampling profiler, sim_profile.vhdl
+    component sim_core_profile is
+        generic (
+            CPU_INDEX : natural
+            );
+        port (
+            clk : in std_ulogic;
+            rst : in std_ulogic;
+            nia : in std_ulogic_vector(63 downto 0);
+            lr  : in std_ulogic_vector(63 downto 0);
+            pr  : in std_ulogic
+            );
+    end component;
+
+    signal last_nia : std_ulogic_vector(63 downto 0);
+    signal sim_lr : std_ulogic_vector(63 downto 0);
+
     function keep_h(disable : boolean) return string is
     begin
 	if disable then
@@ -336,6 +371,7 @@ begin
     register_file_0: entity work.register_file
         generic map (
             SIM => SIM,
+            CPU_INDEX => CPU_INDEX,
             HAS_FPU => HAS_FPU,
             LOG_LENGTH => LOG_LENGTH
             )
@@ -358,6 +394,7 @@ begin
     cr_file_0: entity work.cr_file
         generic map (
             SIM => SIM,
+            CPU_INDEX => CPU_INDEX,
             LOG_LENGTH => LOG_LENGTH
             )
         port map (
@@ -366,6 +403,7 @@ begin
             d_out => cr_file_to_decode2,
             w_in => writeback_to_cr_file,
             sim_dump => sim_cr_dump,
+            dbg_cr_data => dbg_cr_data,
             ctrl => ctrl_debug,
             log_out => log_data(183 downto 171)
             );
@@ -377,12 +415,15 @@ begin
             NCPUS => NCPUS,
             EX1_BYPASS => EX1_BYPASS,
             HAS_FPU => HAS_FPU,
-            LOG_LENGTH => LOG_LENGTH
+            LOG_LENGTH => LOG_LENGTH,
+            HAS_TIME_SKIP => HAS_TIME_SKIP
             )
         port map (
             clk => clk,
             rst => rst_ex1,
             tb_ctrl => tb_ctrl,
+            tb_skip => dbg_tb_skip,
+            tb_skip_valid => dbg_tb_skip_valid,
             flush_in => flush,
 	    busy_out => ex1_busy_out,
             e_in => decode2_to_execute1,
@@ -399,6 +440,8 @@ begin
             bypass2_cr_data => execute2_cr_bypass,
 	    icache_inval => ex1_icache_inval,
             dbg_ctrl_out => ctrl_debug,
+            last_nia_out => last_nia,
+            sim_lr_out => sim_lr,
             wb_events => writeback_events,
             ls_events => loadstore_events,
             dc_events => dcache_events,
@@ -515,12 +558,20 @@ begin
             complete_out => complete
             );
 
-    log_data(150) <= '0';
+    -- FPU completions, a cycle late to line up with execute1's log
+    fpu_log: process(clk)
+    begin
+        if rising_edge(clk) then
+            log_data(150) <= fpu_to_writeback.valid;
+        end if;
+    end process;
     log_data(139 downto 136) <= "0000";
 
     debug_0: entity work.core_debug
         generic map (
-            LOG_LENGTH => LOG_LENGTH
+            LOG_LENGTH => LOG_LENGTH,
+            HAS_ICOUNT => HAS_ICOUNT,
+            HAS_NIA_TRIGGER => HAS_NIA_TRIGGER
             )
 	port map (
 	    clk => clk,
@@ -536,8 +587,12 @@ begin
 	    icache_rst => dbg_icache_rst,
 	    terminate => terminate,
 	    core_stopped => dbg_core_is_stopped,
+            core_waiting => ctrl_debug.wait_state,
+            ext_irq => ext_irq,
 	    nia => fetch1_to_icache.nia,
             msr => ctrl_debug.msr,
+            last_nia => last_nia,
+            instr_complete => complete.valid,
             wb_snoop_in => wb_snoop_in,
             dbg_gpr_req => dbg_gpr_req,
             dbg_gpr_ack => dbg_gpr_ack,
@@ -551,11 +606,38 @@ begin
             dbg_ls_spr_ack => dbg_ls_spr_ack,
             dbg_ls_spr_addr => dbg_ls_spr_addr,
             dbg_ls_spr_data => dbg_ls_spr_data,
+            dbg_cr_data => dbg_cr_data,
             log_data => log_data,
             log_read_addr => log_rd_addr,
             log_read_data => log_rd_data,
             log_write_addr => log_wr_addr,
+            tb_skip => dbg_tb_skip,
+            tb_skip_valid => dbg_tb_skip_valid,
 	    terminated_out => terminated_out
 	    );
 
+    stats: if SIM generate
+        stats_0: sim_core_stats
+            generic map (
+                CPU_INDEX => CPU_INDEX
+                )
+            port map (
+                clk => clk,
+                rst => core_rst,
+                instr_complete => complete.valid
+                );
+
+        profile_0: sim_core_profile
+            generic map (
+                CPU_INDEX => CPU_INDEX
+                )
+            port map (
+                clk => clk,
+                rst => core_rst,
+                nia => last_nia,
+                lr => sim_lr,
+                pr => ctrl_debug.msr(MSR_PR)
+                );
+    end generate;
+
 end behave;
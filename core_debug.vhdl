@@ -10,7 +10,11 @@ use work.wishbone_types.all;
 entity core_debug is
     generic (
         -- Length of log buffer
-        LOG_LENGTH : natural := 512
+        LOG_LENGTH : natural := 512;
+        -- Count completed instructions for DBG_CORE_ICOUNT
+        HAS_ICOUNT : boolean := false;
+        -- Watch the fetch NIA for DBG_CORE_NIA_TRIGGER
+        HAS_NIA_TRIGGER : boolean := false
         );
     port (
         clk             : in std_logic;
@@ -31,8 +35,12 @@ entity core_debug is
         -- Core status inputs
         terminate       : in std_ulogic;
         core_stopped    : in std_ulogic;
+        core_waiting    : in std_ulogic := '0';
+        ext_irq         : in std_ulogic := '0';
         nia             : in std_ulogic_vector(63 downto 0);
         msr             : in std_ulogic_vector(63 downto 0);
+        last_nia        : in std_ulogic_vector(63 downto 0) := (others => '0');
+        instr_complete  : in std_ulogic := '0';
         wb_snoop_in     : in wishbone_master_out := wishbone_master_out_init;
 
         -- GPR/FPR register read port
@@ -53,12 +61,19 @@ entity core_debug is
         dbg_ls_spr_addr : out std_ulogic_vector(1 downto 0);
         dbg_ls_spr_data : in std_ulogic_vector(63 downto 0);
 
+        -- CR, read directly
+        dbg_cr_data     : in std_ulogic_vector(31 downto 0) := (others => '0');
+
         -- Core logging data
         log_data        : in std_ulogic_vector(255 downto 0);
         log_read_addr   : in std_ulogic_vector(31 downto 0);
         log_read_data   : out std_ulogic_vector(63 downto 0);
         log_write_addr  : out std_ulogic_vector(31 downto 0);
 
+        -- Move the timebase and decrementer forward (HAS_TIME_SKIP)
+        tb_skip         : out std_ulogic_vector(63 downto 0);
+        tb_skip_valid   : out std_ulogic;
+
         -- Misc
         terminated_out  : out std_ulogic
         );
@@ -85,10 +100,14 @@ architecture behave of core_debug is
     -- bit    0 : Core stopping (wait til bit 1 set)
     -- bit    1 : Core stopped
     -- bit    2 : Core terminated (clears with start or reset)
+    -- bit    3 : Core waiting (executed wait, no interrupt yet)
+    -- bit    4 : External interrupt pending from the XICS
     constant DBG_CORE_STAT           : std_ulogic_vector(3 downto 0) := "0001";
     constant DBG_CORE_STAT_STOPPING  : integer := 0;
     constant DBG_CORE_STAT_STOPPED   : integer := 1;
     constant DBG_CORE_STAT_TERM      : integer := 2;
+    constant DBG_CORE_STAT_WAITING   : integer := 3;
+    constant DBG_CORE_STAT_IRQ       : integer := 4;
 
     -- NIA register (read only for now)
     constant DBG_CORE_NIA             : std_ulogic_vector(3 downto 0) := "0010";
@@ -108,6 +127,24 @@ architecture behave of core_debug is
     constant DBG_CORE_LOG_TRIGGER    : std_ulogic_vector(3 downto 0) := "1000";
     constant DBG_CORE_LOG_MTRIGGER   : std_ulogic_vector(3 downto 0) := "1001";
 
+    -- Completed instruction count since reset (read only, 0 without
+    -- HAS_ICOUNT)
+    constant DBG_CORE_ICOUNT         : std_ulogic_vector(3 downto 0) := "1010";
+
+    -- Write N to account for N cycles that weren't simulated: the timebase
+    -- and decrementer move on by N (write only, needs HAS_TIME_SKIP)
+    constant DBG_CORE_TB_SKIP        : std_ulogic_vector(3 downto 0) := "1011";
+
+    -- Profiling sample (read only): address of the last instruction
+    -- executed, with MSR[PR] in bit 0
+    constant DBG_CORE_SAMPLE         : std_ulogic_vector(3 downto 0) := "1100";
+
+    -- NIA trigger (needs HAS_NIA_TRIGGER)
+    -- bits 63:2 : address
+    -- bit      1 : fetch got there (sticky, cleared by a write)
+    -- bit      0 : enable
+    constant DBG_CORE_NIA_TRIGGER    : std_ulogic_vector(3 downto 0) := "1101";
+
     constant LOG_INDEX_BITS : natural := log2(LOG_LENGTH);
 
     -- Some internal wires
@@ -124,6 +161,7 @@ architecture behave of core_debug is
     signal gspr_data    : std_ulogic_vector(63 downto 0);
 
     signal spr_index_valid : std_ulogic;
+    signal cr_index_valid : std_ulogic;
 
     signal log_dmi_addr        : std_ulogic_vector(31 downto 0) := (others => '0');
     signal log_dmi_data        : std_ulogic_vector(63 downto 0) := (others => '0');
@@ -138,19 +176,25 @@ architecture behave of core_debug is
     signal dmi_read_log_data_1 : std_ulogic;
     signal log_trigger_delay   : integer range 0 to 255 := 0;
 
+    signal icount : unsigned(63 downto 0) := (others => '0');
+    signal nia_trigger : std_ulogic_vector(63 downto 0) := (others => '0');
+
 begin
        -- Single cycle register accesses on DMI except for GSPR data
     dmi_ack <= dmi_req when dmi_addr /= DBG_CORE_GSPR_DATA
                else dbg_gpr_ack or dbg_spr_ack or dbg_ls_spr_ack;
 
     -- Status register read composition
-    stat_reg <= (2 => terminated,
+    stat_reg <= (4 => ext_irq,
+                 3 => core_waiting,
+                 2 => terminated,
                  1 => core_stopped,
                  0 => stopping,
                  others => '0');
 
     gspr_data <= dbg_gpr_data when gspr_index(5) = '0' else
                  dbg_ls_spr_data when dbg_ls_spr_req = '1' else
+                 32x"0" & dbg_cr_data when cr_index_valid = '1' else
                  dbg_spr_data when spr_index_valid = '1' else
                  (others => '0');
 
@@ -164,8 +208,42 @@ begin
         log_dmi_data    when DBG_CORE_LOG_DATA,
         log_dmi_trigger when DBG_CORE_LOG_TRIGGER,
         log_mem_trigger when DBG_CORE_LOG_MTRIGGER,
+        std_ulogic_vector(icount) when DBG_CORE_ICOUNT,
+        last_nia(63 downto 1) & msr(MSR_PR) when DBG_CORE_SAMPLE,
+        nia_trigger     when DBG_CORE_NIA_TRIGGER,
         (others => '0') when others;
 
+    with_icount: if HAS_ICOUNT generate
+        icount_count: process(clk)
+        begin
+            if rising_edge(clk) then
+                if rst = '1' then
+                    icount <= (others => '0');
+                elsif instr_complete = '1' then
+                    icount <= icount + 1;
+                end if;
+            end if;
+        end process;
+    end generate;
+
+    -- Compared every cycle, so the trigger can't miss a short visit to
+    -- the address the way polling DBG_CORE_NIA can
+    with_nia_trigger: if HAS_NIA_TRIGGER generate
+        nia_watch: process(clk)
+        begin
+            if rising_edge(clk) then
+                if rst = '1' then
+                    nia_trigger <= (others => '0');
+                elsif dmi_req = '1' and dmi_req_1 = '0' and dmi_wr = '1' and
+                    dmi_addr = DBG_CORE_NIA_TRIGGER then
+                    nia_trigger <= dmi_din(63 downto 2) & '0' & dmi_din(0);
+                elsif nia_trigger(0) = '1' and nia(63 downto 2) = nia_trigger(63 downto 2) then
+                    nia_trigger(1) <= '1';
+                end if;
+            end if;
+        end process;
+    end generate;
+
     -- DMI writes
     reg_write: process(clk)
     begin
@@ -175,6 +253,7 @@ begin
             do_reset <= '0';
             do_icreset <= '0';
             do_dmi_log_rd <= '0';
+            tb_skip_valid <= '0';
 
             if (rst) then
                 stopping <= '0';
@@ -238,6 +317,9 @@ begin
                             log_dmi_trigger <= dmi_din;
                         elsif dmi_addr = DBG_CORE_LOG_MTRIGGER then
                             log_mem_trigger <= dmi_din;
+                        elsif dmi_addr = DBG_CORE_TB_SKIP then
+                            tb_skip <= dmi_din;
+                            tb_skip_valid <= '1';
                         end if;
                     else
                         report("DMI read from " & to_string(dmi_addr));
@@ -273,6 +355,7 @@ begin
         variable isram : std_ulogic;
         variable raddr : ramspr_index;
         variable odd : std_ulogic;
+        variable iscr : std_ulogic;
     begin
         if rising_edge(clk) then
             dbg_gpr_req <= '0';
@@ -294,6 +377,7 @@ begin
 
             -- For SPRs, use the same mapping as when the fast SPRs were in the GPR file
             valid := '1';
+            iscr := '0';
             sel := "0000";
             isram := '1';
             raddr := (others => '0');
@@ -336,6 +420,16 @@ begin
                 when 5x"11" =>
                     isram := '0';
                     sel := SPRSEL_CFAR;
+                when 5x"12" =>
+                    isram := '0';
+                    sel := SPRSEL_DEC;
+                when 5x"13" =>
+                    isram := '0';
+                    sel := SPRSEL_TB;
+                when 5x"14" =>
+                    -- CR comes from cr_file, execute1 just provides the ack
+                    isram := '0';
+                    iscr := '1';
                 when others =>
                     valid := '0';
             end case;
@@ -345,6 +439,7 @@ begin
                 dbg_spr_addr <= "0000" & sel;
             end if;
             spr_index_valid <= valid;
+            cr_index_valid <= iscr;
         end if;
     end process;
 
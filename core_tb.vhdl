@@ -7,6 +7,11 @@ use work.common.all;
 use work.wishbone_types.all;
 
 entity core_tb is
+    generic (
+        MEMORY_SIZE   : natural := (384*1024);
+        -- Comma separated files, each optionally followed by @offset
+        MAIN_RAM_FILE : string  := "main_ram.bin"
+        );
 end core_tb;
 
 architecture behave of core_tb is
@@ -19,8 +24,9 @@ begin
     soc0: entity work.soc
         generic map(
             SIM => true,
-            MEMORY_SIZE => (384*1024),
-            RAM_INIT_FILE => "main_ram.bin",
+            HAS_ICOUNT => true,
+            MEMORY_SIZE => MEMORY_SIZE,
+            RAM_INIT_FILE => MAIN_RAM_FILE,
             CLK_FREQ => 100000000
             )
         port map(
@@ -8,6 +8,7 @@ use work.common.all;
 entity cr_file is
     generic (
         SIM : boolean := false;
+        CPU_INDEX : natural := 0;
         -- Non-zero to enable log data collection
         LOG_LENGTH : natural := 0
         );
@@ -22,6 +23,7 @@ entity cr_file is
 
         -- debug
         sim_dump : in std_ulogic;
+        dbg_cr_data : out std_ulogic_vector(31 downto 0);
 
         log_out : out std_ulogic_vector(12 downto 0)
         );
@@ -32,6 +34,20 @@ architecture behaviour of cr_file is
     signal crs_updated : std_ulogic_vector(31 downto 0);
     signal xerc : xer_common_t := xerc_init;
     signal xerc_updated : xer_common_t;
+
+    -- Simulation trace, sim_trace.vhdl
+    component sim_trace_event is
+        generic (
+            EVENT     : natural;
+            CPU_INDEX : natural
+            );
+        port (
+            clk   : in std_ulogic;
+            valid : in std_ulogic;
+            arg   : in std_ulogic_vector(63 downto 0);
+            data  : in std_ulogic_vector(63 downto 0)
+            );
+    end component;
 begin
     cr_create_0: process(all)
         variable hi, lo : integer := 0;
@@ -62,15 +78,9 @@ begin
     begin
         if rising_edge(clk) then
             if w_in.write_cr_enable = '1' then
-                report "Writing " & to_hstring(w_in.write_cr_data) & " to CR mask " & to_hstring(w_in.write_cr_mask);
                 crs <= crs_updated;
             end if;
             if w_in.write_xerc_enable = '1' then
-                report "Writing XERC SO=" & std_ulogic'image(xerc_updated.so) &
-                    " OV=" & std_ulogic'image(xerc_updated.ov) &
-                    " CA=" & std_ulogic'image(xerc_updated.ca) &
-                    " OV32=" & std_ulogic'image(xerc_updated.ov32) &
-                    " CA32=" & std_ulogic'image(xerc_updated.ca32);
                 xerc <= xerc_updated;
             end if;
         end if;
@@ -80,13 +90,13 @@ begin
     cr_read_0: process(all)
     begin
         -- just return the entire CR to make mfcrf easier for now
-        if d_in.read = '1' then
-            report "Reading CR " & to_hstring(crs_updated);
-        end if;
         d_out.read_cr_data <= crs_updated;
         d_out.read_xerc_data <= xerc_updated;
     end process;
 
+    -- Read by the debug interface
+    dbg_cr_data <= crs;
+
     sim_dump_test: if SIM generate
         dump_cr: process(all)
             variable xer : std_ulogic_vector(31 downto 0);
@@ -106,6 +116,33 @@ begin
         end process;
     end generate;
 
+    -- CR and XER writes and CR reads for the simulation trace
+    sim_trace: if SIM generate
+        signal cr_write_arg : std_ulogic_vector(63 downto 0);
+        signal cr_write_data : std_ulogic_vector(63 downto 0);
+        signal xerc_data : std_ulogic_vector(63 downto 0);
+        signal cr_read_data : std_ulogic_vector(63 downto 0);
+    begin
+        cr_write_arg <= 56x"0" & w_in.write_cr_mask;
+        cr_write_data <= 32x"0" & w_in.write_cr_data;
+        xerc_data <= 59x"0" & xerc_updated.ca32 & xerc_updated.ov32 &
+                     xerc_updated.ca & xerc_updated.ov & xerc_updated.so;
+        cr_read_data <= 32x"0" & crs_updated;
+
+        trace_cr_write: sim_trace_event
+            generic map (EVENT => TRACE_CR_WRITE, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => w_in.write_cr_enable,
+                      arg => cr_write_arg, data => cr_write_data);
+        trace_xerc_write: sim_trace_event
+            generic map (EVENT => TRACE_XERC_WRITE, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => w_in.write_xerc_enable,
+                      arg => 64x"0", data => xerc_data);
+        trace_cr_read: sim_trace_event
+            generic map (EVENT => TRACE_CR_READ, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => d_in.read,
+                      arg => 64x"0", data => cr_read_data);
+    end generate;
+
     cf_log: if LOG_LENGTH > 0 generate
         signal log_data : std_ulogic_vector(12 downto 0);
     begin
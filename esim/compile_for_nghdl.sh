@@ -19,6 +19,9 @@ echo "=============================================="
 cc -O3 -Wall -c -o sim_vhpi_c.o sim_vhpi_c.c
 cc -O3 -Wall -c -o sim_console_c.o sim_console_c.c
 cc -O3 -Wall -c -o sim_bram_helpers_c.o sim_bram_helpers_c.c
+cc -O3 -Wall -c -o sim_trace_c.o sim_trace_c.c
+cc -O3 -Wall -c -o sim_stats_c.o sim_stats_c.c
+cc -O3 -Wall -c -o sim_profile_c.o sim_profile_c.c
 
 echo "=============================================="
 echo " Step 1: Compile Microwatt + wrapper"
@@ -28,6 +31,9 @@ ghdl -c --std=08 --workdir="$WORK_DIR" \
     -Wl,sim_vhpi_c.o \
     -Wl,sim_console_c.o \
     -Wl,sim_bram_helpers_c.o \
+    -Wl,sim_trace_c.o \
+    -Wl,sim_stats_c.o \
+    -Wl,sim_profile_c.o \
     decode_types.vhdl \
     common.vhdl \
     wishbone_types.vhdl \
@@ -77,6 +83,9 @@ ghdl -c --std=08 --workdir="$WORK_DIR" \
     sim_console.vhdl \
     sim_pp_uart.vhdl \
     sim_bram_helpers.vhdl \
+    sim_trace.vhdl \
+    sim_stats.vhdl \
+    sim_profile.vhdl \
     sim_bram.vhdl \
     sim_16550_uart.vhdl \
     foreign_random.vhdl \
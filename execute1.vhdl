@@ -18,7 +18,9 @@ entity execute1 is
         CPU_INDEX : natural;
         NCPUS : positive := 1;
         -- Non-zero to enable log data collection
-        LOG_LENGTH : natural := 0
+        LOG_LENGTH : natural := 0;
+        -- Allow the debug interface to move the timebase forward
+        HAS_TIME_SKIP : boolean := false
         );
     port (
 	clk   : in std_ulogic;
@@ -36,6 +38,8 @@ entity execute1 is
         interrupt_in : WritebackToExecute1Type;
 
         tb_ctrl : timebase_ctrl;
+        tb_skip : in std_ulogic_vector(63 downto 0) := (others => '0');
+        tb_skip_valid : in std_ulogic := '0';
 
 	-- asynchronous
         l_out : out Execute1ToLoadstore1Type;
@@ -71,6 +75,8 @@ entity execute1 is
         -- debug
         sim_dump      : in std_ulogic;
         sim_dump_done : out std_ulogic;
+        last_nia_out  : out std_ulogic_vector(63 downto 0);
+        sim_lr_out    : out std_ulogic_vector(63 downto 0);
 
         log_out : out std_ulogic_vector(11 downto 0);
         log_rd_addr : out std_ulogic_vector(31 downto 0);
@@ -479,6 +485,20 @@ architecture behaviour of execute1 is
         end if;
     end;
 
+    -- Simulation trace, sim_trace.vhdl
+    component sim_trace_event is
+        generic (
+            EVENT     : natural;
+            CPU_INDEX : natural
+            );
+        port (
+            clk   : in std_ulogic;
+            valid : in std_ulogic;
+            arg   : in std_ulogic_vector(63 downto 0);
+            data  : in std_ulogic_vector(63 downto 0)
+            );
+    end component;
+
     -- Tell vivado to keep the hierarchy for the random module so that the
     -- net names in the xdc file match.
     attribute keep_hierarchy : string;
@@ -616,6 +636,9 @@ begin
             thi := std_ulogic_vector(unsigned(thi) + carry);
         end if;
         tb_next <= thi & tlo;
+        if HAS_TIME_SKIP and tb_skip_valid = '1' and tb_ctrl.freeze = '0' then
+            tb_next <= std_ulogic_vector(unsigned(timebase) + unsigned(tb_skip) + 1);
+        end if;
     end process;
 
     dec_sign <= (ctrl.dec(63) and ctrl.lpcr_ld) or (ctrl.dec(31) and not ctrl.lpcr_ld);
@@ -623,6 +646,18 @@ begin
     dbg_ctrl_out <= ctrl;
     log_rd_addr <= ex2.log_addr_spr;
 
+    -- Address of the last instruction executed, sampled by profilers
+    last_nia_out <= ex1.e.last_nia;
+
+    -- LR for the simulation profiler, kept out of synthesis as it is
+    -- another read port on the SPR RAM
+    sim_lr: if SIM generate
+        sim_lr_out <= even_sprs(to_integer(RAMSPR_LR));
+    end generate;
+    no_sim_lr: if not SIM generate
+        sim_lr_out <= (others => '0');
+    end generate;
+
     -- Doorbells
     doorbell_sync : process(clk)
     begin
@@ -770,14 +805,10 @@ begin
             if ramspr_even_wr_enab = '1' then
 		assert not is_X(ramspr_wr_addr) report "Writing to unknown address" severity FAILURE;
                 even_sprs(to_integer(ramspr_wr_addr)) <= ramspr_even_wr_data;
-                report "writing even spr " & integer'image(to_integer(ramspr_wr_addr)) & " data=" &
-                    to_hstring(ramspr_even_wr_data);
             end if;
             if ramspr_odd_wr_enab = '1' then
 		assert not is_X(ramspr_wr_addr) report "Writing to unknown address" severity FAILURE;
                 odd_sprs(to_integer(ramspr_wr_addr)) <= ramspr_odd_wr_data;
-                report "writing odd spr " & integer'image(to_integer(ramspr_wr_addr)) & " data=" &
-                    to_hstring(ramspr_odd_wr_data);
             end if;
         end if;
     end process;
@@ -806,13 +837,6 @@ begin
                 ex1 <= ex1in;
                 ex2 <= ex2in;
                 ctrl <= ctrl_tmp;
-                if valid_in = '1' then
-                    report "CPU " & natural'image(CPU_INDEX) & " execute " & to_hstring(e_in.nia) &
-                        " op=" & insn_type_t'image(e_in.insn_type) &
-                        " wr=" & to_hstring(ex1in.e.write_reg) & " we=" & std_ulogic'image(ex1in.e.write_enable) &
-                        " tag=" & integer'image(ex1in.e.instr_tag.tag) & std_ulogic'image(ex1in.e.instr_tag.valid) &
-                        " 2nd=" & std_ulogic'image(e_in.second);
-                end if;
                 -- We mustn't get stalled on a cycle where execute2 is
                 -- completing an instruction or generating an interrupt
                 if ex2.e.valid = '1' or ex2.e.interrupt = '1' then
@@ -839,6 +863,10 @@ begin
                                 dbg_spr_data <= ctrl.heir;
                             when SPRSEL_CFAR =>
                                 dbg_spr_data <= ctrl.cfar;
+                            when SPRSEL_DEC =>
+                                dbg_spr_data <= assemble_dec(ctrl);
+                            when SPRSEL_TB =>
+                                dbg_spr_data <= timebase;
                             when others =>
                                 dbg_spr_data <= assemble_xer(xerc_in, ctrl.xer_low);
                         end case;
@@ -2088,6 +2116,9 @@ begin
 
 	ctrl_tmp <= ctrl;
 	ctrl_tmp.dec <= std_ulogic_vector(unsigned(ctrl.dec) - 1);
+        if HAS_TIME_SKIP and tb_skip_valid = '1' then
+            ctrl_tmp.dec <= std_ulogic_vector(unsigned(ctrl.dec) - unsigned(tb_skip) - 1);
+        end if;
 
         x_to_pmu.mfspr <= '0';
         x_to_pmu.mtspr <= '0';
@@ -2305,6 +2336,35 @@ begin
         sim_dump_done <= '0';
     end generate;
 
+    -- Executed instructions and SPR writes for the simulation trace
+    sim_trace: if SIM generate
+        signal exec_valid : std_ulogic;
+        signal exec_arg : std_ulogic_vector(63 downto 0);
+        signal even_arg : std_ulogic_vector(63 downto 0);
+        signal odd_arg : std_ulogic_vector(63 downto 0);
+    begin
+        exec_valid <= valid_in and not rst;
+        exec_arg <= 39x"0" & ex1in.e.instr_tag.valid &
+                    std_ulogic_vector(to_unsigned(ex1in.e.instr_tag.tag, 8)) &
+                    e_in.second & ex1in.e.write_enable & ex1in.e.write_reg &
+                    std_ulogic_vector(to_unsigned(insn_type_t'pos(e_in.insn_type), 8));
+        even_arg <= 61x"0" & std_ulogic_vector(ramspr_wr_addr);
+        odd_arg <= 55x"0" & '1' & 5x"0" & std_ulogic_vector(ramspr_wr_addr);
+
+        trace_execute: sim_trace_event
+            generic map (EVENT => TRACE_EXECUTE, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => exec_valid,
+                      arg => exec_arg, data => e_in.nia);
+        trace_even_spr: sim_trace_event
+            generic map (EVENT => TRACE_SPR_WRITE, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => ramspr_even_wr_enab,
+                      arg => even_arg, data => ramspr_even_wr_data);
+        trace_odd_spr: sim_trace_event
+            generic map (EVENT => TRACE_SPR_WRITE, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => ramspr_odd_wr_enab,
+                      arg => odd_arg, data => ramspr_odd_wr_data);
+    end generate;
+
     e1_log: if LOG_LENGTH > 0 generate
         signal log_data : std_ulogic_vector(11 downto 0);
     begin
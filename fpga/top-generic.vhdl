@@ -11,8 +11,12 @@ entity toplevel is
 	RESET_LOW     : boolean  := true;
 	CLK_INPUT     : positive := 100000000;
 	CLK_FREQUENCY : positive := 100000000;
+        CPUS          : natural  := 1;
         HAS_FPU       : boolean  := true;
         HAS_BTC       : boolean  := false;
+        HAS_TIME_SKIP : boolean  := false;
+        HAS_ICOUNT    : boolean  := false;
+        HAS_NIA_TRIGGER : boolean := false;
         ICACHE_NUM_LINES : natural := 64;
         LOG_LENGTH    : natural := 512;
 	DISABLE_FLATTEN_CORE : boolean := false;
@@ -72,8 +76,12 @@ begin
 	    RAM_INIT_FILE => RAM_INIT_FILE,
 	    SIM           => false,
 	    CLK_FREQ      => CLK_FREQUENCY,
+            NCPUS         => CPUS,
             HAS_FPU       => HAS_FPU,
             HAS_BTC       => HAS_BTC,
+            HAS_TIME_SKIP => HAS_TIME_SKIP,
+            HAS_ICOUNT    => HAS_ICOUNT,
+            HAS_NIA_TRIGGER => HAS_NIA_TRIGGER,
 	    ICACHE_NUM_LINES => ICACHE_NUM_LINES,
             LOG_LENGTH    => LOG_LENGTH,
 	    DISABLE_FLATTEN_CORE => DISABLE_FLATTEN_CORE,
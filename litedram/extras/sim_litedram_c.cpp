@@ -8,12 +8,19 @@
 #include <poll.h>
 
 #include "sim_vhpi_c.h"
+#include "sim_litedram_fast.h"
 #include "Vlitedram_core.h"
 #include "verilated_vcd_c.h"
 
 static Vlitedram_core *v;
 vluint64_t main_time = 0;
 
+/* SIM_DRAM_MODEL=fast hands everything to the functional model */
+static bool fast_model;
+
+/* Inputs changed since the last eval */
+static bool dirty;
+
 #if VM_TRACE
 VerilatedVcdC *tfp;
 #endif
@@ -31,8 +38,19 @@ static void cleanup(void)
 
 static inline void check_init(bool traces)
 {
-	if (v)
+	const char *model;
+
+	if (v || fast_model)
 		return;
+	model = getenv("SIM_DRAM_MODEL");
+	if (model && !strcmp(model, "fast")) {
+		fast_model = true;
+		return;
+	}
+	if (model && strcmp(model, "litedram")) {
+		fprintf(stderr, "SIM_DRAM_MODEL should be litedram or fast, not %s\n", model);
+		exit(1);
+	}
 	// XX Catch exceptions ?
 	v = new Vlitedram_core;
 	if (!v) {
@@ -51,7 +69,8 @@ static inline void check_init(bool traces)
 	atexit(cleanup);
 }
 
-unsigned char get_bit(unsigned char **p)
+/* Walk the flattened request vectors with the sim_vhpi_c.h converters */
+static inline unsigned char get_bit(unsigned char **p)
 {
 	unsigned char b = **p;
 
@@ -60,26 +79,57 @@ unsigned char get_bit(unsigned char **p)
 	return b  == vhpi1 ? 1  : 0;
 }
 
-uint64_t get_bits(unsigned char **p, int len)
+static inline uint64_t get_bits(unsigned char **p, int len)
 {
-	uint64_t r = 0;
+	uint64_t r = vhpi_get_bits(*p, len, NULL);
+
+	*p = *p + len;
 
-	while(len--)
-		r = (r << 1) | get_bit(p);
-	
 	return r;
 }
 
-void set_bit(unsigned char **p, int bit)
+static inline void set_bit(unsigned char **p, int bit)
 {
 	**p = bit ? vhpi1 : vhpi0;
 	*p = *p + 1;
 }
 
-void set_bits(unsigned char **p, uint64_t val, int len)
+static inline void set_bits(unsigned char **p, uint64_t val, int len)
 {
-	while(len--)
-		set_bit(p, (val >> len) & 1);
+	vhpi_set_bits(*p, val, len);
+	*p = *p + len;
+}
+
+/* 128 bit DRAM data, Verilator keeps it as 32 bit words LSB first */
+template <typename T> static inline void get_data128(unsigned char **p, T &w)
+{
+	uint64_t d[2];
+	uint32_t n[4];
+
+	vhpi_get_wide(*p, 128, d);
+	*p = *p + 128;
+
+	n[0] = d[0];
+	n[1] = d[0] >> 32;
+	n[2] = d[1];
+	n[3] = d[1] >> 32;
+	for (int i = 0; i < 4; i++) {
+		if (w[i] != n[i]) {
+			w[i] = n[i];
+			dirty = true;
+		}
+	}
+}
+
+template <typename T> static inline void set_data128(unsigned char **p, T &w)
+{
+	uint64_t d[2];
+
+	d[0] = ((uint64_t)w[1] << 32) | w[0];
+	d[1] = ((uint64_t)w[3] << 32) | w[2];
+
+	vhpi_set_wide(*p, d, 128);
+	*p = *p + 128;
 }
 
 double sc_time_stamp(void)
@@ -95,8 +145,23 @@ double sc_time_stamp(void)
 			fprintf(stderr, "WARNING: %s exp %d got %d\n", __func__, __e, __s); \
 	} while(0)
 
+/*
+ * Only an input that changed needs an eval before the outputs are read,
+ * so the calls on the falling edge, where nothing usually has, cost
+ * nothing, and the two sets before a get share one eval.
+ */
+#define set_input(sig, val)						\
+	do {								\
+		uint64_t __v = (val);					\
+		if (v->sig != __v) {					\
+			v->sig = __v;					\
+			dirty = true;					\
+		}							\
+	} while (0)
+
 static void do_eval(void)
 {
+	dirty = false;
 	v->eval();
 #if VM_TRACE
 	if (tfp)
@@ -110,19 +175,21 @@ extern "C" void litedram_set_wb(unsigned char *req)
 	unsigned char *orig = req;
 
 	check_init(false);
-	
-	v->wb_ctrl_cti   = get_bits(&req, 3);
-	v->wb_ctrl_bte   = get_bits(&req, 2);
-	v->wb_ctrl_sel   = get_bits(&req, 4);
-	v->wb_ctrl_we    = get_bit(&req);
-	v->wb_ctrl_stb   = get_bit(&req);
-	v->wb_ctrl_cyc   = get_bit(&req);
-	v->wb_ctrl_adr   = get_bits(&req, 30);
-	v->wb_ctrl_dat_w = get_bits(&req, 32);
+	if (fast_model) {
+		litedram_fast_set_wb(req);
+		return;
+	}
 
-	check_size(req - orig, 74);
+	set_input(wb_ctrl_cti,   get_bits(&req, 3));
+	set_input(wb_ctrl_bte,   get_bits(&req, 2));
+	set_input(wb_ctrl_sel,   get_bits(&req, 4));
+	set_input(wb_ctrl_we,    get_bit(&req));
+	set_input(wb_ctrl_stb,   get_bit(&req));
+	set_input(wb_ctrl_cyc,   get_bit(&req));
+	set_input(wb_ctrl_adr,   get_bits(&req, 30));
+	set_input(wb_ctrl_dat_w, get_bits(&req, 32));
 
-	do_eval();
+	check_size(req - orig, 74);
 }
 
 extern "C" void litedram_get_wb(unsigned char *req)
@@ -130,6 +197,12 @@ extern "C" void litedram_get_wb(unsigned char *req)
 	unsigned char *orig = req;
 
 	check_init(false);
+	if (fast_model) {
+		litedram_fast_get_wb(req);
+		return;
+	}
+	if (dirty)
+		do_eval();
 
 	set_bit(&req, v->init_error);
 	set_bit(&req, v->init_done);
@@ -145,21 +218,20 @@ extern "C" void litedram_set_user(unsigned char *req)
 	unsigned char *orig = req;
 
 	check_init(false);
+	if (fast_model) {
+		litedram_fast_set_user(req);
+		return;
+	}
 
-	v->user_port_native_0_cmd_valid     = get_bit(&req);
-	v->user_port_native_0_cmd_we        = get_bit(&req);
-	v->user_port_native_0_wdata_valid   = get_bit(&req);
-	v->user_port_native_0_rdata_ready   = get_bit(&req);
-	v->user_port_native_0_cmd_addr      = get_bits(&req, 24);
-	v->user_port_native_0_wdata_we      = get_bits(&req, 16);
-	v->user_port_native_0_wdata_data[3] = get_bits(&req, 32);
-	v->user_port_native_0_wdata_data[2] = get_bits(&req, 32);
-	v->user_port_native_0_wdata_data[1] = get_bits(&req, 32);
-	v->user_port_native_0_wdata_data[0] = get_bits(&req, 32);
+	set_input(user_port_native_0_cmd_valid,   get_bit(&req));
+	set_input(user_port_native_0_cmd_we,      get_bit(&req));
+	set_input(user_port_native_0_wdata_valid, get_bit(&req));
+	set_input(user_port_native_0_rdata_ready, get_bit(&req));
+	set_input(user_port_native_0_cmd_addr,    get_bits(&req, 24));
+	set_input(user_port_native_0_wdata_we,    get_bits(&req, 16));
+	get_data128(&req, v->user_port_native_0_wdata_data);
 
 	check_size(req - orig, 172);
-
-	do_eval();
 }
 
 extern "C" void litedram_get_user(unsigned char *req)
@@ -167,14 +239,17 @@ extern "C" void litedram_get_user(unsigned char *req)
 	unsigned char *orig = req;
 
 	check_init(false);
+	if (fast_model) {
+		litedram_fast_get_user(req);
+		return;
+	}
+	if (dirty)
+		do_eval();
 
 	set_bit(&req, v->user_port_native_0_cmd_ready);
 	set_bit(&req, v->user_port_native_0_wdata_ready);
 	set_bit(&req, v->user_port_native_0_rdata_valid);
-	set_bits(&req, v->user_port_native_0_rdata_data[3], 32);
-	set_bits(&req, v->user_port_native_0_rdata_data[2], 32);
-	set_bits(&req, v->user_port_native_0_rdata_data[1], 32);
-	set_bits(&req, v->user_port_native_0_rdata_data[0], 32);
+	set_data128(&req, v->user_port_native_0_rdata_data);
 
 	check_size(req - orig, 131);
 }
@@ -182,7 +257,13 @@ extern "C" void litedram_get_user(unsigned char *req)
 extern "C" void litedram_clock(void)
 {
 	check_init(false);
+	if (fast_model) {
+		litedram_fast_clock();
+		return;
+	}
 
+	if (dirty)
+		do_eval();
 	v->clk = 1;
 	do_eval();
 	v->clk = 0;
@@ -192,6 +273,8 @@ extern "C" void litedram_clock(void)
 extern "C" void litedram_init(int trace_on)
 {
 	check_init(!!trace_on);
+	if (fast_model)
+		litedram_fast_init(trace_on);
 }
 
 	
@@ -0,0 +1,15 @@
+/* Functional DRAM model, see sim_litedram_fast_c.c */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void litedram_fast_set_wb(unsigned char *req);
+void litedram_fast_get_wb(unsigned char *rsp);
+void litedram_fast_set_user(unsigned char *req);
+void litedram_fast_get_user(unsigned char *rsp);
+void litedram_fast_clock(void);
+void litedram_fast_init(int trace_on);
+
+#ifdef __cplusplus
+}
+#endif
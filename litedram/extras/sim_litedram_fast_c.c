@@ -0,0 +1,303 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sim_vhpi_c.h"
+#include "sim_litedram_fast.h"
+
+/*
+ * Functional model of litedram_core for dram_tb and core_dram_tb, behind
+ * the same VHPI calls as the verilated controller in sim_litedram_c.cpp.
+ * It is selected by building with SIM_DRAM=fast, or at runtime with
+ * SIM_DRAM_MODEL=fast when the verilated controller is linked in too.
+ *
+ * The native user port takes one command a clock into an in order queue
+ * of up to QUEUE_DEPTH, like the controller's command buffer. A read
+ * returns its data SIM_DRAM_LATENCY clocks after the command went in,
+ * which is either a fixed number or a min-max range to pick uniformly
+ * from, and a write takes its data from the store queue on the clock
+ * after. Nothing overtakes, one transfer happens a clock, and the data
+ * lives in a sparse array of pages allocated when first written.
+ *
+ * There is no PHY to train, so init_done is set from the start. CSRs
+ * read back what was last written to them and all ones before that, so
+ * the init firmware finds ddrctrl's init_done set and skips calibration.
+ */
+
+#define USER_ADDR_BITS	24
+#define LINE_SIZE	16
+#define PAGE_SHIFT	16
+#define PAGE_SIZE	(1UL << PAGE_SHIFT)
+#define NR_PAGES	((LINE_SIZE << USER_ADDR_BITS) >> PAGE_SHIFT)
+#define CSR_WORDS	(1 << 14)
+#define QUEUE_DEPTH	16
+#define DEFAULT_LATENCY	20
+
+struct dram_cmd {
+	uint32_t addr;
+	bool	we;
+	uint64_t ready;
+};
+
+static bool initialised;
+static unsigned char *pages[NR_PAGES];
+static uint32_t csrs[CSR_WORDS];
+static uint64_t cycle;
+static unsigned long lat_min, lat_max;
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+static struct dram_cmd queue[QUEUE_DEPTH];
+static unsigned int q_head, q_count;
+static uint64_t last_ready;
+
+/* Inputs as last set, and the wishbone response */
+static struct {
+	bool	cyc, stb, we;
+	uint32_t adr, dat_w, sel;
+} wb;
+static bool wb_ack;
+static uint32_t wb_dat_r;
+
+static struct {
+	bool	cmd_valid, cmd_we, wdata_valid, rdata_ready;
+	uint32_t cmd_addr, wdata_we;
+	uint64_t wdata[2];
+} user;
+
+static void fast_init(void)
+{
+	const char *s = getenv("SIM_DRAM_LATENCY");
+	char *end;
+
+	initialised = true;
+	memset(csrs, 0xff, sizeof(csrs));
+
+	lat_min = lat_max = DEFAULT_LATENCY;
+	if (s) {
+		lat_min = lat_max = strtoul(s, &end, 0);
+		if (*end == '-')
+			lat_max = strtoul(end + 1, &end, 0);
+		if (*end || !lat_min || lat_max < lat_min) {
+			fprintf(stderr, "SIM_DRAM_LATENCY should be <cycles> or <min>-<max>, not %s\n", s);
+			exit(1);
+		}
+	}
+}
+
+static inline void check_init(void)
+{
+	if (!initialised)
+		fast_init();
+}
+
+static unsigned long latency(void)
+{
+	if (lat_min == lat_max)
+		return lat_min;
+
+	/* xorshift64, so that runs are repeatable */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return lat_min + rand_state % (lat_max - lat_min + 1);
+}
+
+static unsigned char *line(uint32_t addr, bool alloc)
+{
+	unsigned long off = (unsigned long)addr * LINE_SIZE;
+	unsigned char **page = &pages[off >> PAGE_SHIFT];
+
+	if (!*page) {
+		if (!alloc)
+			return NULL;
+		*page = calloc(1, PAGE_SIZE);
+		if (!*page) {
+			perror("calloc");
+			exit(1);
+		}
+	}
+
+	return *page + (off & (PAGE_SIZE - 1));
+}
+
+static inline struct dram_cmd *head(void)
+{
+	return q_count ? &queue[q_head] : NULL;
+}
+
+static inline bool wdata_ready(void)
+{
+	struct dram_cmd *c = head();
+
+	return c && c->we && c->ready <= cycle;
+}
+
+static inline bool rdata_valid(void)
+{
+	struct dram_cmd *c = head();
+
+	return c && !c->we && c->ready <= cycle;
+}
+
+void litedram_fast_set_wb(unsigned char *req)
+{
+	check_init();
+
+	/* cti and bte don't matter, the CSR bus only does single beats */
+	req += 5;
+	wb.sel = vhpi_get_bits(req, 4, NULL);
+	wb.we = req[4] == vhpi1;
+	wb.stb = req[5] == vhpi1;
+	wb.cyc = req[6] == vhpi1;
+	wb.adr = vhpi_get_bits(req + 7, 30, NULL);
+	wb.dat_w = vhpi_get_bits(req + 37, 32, NULL);
+}
+
+void litedram_fast_get_wb(unsigned char *rsp)
+{
+	check_init();
+
+	rsp[0] = vhpi0;			/* init_error */
+	rsp[1] = vhpi1;			/* init_done */
+	rsp[2] = vhpi0;			/* err */
+	rsp[3] = wb_ack ? vhpi1 : vhpi0;
+	vhpi_set_bits(rsp + 4, wb_dat_r, 32);
+}
+
+void litedram_fast_set_user(unsigned char *req)
+{
+	check_init();
+
+	user.cmd_valid = req[0] == vhpi1;
+	user.cmd_we = req[1] == vhpi1;
+	user.wdata_valid = req[2] == vhpi1;
+	user.rdata_ready = req[3] == vhpi1;
+	user.cmd_addr = vhpi_get_bits(req + 4, USER_ADDR_BITS, NULL);
+	/* Only look at the data when there is a write to take it */
+	if (wdata_ready()) {
+		user.wdata_we = vhpi_get_bits(req + 28, 16, NULL);
+		vhpi_get_wide(req + 44, 128, user.wdata);
+	}
+}
+
+void litedram_fast_get_user(unsigned char *rsp)
+{
+	uint64_t d[2] = { 0, 0 };
+	unsigned char *p;
+
+	check_init();
+
+	rsp[0] = q_count < QUEUE_DEPTH ? vhpi1 : vhpi0;	/* cmd_ready */
+	rsp[1] = wdata_ready() ? vhpi1 : vhpi0;
+	rsp[2] = rdata_valid() ? vhpi1 : vhpi0;
+	if (rdata_valid() && (p = line(head()->addr, false)))
+		memcpy(d, p, LINE_SIZE);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	d[0] = __builtin_bswap64(d[0]);
+	d[1] = __builtin_bswap64(d[1]);
+#endif
+	vhpi_set_wide(rsp + 3, d, 128);
+}
+
+static void write_line(uint32_t addr, uint32_t we, const uint64_t *data)
+{
+	unsigned char *p;
+	int i;
+
+	if (!we)
+		return;
+	p = line(addr, true);
+	for (i = 0; i < LINE_SIZE; i++)
+		if (we & (1u << i))
+			p[i] = data[i / 8] >> (8 * (i % 8));
+}
+
+void litedram_fast_clock(void)
+{
+	bool cmd_ready = q_count < QUEUE_DEPTH;
+	struct dram_cmd *c;
+	uint64_t ready;
+
+	check_init();
+
+	/* CSRs ack a clock after the strobe, as the wrapper expects */
+	if (wb.cyc && wb.stb && !wb_ack) {
+		uint32_t *r = &csrs[wb.adr % CSR_WORDS];
+
+		if (wb.we) {
+			uint32_t mask = 0;
+
+			for (int i = 0; i < 4; i++)
+				if (wb.sel & (1u << i))
+					mask |= 0xffu << (8 * i);
+			*r = (*r & ~mask) | (wb.dat_w & mask);
+		}
+		wb_dat_r = *r;
+		wb_ack = true;
+	} else
+		wb_ack = false;
+
+	/* The head of the queue goes first, as seen before this edge */
+	if ((wdata_ready() && user.wdata_valid) ||
+	    (rdata_valid() && user.rdata_ready)) {
+		c = head();
+		if (c->we)
+			write_line(c->addr, user.wdata_we, user.wdata);
+		q_head = (q_head + 1) % QUEUE_DEPTH;
+		q_count--;
+	}
+
+	if (user.cmd_valid && cmd_ready) {
+		c = &queue[(q_head + q_count++) % QUEUE_DEPTH];
+		c->addr = user.cmd_addr;
+		c->we = user.cmd_we;
+		ready = cycle + (c->we ? 1 : latency());
+		if (ready <= last_ready)
+			ready = last_ready + 1;
+		c->ready = last_ready = ready;
+	}
+
+	cycle++;
+}
+
+void litedram_fast_init(int trace_on)
+{
+	check_init();
+	if (trace_on)
+		fprintf(stderr, "The fast DRAM model has no trace\n");
+}
+
+#ifdef SIM_DRAM_FAST_ONLY
+/* Built without the verilated controller, these are the VHPI calls */
+void litedram_set_wb(unsigned char *req)
+{
+	litedram_fast_set_wb(req);
+}
+
+void litedram_get_wb(unsigned char *rsp)
+{
+	litedram_fast_get_wb(rsp);
+}
+
+void litedram_set_user(unsigned char *req)
+{
+	litedram_fast_set_user(req);
+}
+
+void litedram_get_user(unsigned char *rsp)
+{
+	litedram_fast_get_user(rsp);
+}
+
+void litedram_clock(void)
+{
+	litedram_fast_clock();
+}
+
+void litedram_init(int trace_on)
+{
+	litedram_fast_init(trace_on);
+}
+#endif
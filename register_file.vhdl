@@ -8,6 +8,7 @@ use work.common.all;
 entity register_file is
     generic (
         SIM : boolean := false;
+        CPU_INDEX : natural := 0;
         HAS_FPU : boolean := true;
         -- Non-zero to enable log data collection
         LOG_LENGTH : natural := 0
@@ -53,6 +54,20 @@ architecture behaviour of register_file is
     signal data_3 : std_ulogic_vector(63 downto 0);
     signal prev_write_data : std_ulogic_vector(63 downto 0);
 
+    -- Simulation trace, sim_trace.vhdl
+    component sim_trace_event is
+        generic (
+            EVENT     : natural;
+            CPU_INDEX : natural
+            );
+        port (
+            clk   : in std_ulogic;
+            valid : in std_ulogic;
+            arg   : in std_ulogic_vector(63 downto 0);
+            data  : in std_ulogic_vector(63 downto 0)
+            );
+    end component;
+
 begin
     -- synchronous reads and writes
     register_write_0: process(clk)
@@ -63,11 +78,8 @@ begin
         if rising_edge(clk) then
             if w_in.write_enable = '1' then
                 w_addr := w_in.write_reg;
-                if HAS_FPU and w_addr(5) = '1' then
-                    report "Writing FPR " & to_hstring(w_addr(4 downto 0)) & " " & to_hstring(w_in.write_data);
-                else
+                if not HAS_FPU then
                     w_addr(5) := '0';
-                    report "Writing GPR " & to_hstring(w_addr) & " " & to_hstring(w_in.write_data);
                 end if;
                 assert not(is_x(w_in.write_data)) and not(is_x(w_in.write_reg)) severity failure;
                 registers(to_integer(unsigned(w_addr))) <= w_in.write_data;
@@ -159,16 +171,6 @@ begin
             out_data_3 := prev_write_data;
         end if;
 
-        if d_in.read1_enable = '1' then
-            report "Reading GPR " & to_hstring(addr_1_reg) & " " & to_hstring(out_data_1);
-        end if;
-        if d_in.read2_enable = '1' then
-            report "Reading GPR " & to_hstring(addr_2_reg) & " " & to_hstring(out_data_2);
-        end if;
-        if d_in.read3_enable = '1' then
-            report "Reading GPR " & to_hstring(addr_3_reg) & " " & to_hstring(out_data_3);
-        end if;
-
         d_out.read1_data <= out_data_1;
         d_out.read2_data <= out_data_2;
         d_out.read3_data <= out_data_3;
@@ -212,6 +214,36 @@ begin
         sim_dump_done <= '0';
     end generate;
 
+    -- Register writes and reads for the simulation trace
+    sim_trace: if SIM generate
+        signal write_arg : std_ulogic_vector(63 downto 0);
+        signal read1_arg : std_ulogic_vector(63 downto 0);
+        signal read2_arg : std_ulogic_vector(63 downto 0);
+        signal read3_arg : std_ulogic_vector(63 downto 0);
+    begin
+        write_arg <= 58x"0" & w_in.write_reg;
+        read1_arg <= 58x"0" & addr_1_reg;
+        read2_arg <= 58x"0" & addr_2_reg;
+        read3_arg <= 58x"0" & addr_3_reg;
+
+        trace_write: sim_trace_event
+            generic map (EVENT => TRACE_GPR_WRITE, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => w_in.write_enable,
+                      arg => write_arg, data => w_in.write_data);
+        trace_read1: sim_trace_event
+            generic map (EVENT => TRACE_GPR_READ, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => d_in.read1_enable,
+                      arg => read1_arg, data => d_out.read1_data);
+        trace_read2: sim_trace_event
+            generic map (EVENT => TRACE_GPR_READ, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => d_in.read2_enable,
+                      arg => read2_arg, data => d_out.read2_data);
+        trace_read3: sim_trace_event
+            generic map (EVENT => TRACE_GPR_READ, CPU_INDEX => CPU_INDEX)
+            port map (clk => clk, valid => d_in.read3_enable,
+                      arg => read3_arg, data => d_out.read3_data);
+    end generate;
+
     rf_log: if LOG_LENGTH > 0 generate
         signal log_data : std_ulogic_vector(71 downto 0);
     begin
@@ -0,0 +1,42 @@
+#!/usr/bin/python3
+
+# Run a fixed workload on microwatt-verilator-t<n> for each thread count
+# given on the command line and report simulated cycles per wall second.
+# Built by "make bench-verilator", see verilator/README.md.
+
+import os
+import subprocess
+import sys
+import time
+
+# (name, image, cycles)
+workloads = [
+    ('hello_world', 'hello_world/hello_world.bin', 2000000),
+    ('micropython', 'micropython/firmware.bin', 20000000),
+]
+
+def run(binary, image, cycles):
+    cmd = [ binary, '--load', image, '--max-cycles', str(cycles) ]
+    start = time.monotonic()
+    subprocess.run(cmd, stdin=subprocess.PIPE, stdout=subprocess.DEVNULL,
+                   check=True)
+    return time.monotonic() - start
+
+threads = [int(t) for t in sys.argv[1:]] or [1, 2, 4, 8]
+
+print('%-12s %7s %10s %9s %12s %8s' %
+      ('workload', 'threads', 'cycles', 'wall (s)', 'cycles/s', 'speedup'))
+
+for name, image, cycles in workloads:
+    base = None
+    for t in threads:
+        binary = './microwatt-verilator-t%d' % t
+        if not os.path.exists(binary):
+            sys.exit('%s not found, run make bench-verilator' % binary)
+
+        wall = run(binary, image, cycles)
+        rate = cycles / wall
+        if base is None:
+            base = rate
+        print('%-12s %7d %10d %9.2f %12.0f %7.2fx' %
+              (name, t, cycles, wall, rate, rate / base), flush=True)
@@ -1,6 +1,13 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
 
 typedef unsigned long long u64;
 
@@ -57,7 +64,7 @@ struct log_entry {
 	u64	ls_lo_valid: 1;
 	u64	ls_eo_except: 1;
 	u64	ls_stall_out: 1;
-	u64	pad2: 1;
+	u64	fp_valid: 1;
 	u64	dc_state: 3;
 	u64	dc_ra_valid: 1;
 	u64	dc_tlb_way: 3;
@@ -96,29 +103,961 @@ const char *ops[64] =
 	"?56    ", "?57    ", "?58    ", "?59    ", "?60    ", "?61    ", "?62    ", "?63    "
 };
 
+/*
+ * Files from "mw_debug lstream" start with a header and hold a series
+ * of log windows, each after a header with its sequence number, the
+ * instruction count when it was captured and the triggers that fired.
+ */
+#define STREAM_MAGIC	"mwlogstr"
+#define WINDOW_MAGIC	"mwlogwin"
+
 const char *spr_names[13] =
 {
 	"lr ", "ctr", "sr0", "sr1", "hr0", "hr1", "sg0", "sg1",
 	"sg2", "sg3", "hg0", "hg1", "xer"
 };
 			     
+/*
+ * Pipeline timeline. Each instruction is followed by its part_nia from
+ * the icache output through decode1 and decode2 to execute1, and retired
+ * in order when execute1, loadstore or the FPU completes. Its fetch starts when
+ * fetch1 first asked for its address. A flush drops everything not yet
+ * past decode2. Time spent held up gets the reason added to the stage
+ * name: an icache miss or stall while fetching, decode2 not taking the
+ * output of decode1, decode2 waiting on a dependency, execute1 not
+ * taking the instruction, or loadstore or the dcache being busy.
+ *
+ * The result is written for Konata (-k) and as Chrome trace events
+ * (-j), with one cycle per microsecond and each instruction on one of
+ * TL_SLOTS rows. A fetch is only known to have been an instruction once
+ * the icache returns it, so Konata's commands are kept and written out
+ * in cycle order at the end.
+ */
+#define TL_MAX		64
+#define TL_SLOTS	32
+
+enum { ST_F, ST_D1, ST_D2, ST_X };
+const char *stage_names[4] = { "F", "D1", "D2", "X" };
+
+struct tl_insn {
+	long	id;
+	u64	nia;
+	int	part;
+	int	stage;
+	int	type;
+	int	unit;
+	const char *label;
+	long	start;
+};
+
+struct kev {
+	long	cycle;
+	long	seq;
+	char	text[48];
+};
+
+static FILE *konata, *chrome;
+static struct kev *kevs;
+static long nr_kevs, max_kevs;
+static struct tl_insn tl[TL_MAX];
+static int tl_head, tl_count;
+static long tl_next_id, tl_retired;
+static long fetch_seen[16];
+static const char *fetch_label[16];
+static u64 last_fetch = ~0ull;
+static int chrome_events;
+
+#define TL(i)	(&tl[(tl_head + (i)) % TL_MAX])
+
+static void kev(long cycle, const char *fmt, ...)
+{
+	va_list ap;
+
+	if (!konata)
+		return;
+	if (nr_kevs == max_kevs) {
+		max_kevs = max_kevs ? max_kevs * 2 : 4096;
+		kevs = realloc(kevs, max_kevs * sizeof(*kevs));
+		if (!kevs) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	kevs[nr_kevs].cycle = cycle;
+	kevs[nr_kevs].seq = nr_kevs;
+	va_start(ap, fmt);
+	vsnprintf(kevs[nr_kevs].text, sizeof(kevs[0].text), fmt, ap);
+	va_end(ap);
+	nr_kevs++;
+}
+
+static int kev_compare(const void *a, const void *b)
+{
+	const struct kev *x = a, *y = b;
+
+	if (x->cycle != y->cycle)
+		return x->cycle < y->cycle ? -1 : 1;
+	return x->seq < y->seq ? -1 : 1;
+}
+
+/* The stage, with why it isn't moving on if it's being held up */
+static const char *tl_label(const struct tl_insn *t, const struct log_entry *l)
+{
+	switch (t->stage) {
+	case ST_D1:
+		return l->d2_stall_out ? "D1:d2stall" : "D1";
+	case ST_D2:
+		return l->d2_stall_out ? "D2:dep" : "D2";
+	}
+	if (l->d2_valid && l->d2_part_nia == t->part && l->e1_stall_out)
+		return "X:e1stall";
+	if (l->dc_stall_out)
+		return "X:dcache";
+	if (l->ls_stall_out)
+		return "X:lsu";
+	return "X";
+}
+
+static void tl_end(struct tl_insn *t, long cycle)
+{
+	if (!t->label)
+		return;
+	kev(cycle, "E\t%ld\t0\t%s\n", t->id, t->label);
+	if (chrome && cycle > t->start) {
+		fprintf(chrome, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%ld,"
+			"\"dur\":%ld,\"pid\":1,\"tid\":%ld,\"args\":{\"nia\":\"0x%llx\",\"op\":\"%.*s\"}}",
+			chrome_events++ ? ",\n" : "", t->label, stage_names[t->stage],
+			t->start, cycle - t->start, t->id % TL_SLOTS, t->nia,
+			t->stage >= ST_D2 ? (int)strcspn(ops[t->type], " ") : 0, ops[t->type]);
+	}
+}
+
+static void tl_set(struct tl_insn *t, const char *label, long cycle)
+{
+	if (t->label == label)
+		return;
+	tl_end(t, cycle);
+	t->label = label;
+	t->start = cycle;
+	kev(cycle, "S\t%ld\t0\t%s\n", t->id, label);
+}
+
+static void tl_remove(int i, int flushed, long cycle)
+{
+	struct tl_insn *t = TL(i);
+
+	tl_end(t, cycle);
+	kev(cycle, "R\t%ld\t%ld\t%d\n", t->id, flushed ? 0 : tl_retired, flushed);
+	if (!flushed)
+		tl_retired++;
+	for (; i > 0; i--)
+		*TL(i) = *TL(i - 1);
+	tl_head = (tl_head + 1) % TL_MAX;
+	tl_count--;
+}
+
+/* Move the oldest instruction at one stage with part_nia p on to the next */
+static void tl_advance(int stage, int p, long cycle, const struct log_entry *l)
+{
+	for (int i = 0; i < tl_count; i++) {
+		struct tl_insn *t = TL(i);
+
+		if (t->stage != stage || t->part != p)
+			continue;
+		tl_end(t, cycle);
+		t->label = NULL;
+		t->stage++;
+		if (t->stage == ST_D2) {
+			t->unit = l->d1_unit;
+			t->type = l->d1_insn_type;
+			kev(cycle, "L\t%ld\t1\t%s %.*s\n", t->id, units[t->unit],
+			    (int)strcspn(ops[t->type], " "), ops[t->type]);
+		}
+		tl_set(t, tl_label(t, l), cycle);
+		return;
+	}
+}
+
+static void tl_flush_all(long cycle)
+{
+	while (tl_count)
+		tl_remove(0, 1, cycle);
+}
+
+static void tl_cycle(const struct log_entry *l, const u64 *full_nia, long cycle)
+{
+	struct tl_insn *t;
+	int i, n;
+
+	/* Completions, in order */
+	n = l->e1_valid + l->ls_lo_valid + l->fp_valid;
+	for (i = 0; i < tl_count && n; ) {
+		if (TL(i)->stage == ST_X) {
+			tl_remove(i, 0, cycle);
+			n--;
+		} else
+			i++;
+	}
+
+	/* A redirect throws away whatever hasn't reached execute1 */
+	if (l->e1_flush_out || l->e1_redirect) {
+		for (i = 0; i < tl_count; ) {
+			if (TL(i)->stage < ST_X)
+				tl_remove(i, 1, cycle);
+			else
+				i++;
+		}
+	}
+
+	if (l->d2_valid)
+		tl_advance(ST_D2, l->d2_part_nia, cycle, l);
+	if (l->d1_valid)
+		tl_advance(ST_D1, l->d1_part_nia, cycle, l);
+	if (l->ic_valid) {
+		int p = l->ic_part_nia;
+
+		for (i = 0; i < tl_count; i++)
+			if (TL(i)->stage == ST_D1 && TL(i)->part == p)
+				break;
+		if (i == tl_count) {
+			if (tl_count == TL_MAX)
+				tl_remove(0, 1, cycle);
+			t = TL(tl_count++);
+			memset(t, 0, sizeof(*t));
+			t->id = tl_next_id++;
+			t->nia = full_nia[p];
+			t->part = p;
+			t->stage = ST_D1;
+			t->start = fetch_seen[p] < cycle ? fetch_seen[p] : cycle;
+			kev(t->start, "I\t%ld\t%ld\t0\n", t->id, t->id);
+			kev(t->start, "L\t%ld\t0\t%llx\n", t->id, t->nia);
+			t->label = fetch_label[p] ? fetch_label[p] : "F";
+			kev(t->start, "S\t%ld\t0\t%s\n", t->id, t->label);
+			/* Its fetch is only known now, so it goes out as it is */
+			t->stage = ST_F;
+			tl_end(t, cycle);
+			t->stage = ST_D1;
+			t->label = NULL;
+			t->start = cycle;
+			tl_set(t, tl_label(t, l), cycle);
+		}
+	}
+
+	/* Reasons for being held up may have changed */
+	for (i = 0; i < tl_count; i++) {
+		t = TL(i);
+		tl_set(t, tl_label(t, l), cycle);
+	}
+
+	if (((u64)l->nia_lo << 2) != last_fetch) {
+		last_fetch = (u64)l->nia_lo << 2;
+		fetch_seen[l->nia_lo & 0xf] = cycle;
+		fetch_label[l->nia_lo & 0xf] = "F";
+	}
+	if (l->ic_is_miss)
+		fetch_label[l->nia_lo & 0xf] = "F:imiss";
+	else if (l->ic_stall_out && fetch_label[l->nia_lo & 0xf][1] == 0)
+		fetch_label[l->nia_lo & 0xf] = "F:stall";
+}
+
+static void tl_start(void)
+{
+	if (chrome)
+		fprintf(chrome, "{\"traceEvents\":[\n");
+}
+
+static void tl_finish(long cycle)
+{
+	long c = 0;
+
+	tl_flush_all(cycle);
+	if (chrome)
+		fprintf(chrome, "\n]}\n");
+	if (!konata)
+		return;
+	qsort(kevs, nr_kevs, sizeof(*kevs), kev_compare);
+	fprintf(konata, "Kanata\t0004\nC=\t0\n");
+	for (long i = 0; i < nr_kevs; i++) {
+		if (kevs[i].cycle != c) {
+			fprintf(konata, "C\t%ld\n", kevs[i].cycle - c);
+			c = kevs[i].cycle;
+		}
+		fputs(kevs[i].text, konata);
+	}
+}
+
+/*
+ * Symbols from ELF files given with -e, for function+offset after each
+ * line, on the loops and in the stats. Only the symbol table is read,
+ * and only little endian ELF64 is supported, as for scripts/profile.py.
+ * With --lines the source line comes from addr2line (ADDR2LINE, or
+ * ${CROSS_COMPILE}addr2line with the usual default prefix) run alongside
+ * for each file, and is cached.
+ */
+#define MAX_ELFS	8
+#define LINE_CACHE	4096
+
+struct elf_file {
+	const char *path;
+	char	*data;
+	FILE	*a2l_in;
+	FILE	*a2l_out;
+};
+
+struct symbol {
+	u64	addr;
+	u64	size;
+	const char *name;
+	int	elf;
+};
+
+static struct elf_file elfs[MAX_ELFS];
+static int nr_elfs;
+static struct symbol *syms;
+static long nr_syms;
+static int src_lines;
+static struct {
+	u64	addr;
+	char	*text;
+} line_cache[LINE_CACHE];
+
+static void elf_load(const char *path)
+{
+	struct elf_file *e = &elfs[nr_elfs];
+	u64 shoff, off, size, stroff, strsize, value, symsize;
+	unsigned int shentsize, shnum, i, link;
+	unsigned int type, name;
+	long len;
+	FILE *f;
+
+	if (nr_elfs == MAX_ELFS) {
+		fprintf(stderr, "Too many ELF files\n");
+		exit(1);
+	}
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 0, SEEK_END) < 0 || (len = ftell(f)) < 64) {
+		perror(path);
+		exit(1);
+	}
+	e->data = malloc(len);
+	rewind(f);
+	if (!e->data || fread(e->data, len, 1, f) != 1) {
+		perror(path);
+		exit(1);
+	}
+	fclose(f);
+	if (memcmp(e->data, "\177ELF", 4) || e->data[4] != 2 || e->data[5] != 1) {
+		fprintf(stderr, "%s: only little endian ELF64 is supported\n", path);
+		exit(1);
+	}
+	e->path = path;
+
+/* Whether len bytes at o are inside the file */
+#define INSIDE(o, l)	((o) <= (u64)len && (l) <= (u64)len - (o))
+#define GET(v, o)	memcpy(&(v), e->data + (o), sizeof(v))
+	shoff = 0;
+	shentsize = shnum = 0;
+	GET(shoff, 0x28);
+	memcpy(&shentsize, e->data + 0x3a, 2);
+	memcpy(&shnum, e->data + 0x3c, 2);
+	if (shnum && (shentsize < 0x40 ||
+		      !INSIDE(shoff, (u64)shnum * shentsize))) {
+		fprintf(stderr, "%s: bad section headers\n", path);
+		exit(1);
+	}
+	for (i = 0; i < shnum; i++) {
+		u64 sh = shoff + (u64)i * shentsize;
+
+		type = 0;
+		GET(type, sh + 4);
+		if (type != 2)		/* SHT_SYMTAB */
+			continue;
+		GET(off, sh + 0x18);
+		GET(size, sh + 0x20);
+		link = 0;
+		GET(link, sh + 0x28);
+		if (link >= shnum) {
+			fprintf(stderr, "%s: bad symbol table\n", path);
+			exit(1);
+		}
+		GET(stroff, shoff + (u64)link * shentsize + 0x18);
+		GET(strsize, shoff + (u64)link * shentsize + 0x20);
+		if (!INSIDE(off, size) || !INSIDE(stroff, strsize)) {
+			fprintf(stderr, "%s: bad symbol table\n", path);
+			exit(1);
+		}
+		for (u64 s = off; s + 24 <= off + size; s += 24) {
+			if ((e->data[s + 4] & 0xf) != 2)	/* STT_FUNC */
+				continue;
+			GET(name, s);
+			GET(value, s + 8);
+			GET(symsize, s + 16);
+			if (!value)
+				continue;
+			/* Skip names that don't end inside the string table */
+			if (name >= strsize ||
+			    !memchr(e->data + stroff + name, 0, strsize - name))
+				continue;
+			if (nr_syms % 1024 == 0) {
+				syms = realloc(syms, (nr_syms + 1024) * sizeof(*syms));
+				if (!syms) {
+					fprintf(stderr, "Out of memory\n");
+					exit(1);
+				}
+			}
+			syms[nr_syms].addr = value;
+			syms[nr_syms].size = symsize;
+			syms[nr_syms].name = e->data + stroff + name;
+			syms[nr_syms].elf = nr_elfs;
+			nr_syms++;
+		}
+	}
+#undef GET
+#undef INSIDE
+	nr_elfs++;
+}
+
+static int sym_compare(const void *a, const void *b)
+{
+	const struct symbol *x = a, *y = b;
+
+	return x->addr < y->addr ? -1 : x->addr > y->addr;
+}
+
+static const struct symbol *sym_lookup(u64 nia)
+{
+	long lo = 0, hi = nr_syms - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (syms[mid].addr <= nia)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	if (!nr_syms || syms[lo].addr > nia ||
+	    (syms[lo].size && nia >= syms[lo].addr + syms[lo].size))
+		return NULL;
+	return &syms[lo];
+}
+
+static void a2l_start(struct elf_file *e)
+{
+	const char *prog = getenv("ADDR2LINE");
+	const char *prefix = getenv("CROSS_COMPILE");
+	char cmd[256];
+	int in[2], out[2];
+
+	if (!prog) {
+		snprintf(cmd, sizeof(cmd), "%saddr2line",
+			 prefix ? prefix : "powerpc64le-linux-gnu-");
+		prog = cmd;
+	}
+	if (pipe(in) < 0 || pipe(out) < 0) {
+		perror("pipe");
+		exit(1);
+	}
+	fflush(stdout);
+	if (fork() == 0) {
+		dup2(in[0], 0);
+		dup2(out[1], 1);
+		close(in[1]);
+		close(out[0]);
+		execlp(prog, prog, "-e", e->path, (char *)NULL);
+		perror(prog);
+		_exit(1);
+	}
+	close(in[0]);
+	close(out[1]);
+	e->a2l_in = fdopen(in[1], "w");
+	e->a2l_out = fdopen(out[0], "r");
+}
+
+/* "file:line" for an address in one of the ELF files, or NULL */
+static const char *src_line(const struct symbol *s, u64 nia)
+{
+	struct elf_file *e = &elfs[s->elf];
+	int i = (nia >> 2) % LINE_CACHE;
+	char buf[512], *p;
+	void (*old)(int);
+
+	if (line_cache[i].text && line_cache[i].addr == nia)
+		return line_cache[i].text;
+	if (!e->a2l_in)
+		a2l_start(e);
+	/* a write to an addr2line that couldn't start mustn't kill us */
+	old = signal(SIGPIPE, SIG_IGN);
+	fprintf(e->a2l_in, "0x%llx\n", nia);
+	fflush(e->a2l_in);
+	signal(SIGPIPE, old);
+	if (!fgets(buf, sizeof(buf), e->a2l_out)) {
+		fprintf(stderr, "No source lines from addr2line for %s\n", e->path);
+		src_lines = 0;
+		return NULL;
+	}
+	buf[strcspn(buf, " \n")] = 0;
+	p = strrchr(buf, '/');
+	free(line_cache[i].text);
+	line_cache[i].addr = nia;
+	line_cache[i].text = strdup(p ? p + 1 : buf);
+	return line_cache[i].text;
+}
+
+/* function+offset, and the source line if wanted, or "" */
+static const char *sym_format(u64 nia)
+{
+	static char buf[600];
+	const struct symbol *s;
+	const char *line;
+	int n;
+
+	if (!nr_syms || !(s = sym_lookup(nia)))
+		return "";
+	if (nia == s->addr)
+		n = snprintf(buf, sizeof(buf), "%s", s->name);
+	else
+		n = snprintf(buf, sizeof(buf), "%s+0x%llx", s->name, nia - s->addr);
+	if (src_lines && (line = src_line(s, nia)) && n < sizeof(buf))
+		snprintf(buf + n, sizeof(buf) - n, " %s", line);
+	return buf;
+}
+
+
+/*
+ * Top-down cycle accounting (--stats). Each cycle goes to one category,
+ * the first of these that applies: something completed; the pipeline
+ * refilling after a flush or redirect, until decode2 has an instruction
+ * again; loadstore or the dcache stalled; execute1 stalled; decode2
+ * held up on a dependency; the icache missing or stalled. Anything left
+ * is a bubble with no clear cause. Stall cycles are charged to the
+ * instruction that was held up, as followed by the timeline: the oldest
+ * one in execute1 or decode2, the fetch address for the icache, and the
+ * instruction that redirected for a refill.
+ */
+enum { CAT_RETIRE, CAT_FLUSH, CAT_LSU, CAT_EXEC, CAT_DECODE, CAT_ICACHE,
+       CAT_OTHER, NR_CATS };
+const char *cat_names[NR_CATS] = {
+	"retiring", "flush/redirect", "lsu/dcache", "execute busy",
+	"decode hazard", "icache miss", "other bubble"
+};
+
+struct stall_site {
+	u64	nia;
+	long	total;
+	long	cycles[NR_CATS];
+};
+
+static int stats;
+static long cat_cycles[NR_CATS];
+static struct stall_site *sites;
+static unsigned long nr_sites, sites_size;
+static int refilling;
+static u64 refill_nia;
+
+static u64 tl_oldest(int stage)
+{
+	for (int i = 0; i < tl_count; i++)
+		if (TL(i)->stage == stage)
+			return TL(i)->nia;
+	return ~0ull;
+}
+
+static struct stall_site *site_lookup(struct stall_site *table,
+				      unsigned long size, u64 nia)
+{
+	unsigned long i = ((nia >> 2) * 0x9e3779b97f4a7c15ull >> 20) & (size - 1);
+
+	while (table[i].total && table[i].nia != nia)
+		i = (i + 1) & (size - 1);
+	return &table[i];
+}
+
+static void site_add(u64 nia, int cat)
+{
+	struct stall_site *s;
+
+	if (nia == ~0ull)
+		return;
+	if (nr_sites * 2 >= sites_size) {
+		unsigned long size = sites_size ? sites_size * 2 : 1024;
+		struct stall_site *table = calloc(size, sizeof(*table));
+
+		if (!table) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		for (unsigned long i = 0; i < sites_size; i++)
+			if (sites[i].total)
+				*site_lookup(table, size, sites[i].nia) = sites[i];
+		free(sites);
+		sites = table;
+		sites_size = size;
+	}
+	s = site_lookup(sites, sites_size, nia);
+	if (!s->total) {
+		s->nia = nia;
+		nr_sites++;
+	}
+	s->total++;
+	s->cycles[cat]++;
+}
+
+/* Called before the timeline moves on, so it shows what was in flight */
+static void stats_cycle(const struct log_entry *l)
+{
+	int cat;
+	u64 nia = ~0ull;
+
+	if (l->e1_flush_out || l->e1_redirect) {
+		refilling = 1;
+		refill_nia = tl_oldest(ST_X);
+	} else if (l->d2_valid)
+		refilling = 0;
+
+	if (l->e1_valid || l->ls_lo_valid || l->fp_valid)
+		cat = CAT_RETIRE;
+	else if (refilling) {
+		cat = CAT_FLUSH;
+		nia = refill_nia;
+	} else if (l->ls_stall_out || l->dc_stall_out) {
+		cat = CAT_LSU;
+		nia = tl_oldest(ST_X);
+	} else if (l->e1_stall_out) {
+		cat = CAT_EXEC;
+		nia = tl_oldest(ST_X);
+	} else if (l->d2_stall_out) {
+		cat = CAT_DECODE;
+		nia = tl_oldest(ST_D2);
+	} else if (l->ic_stall_out || l->ic_is_miss || l->ic_state) {
+		cat = CAT_ICACHE;
+		nia = (l->nia_hi ? 0xc000000000000000ull : 0) | ((u64)l->nia_lo << 2);
+	} else
+		cat = CAT_OTHER;
+
+	cat_cycles[cat]++;
+	if (cat != CAT_RETIRE && cat != CAT_OTHER)
+		site_add(nia, cat);
+}
+
+static int site_compare(const void *a, const void *b)
+{
+	const struct stall_site *x = a, *y = b;
+
+	if (x->total != y->total)
+		return x->total > y->total ? -1 : 1;
+	return x->nia < y->nia ? -1 : x->nia > y->nia;
+}
+
+static void stats_print(long ncycles, long ncompl, int top)
+{
+	unsigned long i, n;
+	int c, worst;
+
+	printf("\nCPI stack: %ld cycles, %ld instructions", ncycles, ncompl);
+	if (ncompl)
+		printf(", %.2f CPI", (double)ncycles / ncompl);
+	printf("\n%-16s %10s %7s %7s\n", "", "cycles", "%", "CPI");
+	for (c = 0; c < NR_CATS; c++)
+		printf("%-16s %10ld %6.2f%% %7.3f\n", cat_names[c], cat_cycles[c],
+		       ncycles ? 100.0 * cat_cycles[c] / ncycles : 0.0,
+		       ncompl ? (double)cat_cycles[c] / ncompl : 0.0);
+
+	for (i = 0, n = 0; i < sites_size; i++)
+		if (sites[i].total)
+			sites[n++] = sites[i];
+	qsort(sites, n, sizeof(*sites), site_compare);
+
+	printf("\nTop stalling instructions:\n");
+	printf("%18s %10s %7s  %s\n", "nia", "cycles", "%", "mostly");
+	for (i = 0; i < n && i < top; i++) {
+		worst = 0;
+		for (c = 1; c < NR_CATS; c++)
+			if (sites[i].cycles[c] > sites[i].cycles[worst])
+				worst = c;
+		printf("0x%016llx %10ld %6.2f%%  %s (%ld)  %s\n", sites[i].nia,
+		       sites[i].total, 100.0 * sites[i].total / ncycles,
+		       cat_names[worst], sites[i].cycles[worst],
+		       sym_format(sites[i].nia));
+	}
+}
+
+static void print_entry(struct log_entry log, const u64 *full_nia,
+			long lineno, int header)
+{
+	if (lineno % 20 == 1 || header) {
+		printf("        fetch1 NIA      icache                             decode1       decode2   execute1         loadstore  dcache       CR   GSPR\n");
+		printf("     ----------------   TAHW S -WB-- pN  ic --insn--    pN un op         pN byp    FR IIE MSR  WC   SD MM CE   SRTO DE -WB-- c ms reg val\n");
+		printf("                        LdMy t csnSa IA                 IA it            IA abc    le srx EPID em   tw rd mx   tAwp vr csnSa 0 k\n");
+	}
+	printf("%4ld %c0000%.11llx %c ", lineno,
+	       (log.nia_hi? 'c': '0'),
+	       (unsigned long long)log.nia_lo << 2,
+	       FLAG(ic_stall_out, '|'));
+	printf("%c%c%c%d %c %c%c%d%c%c %.2llx ",
+	       FLGA(ic_ra_valid, ' ', 'T'),
+	       FLGA(ic_access_ok, ' ', 'X'),
+	       FLGA(ic_is_hit, 'H', FLGA(ic_is_miss, 'M', ' ')),
+	       log.ic_way,
+	       FLAG(ic_state, 'W'),
+	       FLAG(ic_wb_cyc, 'c'),
+	       FLAG(ic_wb_stb, 's'),
+	       log.ic_wb_adr,
+	       FLAG(ic_wb_stall, 'S'),
+	       FLAG(ic_wb_ack, 'a'),
+	       PNIA(ic_part_nia));
+	if (log.ic_valid) {
+		if (log.ic_insn & (1ul << 35))
+			printf("ill %.8lx", log.ic_insn & 0xfffffffful);
+		else
+			printf("%3lu x%.7lx", (long)(log.ic_insn >> 26),
+			       (unsigned long)(log.ic_insn & 0x3ffffff));
+	} else if (log.ic_fetch_failed)
+		printf("    !!!!!!!!");
+	else
+		printf("--- --------");
+	printf(" %c%c %.2llx ",
+	       FLAG(ic_valid, '>'),
+	       FLAG(d2_stall_out, '|'),
+	       PNIA(d1_part_nia));
+	if (log.d1_valid)
+		printf("%s %s",
+		       units[log.d1_unit],
+		       ops[log.d1_insn_type]);
+	else
+		printf("-- -------");
+	printf(" %c%c ",
+	       FLAG(d1_valid, '>'),
+	       FLAG(d2_stall_out, '|'));
+	printf("%.2llx %c%c%c %c%c ",
+	       PNIA(d2_part_nia),
+	       FLAG(d2_bypass_a, 'a'),
+	       FLAG(d2_bypass_b, 'b'),
+	       FLAG(d2_bypass_c, 'c'),
+	       FLAG(d2_valid, '>'),
+	       FLAG(e1_stall_out, '|'));
+	printf("%c%c %c%c%c %c%c%c%c %c%c ",
+	       FLAG(e1_flush_out, 'F'),
+	       FLAG(e1_redirect, 'R'),
+	       FLAG(e1_irq_state, 'w'),
+	       FLAG(e1_irq, 'I'),
+	       FLAG(e1_exception, 'X'),
+	       FLAG(e1_msr_ee, 'E'),
+	       FLGA(e1_msr_pr, 'u', 's'),
+	       FLAG(e1_msr_ir, 'I'),
+	       FLAG(e1_msr_dr, 'D'),
+	       FLAG(e1_write_enable, 'W'),
+	       FLAG(e1_valid, 'C'));
+	printf("%c %d%d %c%c %c%c %c ",
+	       FLAG(ls_stall_out, '|'),
+	       log.ls_state,
+	       log.ls_dw_done,
+	       FLAG(ls_mo_valid, 'M'),
+	       FLAG(ls_min_done, 'm'),
+	       FLAG(ls_lo_valid, 'C'),
+	       FLAG(ls_eo_except, 'X'),
+	       FLAG(ls_do_valid, '>'));
+	printf("%d%c%d%d %c%c %c%c%d%c%c ",
+	       log.dc_state,
+	       FLAG(dc_ra_valid, 'R'),
+	       log.dc_tlb_way,
+	       log.dc_op,
+	       FLAG(dc_do_valid, 'V'),
+	       FLAG(dc_do_error, 'E'),
+	       FLAG(dc_wb_cyc, 'c'),
+	       FLAG(dc_wb_stb, 's'),
+	       log.dc_wb_adr,
+	       FLAG(dc_wb_stall, 'S'),
+	       FLAG(dc_wb_ack, 'a'));
+	if (log.cr_wr_enable)
+		printf("%x>%.2x ", log.cr_wr_data, log.cr_wr_mask);
+	else
+		printf("     ");
+	if (log.reg_wr_enable) {
+		if (log.reg_wr_reg < 32 || log.reg_wr_reg > 44)
+			printf("r%02d", log.reg_wr_reg);
+		else
+			printf("%s", spr_names[log.reg_wr_reg - 32]);
+		printf("=%.16llx", log.reg_wr_data);
+	}
+	if (nr_syms)
+		printf("  %s", sym_format(full_nia[log.nia_lo & 0xf]));
+	printf("\n");
+}
+
+/*
+ * Loop folding (--loops). The printed cycles are cut into pieces at each
+ * backward jump of the fetch address. A piece that fetched the same
+ * sequence of addresses as the one before it is another iteration of a
+ * loop, and is counted instead of printed; a summary line goes out once
+ * something else comes along. A piece longer than LOOP_MAX cycles is
+ * printed as it is.
+ */
+#define LOOP_MAX	4096
+
+struct loop_entry {
+	struct log_entry log;
+	u64	full_nia[16];
+	long	lineno;
+	int	header;
+};
+
+static int loops;
+static struct loop_entry *loop_buf;
+static int loop_len;
+static u64 loop_sig, loop_prev_sig, loop_prev_start, loop_last;
+static long loop_repeats, loop_cycles;
+
+static void loop_summary(void)
+{
+	if (!loop_repeats)
+		return;
+	printf("     ... %ld more iteration%s of the loop at 0x%llx %s, %ld cycles\n",
+	       loop_repeats, loop_repeats == 1 ? "" : "s", loop_prev_start,
+	       sym_format(loop_prev_start), loop_cycles);
+	loop_repeats = 0;
+	loop_cycles = 0;
+}
+
+/* End the current piece, printing it unless it repeats the last one */
+static void loop_end(void)
+{
+	struct loop_entry *e;
+	int i;
+
+	if (!loop_len)
+		return;
+	if (loop_sig == loop_prev_sig && loop_len < LOOP_MAX) {
+		loop_repeats++;
+		loop_cycles += loop_len;
+	} else {
+		loop_summary();
+		for (i = 0; i < loop_len; i++) {
+			e = &loop_buf[i];
+			print_entry(e->log, e->full_nia, e->lineno, e->header);
+		}
+		loop_prev_sig = loop_len < LOOP_MAX ? loop_sig : 0;
+		loop_prev_start = loop_buf[0].full_nia[loop_buf[0].log.nia_lo & 0xf];
+	}
+	loop_len = 0;
+	loop_sig = 0;
+}
+
+/* Forget the previous piece, at a new window or the end of the log */
+static void loop_flush(void)
+{
+	loop_end();
+	loop_summary();
+	loop_prev_sig = 0;
+	loop_last = ~0ull;
+}
+
+static void loop_add(struct log_entry log, const u64 *full_nia,
+		       long lineno, int header)
+{
+	u64 nia = full_nia[log.nia_lo & 0xf];
+	struct loop_entry *e;
+
+	if (!loop_buf) {
+		loop_buf = malloc(LOOP_MAX * sizeof(*loop_buf));
+		if (!loop_buf) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+	}
+	if (nia < loop_last || loop_len == LOOP_MAX)
+		loop_end();
+	e = &loop_buf[loop_len++];
+	e->log = log;
+	memcpy(e->full_nia, full_nia, sizeof(e->full_nia));
+	e->lineno = lineno;
+	e->header = header;
+	if (nia != loop_last)
+		loop_sig = (loop_sig ^ nia) * 0x100000001b3ull + 1;
+	loop_last = nia;
+}
+
 int main(int ac, char **av)
 {
 	struct log_entry log;
+	u64 rec[4];
 	u64 full_nia[16];
+	u64 last_icount = 0;
+	int stream = 0;
+	int header = 1;
 	long int lineno = 1;
 	FILE *f;
 	const char *filename;
-	int i;
+	int i, c;
+	int quiet = 0;
+	int top = 20;
 	long int ncompl = 0;
 
-	if (ac != 1 && ac != 2) {
-		fprintf(stderr, "Usage: %s [filename]\n", av[0]);
+	while (1) {
+		static struct option lopts[] = {
+			{ "konata",	required_argument, 0, 'k' },
+			{ "json",	required_argument, 0, 'j' },
+			{ "quiet",	no_argument,       0, 'q' },
+			{ "stats",	no_argument,       0, 's' },
+			{ "top",	required_argument, 0, 'n' },
+			{ "elf",	required_argument, 0, 'e' },
+			{ "lines",	no_argument,       0, 'l' },
+			{ "loops",	no_argument,       0, 'L' },
+			{ 0, 0, 0, 0 }
+		};
+
+		c = getopt_long(ac, av, "k:j:qsn:e:lL", lopts, NULL);
+		if (c < 0)
+			break;
+		switch (c) {
+		case 'k':
+		case 'j':
+			f = fopen(optarg, "w");
+			if (f == NULL) {
+				perror(optarg);
+				exit(1);
+			}
+			if (c == 'k')
+				konata = f;
+			else
+				chrome = f;
+			break;
+		case 'q':
+			quiet = 1;
+			break;
+		case 's':
+			stats = 1;
+			break;
+		case 'n':
+			top = atoi(optarg);
+			break;
+		case 'e':
+			elf_load(optarg);
+			break;
+		case 'l':
+			src_lines = 1;
+			break;
+		case 'L':
+			loops = 1;
+			break;
+		default:
+			ac = 0;
+		}
+	}
+	if (ac - optind > 1 || ac == 0) {
+		fprintf(stderr, "Usage: %s [options] [filename]\n", av[0]);
+		fprintf(stderr, "  -k, --konata <file>  write a pipeline timeline for Konata\n");
+		fprintf(stderr, "  -j, --json <file>    write a pipeline timeline as Chrome trace events\n");
+		fprintf(stderr, "  -s, --stats          print a CPI stack and the top stalling instructions\n");
+		fprintf(stderr, "  -n, --top <n>        stalling instructions to print (default 20)\n");
+		fprintf(stderr, "  -e, --elf <file>     show function+offset from this ELF file (repeatable)\n");
+		fprintf(stderr, "  -l, --lines          show source lines too, using addr2line\n");
+		fprintf(stderr, "  -L, --loops          fold repeated loop iterations\n");
+		fprintf(stderr, "  -q, --quiet          don't print the log itself\n");
 		exit(1);
 	}
 	f = stdin;
-	if (ac == 2) {
-		filename = av[1];
+	if (optind < ac) {
+		filename = av[optind];
 		f = fopen(filename, "rb");
 		if (f == NULL) {
 			perror(filename);
@@ -126,113 +1065,70 @@ int main(int ac, char **av)
 		}
 	}
 
+	if (nr_syms)
+		qsort(syms, nr_syms, sizeof(*syms), sym_compare);
+	if (src_lines && !nr_syms) {
+		fprintf(stderr, "--lines needs an ELF file\n");
+		exit(1);
+	}
 	for (i = 0; i < 15; ++i)
 		full_nia[i] = i << 2;
+	tl_start();
 
-	while (fread(&log, sizeof(log), 1, f) == 1) {
+	while (fread(rec, sizeof(rec), 1, f) == 1) {
+		if (lineno == 1 && !stream && memcmp(rec, STREAM_MAGIC, 8) == 0) {
+			printf("Log stream, %llu entries per window\n", rec[2]);
+			stream = 1;
+			continue;
+		}
+		if (stream && memcmp(rec, WINDOW_MAGIC, 8) == 0) {
+			loop_flush();
+			printf("\n=== window %llu%s%s", rec[1],
+			       (rec[3] & 1)? ", log trigger": "",
+			       (rec[3] & 2)? ", memory trigger": "");
+			/* 0 when the core has no instruction counter */
+			if (rec[2])
+				printf(", instruction count %llu", rec[2]);
+			if (rec[1] && rec[2] && rec[2] >= last_icount)
+				printf(", %llu since the last window, not all logged",
+				       rec[2] - last_icount);
+			printf(" ===\n");
+			last_icount = rec[2];
+			for (i = 0; i < 15; ++i)
+				full_nia[i] = i << 2;
+			header = 1;
+			tl_flush_all(lineno);
+			refilling = 0;
+			continue;
+		}
+		memcpy(&log, rec, sizeof(log));
 		full_nia[log.nia_lo & 0xf] = (log.nia_hi? 0xc000000000000000: 0) |
 			(log.nia_lo << 2);
-		if (lineno % 20 == 1) {
-			printf("        fetch1 NIA      icache                             decode1       decode2   execute1         loadstore  dcache       CR   GSPR\n");
-			printf("     ----------------   TAHW S -WB-- pN  ic --insn--    pN un op         pN byp    FR IIE MSR  WC   SD MM CE   SRTO DE -WB-- c ms reg val\n");
-			printf("                        LdMy t csnSa IA                 IA it            IA abc    le srx EPID em   tw rd mx   tAwp vr csnSa 0 k\n");
-		}
-		printf("%4ld %c0000%.11llx %c ", lineno,
-		       (log.nia_hi? 'c': '0'),
-		       (unsigned long long)log.nia_lo << 2,
-		       FLAG(ic_stall_out, '|'));
-		printf("%c%c%c%d %c %c%c%d%c%c %.2llx ",
-		       FLGA(ic_ra_valid, ' ', 'T'),
-		       FLGA(ic_access_ok, ' ', 'X'),
-		       FLGA(ic_is_hit, 'H', FLGA(ic_is_miss, 'M', ' ')),
-		       log.ic_way,
-		       FLAG(ic_state, 'W'),
-		       FLAG(ic_wb_cyc, 'c'),
-		       FLAG(ic_wb_stb, 's'),
-		       log.ic_wb_adr,
-		       FLAG(ic_wb_stall, 'S'),
-		       FLAG(ic_wb_ack, 'a'),
-		       PNIA(ic_part_nia));
-		if (log.ic_valid) {
-			if (log.ic_insn & (1ul << 35))
-				printf("ill %.8lx", log.ic_insn & 0xfffffffful);
-			else
-				printf("%3lu x%.7lx", (long)(log.ic_insn >> 26),
-				       (unsigned long)(log.ic_insn & 0x3ffffff));
-		} else if (log.ic_fetch_failed)
-			printf("    !!!!!!!!");
-		else
-			printf("--- --------");
-		printf(" %c%c %.2llx ",
-		       FLAG(ic_valid, '>'),
-		       FLAG(d2_stall_out, '|'),
-		       PNIA(d1_part_nia));
-		if (log.d1_valid)
-			printf("%s %s",
-			       units[log.d1_unit],
-			       ops[log.d1_insn_type]);
+		if (quiet)
+			;
+		else if (loops)
+			loop_add(log, full_nia, lineno, header);
 		else
-			printf("-- -------");
-		printf(" %c%c ",
-		       FLAG(d1_valid, '>'),
-		       FLAG(d2_stall_out, '|'));
-		printf("%.2llx %c%c%c %c%c ",
-		       PNIA(d2_part_nia),
-		       FLAG(d2_bypass_a, 'a'),
-		       FLAG(d2_bypass_b, 'b'),
-		       FLAG(d2_bypass_c, 'c'),
-		       FLAG(d2_valid, '>'),
-		       FLAG(e1_stall_out, '|'));
-		printf("%c%c %c%c%c %c%c%c%c %c%c ",
-		       FLAG(e1_flush_out, 'F'),
-		       FLAG(e1_redirect, 'R'),
-		       FLAG(e1_irq_state, 'w'),
-		       FLAG(e1_irq, 'I'),
-		       FLAG(e1_exception, 'X'),
-		       FLAG(e1_msr_ee, 'E'),
-		       FLGA(e1_msr_pr, 'u', 's'),
-		       FLAG(e1_msr_ir, 'I'),
-		       FLAG(e1_msr_dr, 'D'),
-		       FLAG(e1_write_enable, 'W'),
-		       FLAG(e1_valid, 'C'));
-		printf("%c %d%d %c%c %c%c %c ",
-		       FLAG(ls_stall_out, '|'),
-		       log.ls_state,
-		       log.ls_dw_done,
-		       FLAG(ls_mo_valid, 'M'),
-		       FLAG(ls_min_done, 'm'),
-		       FLAG(ls_lo_valid, 'C'),
-		       FLAG(ls_eo_except, 'X'),
-		       FLAG(ls_do_valid, '>'));
-		printf("%d%c%d%d %c%c %c%c%d%c%c ",
-		       log.dc_state,
-		       FLAG(dc_ra_valid, 'R'),
-		       log.dc_tlb_way,
-		       log.dc_op,
-		       FLAG(dc_do_valid, 'V'),
-		       FLAG(dc_do_error, 'E'),
-		       FLAG(dc_wb_cyc, 'c'),
-		       FLAG(dc_wb_stb, 's'),
-		       log.dc_wb_adr,
-		       FLAG(dc_wb_stall, 'S'),
-		       FLAG(dc_wb_ack, 'a'));
-		if (log.cr_wr_enable)
-			printf("%x>%.2x ", log.cr_wr_data, log.cr_wr_mask);
-		else
-			printf("     ");
-		if (log.reg_wr_enable) {
-			if (log.reg_wr_reg < 32 || log.reg_wr_reg > 44)
-				printf("r%02d", log.reg_wr_reg);
-			else
-				printf("%s", spr_names[log.reg_wr_reg - 32]);
-			printf("=%.16llx", log.reg_wr_data);
-		}
-		printf("\n");
+			print_entry(log, full_nia, lineno, header);
+		header = 0;
+		if (stats)
+			stats_cycle(&log);
+		if (konata || chrome || stats)
+			tl_cycle(&log, full_nia, lineno);
 		++lineno;
-		if (log.ls_lo_valid || log.e1_valid)
+		if (log.ls_lo_valid || log.e1_valid || log.fp_valid)
 			++ncompl;
 	}
+	if (loops)
+		loop_flush();
+	tl_finish(lineno);
+	if (konata)
+		fclose(konata);
+	if (chrome)
+		fclose(chrome);
 	printf("%ld instructions completed, %.2f CPI\n", ncompl,
 	       (double)(lineno - 1) / ncompl);
+	if (stats)
+		stats_print(lineno - 1, ncompl, top);
 	exit(0);
 }
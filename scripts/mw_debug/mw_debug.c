@@ -16,9 +16,13 @@
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <urjtag/urjtag.h>
 #include <inttypes.h>
+#include <time.h>
+#include <elf.h>
 
 #define DBG_WB_ADDR		0x00
 #define DBG_WB_DATA		0x01
@@ -49,13 +53,40 @@ unsigned int core;
 #define DBG_LOG_TRIGGER		(0x18 + (core << 4))
 #define DBG_LOG_MTRIGGER	(0x19 + (core << 4))
 
+#define DBG_CORE_ICOUNT		(0x1a + (core << 4))
+
+/* Address of the last completed instruction, bit 0 is MSR[PR] */
+#define DBG_CORE_SAMPLE		(0x1c + (core << 4))
+
+/* core_tb only, see sim_bram.vhdl */
+#define DBG_SIM_RAM		0xfe
+#define  DBG_SIM_RAM_DUMP		0
+#define  DBG_SIM_RAM_SNAPSHOT		1
+#define  DBG_SIM_RAM_RESTORE		2
+#define  DBG_SIM_RAM_WRITES		3
+
 static bool debug;
 
+/* Set by ^C during long running commands */
+static volatile sig_atomic_t interrupted;
+
+static void sigint_handler(int sig)
+{
+	interrupted = 1;
+}
+
 struct backend {
 	int (*init)(const char *target, int freq);
 	int (*reset)(void);
 	int (*command)(uint8_t op, uint8_t addr, uint64_t *data);
+	/*
+	 * Optional, count complete DMI accesses to one address. Can fail
+	 * with DMI_RETRY if some of them may have been dropped.
+	 */
+	int (*read)(uint8_t addr, uint64_t *data, uint32_t count);
+	int (*write)(uint8_t addr, const uint64_t *data, uint32_t count);
 };
+#define DMI_RETRY	-2
 static struct backend *b;
 
 static void check(int r, const char *failstr)
@@ -68,8 +99,44 @@ static void check(int r, const char *failstr)
 
 /* -------------- SIM backend -------------- */
 
+/* Frames of DMI accesses, see sim_jtag_socket_c.c */
+#define SIM_FRAME_MAGIC		0xfd
+#define SIM_FRAME_HDR		8
+#define SIM_FRAME_READ_BLOCK	3
+#define SIM_FRAME_WRITE_BLOCK	4
+
+/* Words per frame, the sim takes up to 1MB */
+#define SIM_FRAME_WORDS		8192
+
 static int sim_fd = -1;
 
+static int sim_init_unix(const char *path)
+{
+	struct sockaddr_un saddr;
+	int rc;
+
+	if (debug)
+		printf("Opening sim backend socket '%s'\n", path);
+
+	sim_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sim_fd < 0) {
+		fprintf(stderr, "Error opening socket: %s\n",
+			strerror(errno));
+		return -1;
+	}
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sun_family = AF_UNIX;
+	strncpy(saddr.sun_path, path, sizeof(saddr.sun_path) - 1);
+	rc = connect(sim_fd, (struct sockaddr *)&saddr, sizeof(saddr));
+	if (rc < 0) {
+		close(sim_fd);
+		fprintf(stderr,"Connection to '%s' failed: %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
 static int sim_init(const char *target, int freq)
 {
 	struct sockaddr_in saddr;
@@ -81,6 +148,8 @@ static int sim_init(const char *target, int freq)
 
 	if (!target)
 		target = "localhost:13245";
+	if (strncmp(target, "unix:", 5) == 0)
+		return sim_init_unix(target + 5);
 	p = strchr(target, ':');
 	host = strndup(target, p - target);
 	if (p && *p)
@@ -205,10 +274,159 @@ static int sim_command(uint8_t op, uint8_t addr, uint64_t *data)
 	return r;
 }
 
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	int i;
+
+	for (i = 0; i < 4; i++)
+		p[i] = v >> (i * 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static int sim_send(const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+	ssize_t r;
+
+	while (len) {
+		r = write(sim_fd, p, len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			fprintf(stderr, "failed to write sim frame\n");
+			return -1;
+		}
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static int sim_recv(void *buf, size_t len)
+{
+	uint8_t *p = buf;
+	ssize_t r;
+
+	while (len) {
+		r = read(sim_fd, p, len);
+		if (r < 0 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			fprintf(stderr, "failed to read sim frame\n");
+			return -1;
+		}
+		p += r;
+		len -= r;
+	}
+	return 0;
+}
+
+static int sim_send_frame(uint8_t op, uint8_t addr, const uint64_t *data,
+			  uint32_t count)
+{
+	uint8_t hdr[SIM_FRAME_HDR + 6];
+	uint8_t *buf;
+	uint32_t i, len;
+	int rc;
+
+	len = 6;
+	if (op == SIM_FRAME_WRITE_BLOCK)
+		len += count * 8;
+
+	memset(hdr, 0, sizeof(hdr));
+	hdr[0] = SIM_FRAME_MAGIC;
+	put_le32(hdr + 4, len);
+	hdr[SIM_FRAME_HDR] = op;
+	hdr[SIM_FRAME_HDR + 1] = addr;
+	put_le32(hdr + SIM_FRAME_HDR + 2, count);
+	if (op != SIM_FRAME_WRITE_BLOCK)
+		return sim_send(hdr, sizeof(hdr));
+
+	buf = malloc(sizeof(hdr) + count * 8);
+	if (!buf) {
+		fprintf(stderr, "Out of memory\n");
+		return -1;
+	}
+	memcpy(buf, hdr, sizeof(hdr));
+	for (i = 0; i < count; i++) {
+		put_le32(buf + sizeof(hdr) + i * 8, data[i]);
+		put_le32(buf + sizeof(hdr) + i * 8 + 4, data[i] >> 32);
+	}
+	rc = sim_send(buf, sizeof(hdr) + count * 8);
+	free(buf);
+	return rc;
+}
+
+static int sim_recv_frame(uint64_t *data, uint32_t count)
+{
+	uint8_t hdr[SIM_FRAME_HDR], buf[8];
+	uint32_t i, len;
+
+	if (sim_recv(hdr, sizeof(hdr)) < 0)
+		return -1;
+	len = get_le32(hdr + 4);
+	if (hdr[0] != SIM_FRAME_MAGIC || len != (data ? count * 8 : 0)) {
+		fprintf(stderr, "bad sim frame reply\n");
+		return -1;
+	}
+	for (i = 0; data && i < count; i++) {
+		if (sim_recv(buf, 8) < 0)
+			return -1;
+		data[i] = get_le32(buf) | (uint64_t)get_le32(buf + 4) << 32;
+	}
+	if (hdr[1]) {
+		fprintf(stderr, "sim frame failed, status %d\n", hdr[1]);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Send all the frames for a block before collecting the replies, so
+ * the sim doesn't wait on us between them.
+ */
+static int sim_block(uint8_t op, uint8_t addr, uint64_t *rdata,
+		     const uint64_t *wdata, uint32_t count)
+{
+	uint32_t done, n;
+
+	for (done = 0; done < count; done += n) {
+		n = count - done;
+		if (n > SIM_FRAME_WORDS)
+			n = SIM_FRAME_WORDS;
+		if (sim_send_frame(op, addr, wdata ? wdata + done : NULL, n) < 0)
+			return -1;
+	}
+	for (done = 0; done < count; done += n) {
+		n = count - done;
+		if (n > SIM_FRAME_WORDS)
+			n = SIM_FRAME_WORDS;
+		if (sim_recv_frame(rdata ? rdata + done : NULL, n) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int sim_read(uint8_t addr, uint64_t *data, uint32_t count)
+{
+	return sim_block(SIM_FRAME_READ_BLOCK, addr, data, NULL, count);
+}
+
+static int sim_write(uint8_t addr, const uint64_t *data, uint32_t count)
+{
+	return sim_block(SIM_FRAME_WRITE_BLOCK, addr, NULL, data, count);
+}
+
 static struct backend sim_backend = {
 	.init	= sim_init,
 	.reset = sim_reset,
 	.command = sim_command,
+	.read = sim_read,
+	.write = sim_write,
 };
 
 /* -------------- JTAG backend -------------- */
@@ -436,22 +654,124 @@ static int jtag_command(uint8_t op, uint8_t addr, uint64_t *data)
 	return rc;
 }
 
+/*
+ * Streaming: a batch of command scans is queued with the cable and the
+ * outputs collected at the end, rather than a status scan and a round
+ * trip to the cable after every command. Each scan captures the status
+ * of the previous command, and a JTAG scan takes long enough that it
+ * has normally completed. If it hadn't, the DTM may or may not have
+ * taken the following command, so the batch fails with DMI_RETRY and
+ * the caller starts again from a known address.
+ */
+#define JTAG_BATCH	256
+
+static urj_tap_register_t *batch_in[JTAG_BATCH + 1];
+static urj_tap_register_t *batch_out[JTAG_BATCH + 1];
+
+static int jtag_batch(uint8_t op, uint8_t addr, uint64_t *rdata,
+		      const uint64_t *wdata, uint32_t count)
+{
+	uint64_t d;
+	uint32_t i;
+	int status;
+
+	for (i = 0; i <= count; i++) {
+		if (!batch_in[i]) {
+			batch_in[i] = urj_tap_register_alloc(74);
+			batch_out[i] = urj_tap_register_alloc(74);
+			if (!batch_in[i] || !batch_out[i])
+				return -1;
+		}
+		/* The last scan is a NOP to collect the last status */
+		urj_tap_register_set_value_bit_range(batch_in[i], i < count ? op : 0, 1, 0);
+		urj_tap_register_set_value_bit_range(batch_in[i], wdata && i < count ? wdata[i] : 0, 65, 2);
+		urj_tap_register_set_value_bit_range(batch_in[i], addr, 73, 66);
+		urj_tap_capture_dr(jc);
+		urj_tap_defer_shift_register(jc, batch_in[i], batch_out[i],
+					     URJ_CHAIN_EXITMODE_IDLE);
+	}
+	for (i = 0; i <= count; i++)
+		urj_tap_shift_register_output(jc, batch_in[i], batch_out[i],
+					      URJ_CHAIN_EXITMODE_IDLE);
+
+	for (i = 0; i <= count; i++) {
+		status = urj_tap_register_get_value_bit_range(batch_out[i], 1, 0);
+		d = urj_tap_register_get_value_bit_range(batch_out[i], 65, 2);
+		if (status == 3 && i == count) {
+			/* The last command is still going, wait for it */
+			do {
+				status = jtag_command(0, 0, &d);
+				if (status < 0)
+					return -1;
+			} while (status == 3);
+		}
+		if (status == 3) {
+			/* Let it finish so the next batch starts idle */
+			do {
+				status = jtag_command(0, 0, NULL);
+			} while (status == 3);
+			return status < 0 ? status : DMI_RETRY;
+		}
+		if (status != 0) {
+			fprintf(stderr, "Unknown status code %d !\n", (int)status);
+			return -1;
+		}
+		if (rdata && i > 0)
+			rdata[i - 1] = d;
+	}
+	return 0;
+}
+
+static int jtag_read(uint8_t addr, uint64_t *data, uint32_t count)
+{
+	uint32_t i, n;
+	int rc;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < JTAG_BATCH ? count - i : JTAG_BATCH;
+		rc = jtag_batch(1, addr, data + i, NULL, n);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
+static int jtag_write(uint8_t addr, const uint64_t *data, uint32_t count)
+{
+	uint32_t i, n;
+	int rc;
+
+	for (i = 0; i < count; i += n) {
+		n = count - i < JTAG_BATCH ? count - i : JTAG_BATCH;
+		rc = jtag_batch(2, addr, NULL, data + i, n);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
 static struct backend bscane2_backend = {
 	.init	= bscane2_init,
 	.reset = jtag_reset,
 	.command = jtag_command,
+	.read = jtag_read,
+	.write = jtag_write,
 };
 
 static struct backend ecp5_backend = {
 	.init	= ecp5_init,
 	.reset = jtag_reset,
 	.command = jtag_command,
+	.read = jtag_read,
+	.write = jtag_write,
 };
 
 static int dmi_read(uint8_t addr, uint64_t *data)
 {
 	int rc;
 
+	if (b->read)
+		return b->read(addr, data, 1);
 	rc = b->command(1, addr, data);
 	if (rc < 0)
 		return rc;
@@ -470,6 +790,8 @@ static int dmi_write(uint8_t addr, uint64_t data)
 {
 	int rc;
 
+	if (b->write)
+		return b->write(addr, &data, 1);
 	rc = b->command(2, addr, &data);
 	if (rc < 0)
 		return rc;
@@ -484,6 +806,37 @@ static int dmi_write(uint8_t addr, uint64_t data)
 	}
 }
 
+/* Repeated accesses to one address, eg DBG_WB_DATA with auto-increment */
+static int dmi_read_block(uint8_t addr, uint64_t *data, uint32_t count)
+{
+	uint32_t i;
+	int rc;
+
+	if (b->read)
+		return b->read(addr, data, count);
+	for (i = 0; i < count; i++) {
+		rc = dmi_read(addr, &data[i]);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
+static int dmi_write_block(uint8_t addr, const uint64_t *data, uint32_t count)
+{
+	uint32_t i;
+	int rc;
+
+	if (b->write)
+		return b->write(addr, data, count);
+	for (i = 0; i < count; i++) {
+		rc = dmi_write(addr, data[i]);
+		if (rc < 0)
+			return rc;
+	}
+	return 0;
+}
+
 static void core_status(void)
 {
 	uint64_t stat, nia, msr;
@@ -552,7 +905,8 @@ static const char *fast_spr_names[] =
 	"lr", "ctr", "srr0", "srr1", "hsrr0", "hsrr1",
 	"sprg0", "sprg1", "sprg2", "sprg3",
 	"hsprg0", "hsprg1", "xer", "tar",
-	"fscr", "lpcr", "heir", "cfar",
+	"fscr", "lpcr", "heir", "cfar", "dec", "tb",
+	"cr",
 };
 
 static const char *ldst_spr_names[] = {
@@ -584,24 +938,75 @@ static void gpr_read(uint64_t reg, uint64_t count)
 	}
 }
 
+/* Words per block in memory transfers */
+#define BLOCK_WORDS	8192
+
+/*
+ * Blocks of memory through the wishbone debug master with address
+ * auto-increment, WB_PIECE words at a time from a freshly set address.
+ * If the backend can't be sure every access in a piece was done, the
+ * piece is redone one access at a time.
+ */
+#define WB_PIECE	1024
+
+static int wb_block(uint64_t addr, uint64_t *rdata, const uint64_t *wdata,
+		    uint32_t count)
+{
+	uint32_t done, n, i;
+	int rc;
+
+	rc = dmi_write(DBG_WB_CTRL, 0x7ff);
+	for (done = 0; done < count && rc >= 0; done += n) {
+		n = count - done < WB_PIECE ? count - done : WB_PIECE;
+		rc = dmi_write(DBG_WB_ADDR, addr + done * 8);
+		if (rc < 0)
+			break;
+		if (rdata)
+			rc = dmi_read_block(DBG_WB_DATA, rdata + done, n);
+		else
+			rc = dmi_write_block(DBG_WB_DATA, wdata + done, n);
+		if (rc != DMI_RETRY)
+			continue;
+
+		rc = dmi_write(DBG_WB_ADDR, addr + done * 8);
+		for (i = 0; i < n && rc >= 0; i++) {
+			if (rdata)
+				rc = dmi_read(DBG_WB_DATA, &rdata[done + i]);
+			else
+				rc = dmi_write(DBG_WB_DATA, wdata[done + i]);
+		}
+	}
+	return rc;
+}
+
+static int wb_read(uint64_t addr, uint64_t *data, uint32_t count)
+{
+	return wb_block(addr, data, NULL, count);
+}
+
+static int wb_write(uint64_t addr, const uint64_t *data, uint32_t count)
+{
+	return wb_block(addr, NULL, data, count);
+}
+
 static void mem_read(uint64_t addr, uint64_t count)
 {
 	union {
 		uint64_t data;
 		unsigned char c[8];
 	} u;
-	int i, j, rc;
+	uint64_t *data;
+	int i, j;
 
-	rc = dmi_write(DBG_WB_CTRL, 0x7ff);
-	if (rc < 0)
-		return;
-	rc = dmi_write(DBG_WB_ADDR, addr);
-	if (rc < 0)
+	data = calloc(count, sizeof(*data));
+	if (!data) {
+		fprintf(stderr, "Out of memory\n");
 		return;
+	}
+	if (wb_read(addr, data, count) < 0)
+		goto out;
 	for (i = 0; i < count; i++) {
-		rc = dmi_read(DBG_WB_DATA, &u.data);
-		if (rc < 0)
-			return;
+		u.data = data[i];
 		printf("%016llx: %016llx  ",
 		       (unsigned long long)addr,
 		       (unsigned long long)u.data);
@@ -610,6 +1015,8 @@ static void mem_read(uint64_t addr, uint64_t count)
 		putchar('\n');
 		addr += 8;
 	}
+out:
+	free(data);
 }
 
 static void mem_write(uint64_t addr, uint64_t data)
@@ -619,70 +1026,221 @@ static void mem_write(uint64_t addr, uint64_t data)
 	check(dmi_write(DBG_WB_DATA, data), "writing WB_DATA");
 }
 
-static void load(const char *filename, uint64_t addr)
+/* FNV-1a, to compare what was loaded with what reads back */
+#define CSUM_INIT	0xcbf29ce484222325ull
+
+static uint64_t csum(uint64_t h, const uint8_t *p, size_t len)
 {
-	uint64_t data;
-	int fd, rc, count;
+	while (len--) {
+		h ^= *p++;
+		h *= 0x100000001b3ull;
+	}
+	return h;
+}
+
+/*
+ * Copy len bytes from fd at offset off (zeroes if fd < 0 or past the
+ * end of the file) to memory at addr, a block at a time. Partial words
+ * at either end are merged with what is in memory. With verify set,
+ * memory is read back instead, and its checksum compared with the
+ * file's.
+ */
+static void transfer(uint64_t addr, int fd, uint64_t off, uint64_t len,
+		     bool verify)
+{
+	uint64_t words[BLOCK_WORDS], back[BLOCK_WORDS];
+	uint64_t h = CSUM_INIT, hback = CSUM_INIT, bad = 0;
+	bool mismatch = false;
+	uint64_t done, start, end, waddr, n, i;
+	uint8_t *buf = (uint8_t *)words, *b = (uint8_t *)back;
+	ssize_t rc = 0;
+
+	for (done = 0; done < len; done += n) {
+		/* Bytes of this block, from start to end within its words */
+		waddr = (addr + done) & ~7ull;
+		start = (addr + done) & 7;
+		n = BLOCK_WORDS * 8 - start;
+		if (n > len - done)
+			n = len - done;
+		end = start + n;
+
+		if (verify || start || (end & 7)) {
+			check(wb_read(waddr, back, (end + 7) / 8), "reading memory");
+			memcpy(words, back, sizeof(words));
+		}
+		if (fd >= 0)
+			rc = pread(fd, buf + start, n, off + done);
+		if (rc < 0) {
+			fprintf(stderr, "Read error: %s\n", strerror(errno));
+			exit(1);
+		}
+		memset(buf + start + rc, 0, n - rc);
+		h = csum(h, buf + start, n);
+
+		if (verify) {
+			hback = csum(hback, b + start, n);
+			for (i = start; i < end && !mismatch; i++) {
+				if (buf[i] != b[i]) {
+					bad = waddr + i;
+					mismatch = true;
+				}
+			}
+		} else {
+			check(wb_write(waddr, words, (end + 7) / 8), "writing memory");
+		}
+		printf("%" PRIx64 "...\r", done + n);
+		fflush(stdout);
+	}
+
+	if (verify && (mismatch || h != hback)) {
+		fprintf(stderr, "Verify failed, checksum %016" PRIx64
+			" should be %016" PRIx64 ", first difference at %" PRIx64 "\n",
+			hback, h, bad);
+		exit(1);
+	}
+}
+
+/* ELF header fields in the file's byte order */
+static bool elf_swap;
+
+static uint64_t elf_val(uint64_t v, int size)
+{
+	if (!elf_swap)
+		return v;
+	switch (size) {
+	case 2:
+		return __builtin_bswap16(v);
+	case 4:
+		return __builtin_bswap32(v);
+	default:
+		return __builtin_bswap64(v);
+	}
+}
+#define ELF(x)	elf_val((x), sizeof(x))
+
+/*
+ * Load each PT_LOAD segment of a 64-bit ELF at its physical address
+ * plus base, clearing the part not in the file. Returns the number of
+ * bytes loaded.
+ */
+static uint64_t load_elf(int fd, uint64_t base, bool verify)
+{
+	Elf64_Ehdr eh;
+	Elf64_Phdr ph;
+	uint64_t paddr, filesz, memsz, total = 0;
+	unsigned int i;
+
+	if (pread(fd, &eh, sizeof(eh), 0) != sizeof(eh) ||
+	    eh.e_ident[EI_CLASS] != ELFCLASS64) {
+		fprintf(stderr, "Only 64-bit ELF files are supported\n");
+		exit(1);
+	}
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	elf_swap = eh.e_ident[EI_DATA] != ELFDATA2LSB;
+#else
+	elf_swap = eh.e_ident[EI_DATA] != ELFDATA2MSB;
+#endif
+
+	for (i = 0; i < ELF(eh.e_phnum); i++) {
+		if (pread(fd, &ph, sizeof(ph), ELF(eh.e_phoff) +
+			  i * ELF(eh.e_phentsize)) != sizeof(ph)) {
+			fprintf(stderr, "Failed to read program header %d\n", i);
+			exit(1);
+		}
+		if (ELF(ph.p_type) != PT_LOAD || !ELF(ph.p_memsz))
+			continue;
+		paddr = ELF(ph.p_paddr) + base;
+		filesz = ELF(ph.p_filesz);
+		memsz = ELF(ph.p_memsz);
+		printf("%s segment %d: %" PRIx64 " bytes at %" PRIx64 "\n",
+		       verify ? "Verifying" : "Loading", i, memsz, paddr);
+		total += memsz;
+		transfer(paddr, fd, ELF(ph.p_offset), filesz, verify);
+		if (memsz > filesz)
+			transfer(paddr + filesz, -1, 0, memsz - filesz, verify);
+	}
+	printf("Entry point %" PRIx64 "\n", (uint64_t)ELF(eh.e_entry) + base);
+	return total;
+}
+
+/*
+ * A raw binary is loaded at addr, an ELF file's segments at their
+ * physical addresses offset by addr. With verify set, memory is
+ * compared with the file rather than written.
+ */
+static void load(const char *filename, uint64_t addr, bool verify)
+{
+	unsigned char ident[SELFMAG];
+	uint64_t size;
+	int fd;
 
 	fd = open(filename, O_RDONLY);
 	if (fd < 0) {
 		fprintf(stderr, "Failed to open '%s': %s\n", filename, strerror(errno));
 		exit(1);
 	}
-	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
-	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
-	count = 0;
-	for (;;) {
-		data = 0;
-		rc = read(fd, &data, 8);
-		if (rc <= 0)
-			break;
-		// if (rc < 8) XXX fixup endian ?
-		check(dmi_write(DBG_WB_DATA, data), "writing WB_DATA");
-		count += 8;
-		if (!(count % 1024)) {
-			printf("%x...\r", count);
-			fflush(stdout);
-		}
+
+	if (pread(fd, ident, SELFMAG, 0) == SELFMAG &&
+	    !memcmp(ident, ELFMAG, SELFMAG)) {
+		size = load_elf(fd, addr, verify);
+	} else {
+		/* Whole words, padded with zeroes */
+		size = (lseek(fd, 0, SEEK_END) + 7) & ~7ull;
+		transfer(addr, fd, 0, size, verify);
 	}
 	close(fd);
-	printf("%x done.\n", count);
+	if (verify)
+		printf("%" PRIx64 " verified.\n", size);
+	else
+		printf("%" PRIx64 " done.\n", size);
 }
 
 static void save(const char *filename, uint64_t addr, uint64_t size)
 {
-	uint64_t data;
-	int fd, rc, count;
+	uint64_t data[BLOCK_WORDS];
+	uint64_t count, n;
+	int fd, rc;
 
 	fd = open(filename, O_WRONLY | O_CREAT, 00666);
 	if (fd < 0) {
 		fprintf(stderr, "Failed to open '%s': %s\n", filename, strerror(errno));
 		exit(1);
 	}
-	check(dmi_write(DBG_WB_CTRL, 0x7ff), "writing WB_CTRL");
-	check(dmi_write(DBG_WB_ADDR, addr), "writing WB_ADDR");
-	count = 0;
-	for (;;) {
-		check(dmi_read(DBG_WB_DATA, &data), "reading WB_DATA");
-		rc = write(fd, &data, 8);
+	/* At least one word, as before */
+	for (count = 0; count < size || !count; count += n * 8) {
+		n = (size - count + 7) / 8;
+		if (n > BLOCK_WORDS)
+			n = BLOCK_WORDS;
+		if (!n)
+			n = 1;
+		check(wb_read(addr + count, data, n), "reading WB_DATA");
+		rc = write(fd, data, n * 8);
 		if (rc <= 0) {
 			fprintf(stderr, "Failed to write: %s\n", strerror(errno));
 			break;
 		}
-		count += 8;
-		if (!(count % 1024)) {
-			printf("%x...\r", count);
-			fflush(stdout);
-		}
-		if (count >= size)
-			break;
+		printf("%" PRIx64 "...\r", count + n * 8);
+		fflush(stdout);
 	}
 	close(fd);
-	printf("%x done.\n", count);
+	printf("%" PRIx64 " done.\n", count);
 }
 
 #define LOG_STOP	0x80000000ull
 
+/* Entries in the log and the oldest one, from LOG_ADDR */
+static uint64_t log_size(uint64_t laddr, uint64_t *waddr)
+{
+	uint64_t lsize;
+
+	*waddr = laddr >> 32;
+	for (lsize = 1; lsize; lsize <<= 1)
+		if ((*waddr >> 1) < lsize)
+			break;
+	*waddr &= ~lsize;
+	return lsize;
+}
+
 static void log_start(void)
 {
 	check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
@@ -694,21 +1252,50 @@ static void log_stop(void)
 
 	check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
 	check(dmi_read(DBG_LOG_ADDR, &laddr), "reading LOG_ADDR");
-	waddr = laddr >> 32;
-	for (lsize = 1; lsize; lsize <<= 1)
-		if ((waddr >> 1) < lsize)
-			break;
-	waddr &= ~lsize;
+	lsize = log_size(laddr, &waddr);
 	printf("Log size = %" PRIu64 " entries, ", lsize);
 	printf("write ptr = %" PRIx64 "\n", waddr);
 }
 
+/* Copy count entries of the stopped log from start on to a file */
+static void log_read(FILE *f, const char *filename, uint64_t lsize,
+		     uint64_t start, uint64_t count, bool progress)
+{
+	uint64_t laddr, i, j, n, ldata[128];
+	int rc;
+
+	laddr = LOG_STOP | (start << 2);
+	check(dmi_write(DBG_LOG_ADDR, laddr), "writing LOG_ADDR");
+
+	for (i = 0; i < count * 4; i += n) {
+		n = count * 4 - i;
+		if (n > 128)
+			n = 128;
+		rc = dmi_read_block(DBG_LOG_DATA, ldata, n);
+		if (rc == DMI_RETRY) {
+			/* Start again from this point, one read at a time */
+			laddr = LOG_STOP | (((start << 2) + i) & (lsize * 4 - 1));
+			rc = dmi_write(DBG_LOG_ADDR, laddr);
+			for (j = 0; j < n && rc >= 0; j++)
+				rc = dmi_read(DBG_LOG_DATA, &ldata[j]);
+		}
+		check(rc, "reading LOG_DATA");
+		if (fwrite(ldata, sizeof(ldata[0]), n, f) != n) {
+			fprintf(stderr, "Write error on %s\n", filename);
+			exit(1);
+		}
+		if (progress) {
+			printf("%" PRIu64 "...\r", i * 8);
+			fflush(stdout);
+		}
+	}
+}
+
 static void log_dump(const char *filename)
 {
 	FILE *f;
-	uint64_t lsize, laddr, waddr;
+	uint64_t lsize, waddr;
 	uint64_t orig_laddr;
-	uint64_t i, ldata;
 
 	f = fopen(filename, "w");
 	if (f == NULL) {
@@ -721,31 +1308,141 @@ static void log_dump(const char *filename)
 	if (!(orig_laddr & LOG_STOP))
 		check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
 
-	waddr = orig_laddr >> 32;
-	for (lsize = 1; lsize; lsize <<= 1)
-		if ((waddr >> 1) < lsize)
-			break;
-	waddr &= ~lsize;
+	lsize = log_size(orig_laddr, &waddr);
 	printf("Log size = %" PRIu64 " entries\n", lsize);
 
-	laddr = LOG_STOP | (waddr << 2);
-	check(dmi_write(DBG_LOG_ADDR, laddr), "writing LOG_ADDR");
+	log_read(f, filename, lsize, waddr, lsize, true);
+	fclose(f);
+	printf("%" PRIu64 " done\n", lsize * 32);
 
-	for (i = 0; i < lsize * 4; ++i) {
-		check(dmi_read(DBG_LOG_DATA, &ldata), "reading LOG_DATA");
-		if (fwrite(&ldata, sizeof(ldata), 1, f) != 1) {
-			fprintf(stderr, "Write error on %s\n", filename);
-			exit(1);
-		}
-		if (!(i % 128)) {
-			printf("%" PRIu64 "...\r", i * 8);
-			fflush(stdout);
+	check(dmi_write(DBG_LOG_ADDR, orig_laddr), "writing LOG_ADDR");
+}
+
+/*
+ * Capture log windows over and over into one file for fmt_log. With a
+ * log or memory trigger set (ltrig/mtrig) each window is the log around
+ * a hit of the trigger, which is then re-armed; without one the log is
+ * stopped as soon as it has been filled again, and drained. The core
+ * isn't stopped, so what runs while a window is being read isn't
+ * logged: each window's header holds the instruction count at capture
+ * for fmt_log to show the gap (0 if the core is built without
+ * HAS_ICOUNT).
+ *
+ * Restarting the log doesn't clear it, so the write pointer is followed
+ * from the restart and only the entries written since go in the window.
+ * A trigger that hits soon after the restart makes a short window.
+ *
+ * The file is a header then, for each window, a header and the entries.
+ * Headers are the size of a log entry: an 8 byte magic, then 64-bit
+ * words, the stream header's giving a version and the log length and
+ * a window's its sequence number, instruction count and which triggers
+ * fired.
+ */
+#define LOG_STREAM_MAGIC	"mwlogstr"
+#define LOG_WINDOW_MAGIC	"mwlogwin"
+
+/* Entries written since the last call, going by the write pointer */
+static uint64_t log_advance(uint64_t lsize, uint64_t *waddr)
+{
+	uint64_t laddr, w, n;
+
+	check(dmi_read(DBG_LOG_ADDR, &laddr), "reading LOG_ADDR");
+	log_size(laddr, &w);
+	n = (w - *waddr) & (lsize - 1);
+	*waddr = w;
+	return n;
+}
+
+static void log_stream(const char *filename, uint64_t windows)
+{
+	uint64_t hdr[4], trig, mtrig, laddr, waddr, lsize, icount, seq, fresh;
+	bool armed;
+	FILE *f;
+
+	f = fopen(filename, "w");
+	if (f == NULL) {
+		fprintf(stderr, "Failed to create '%s': %s\n", filename,
+			strerror(errno));
+		exit(1);
+	}
+
+	check(dmi_read(DBG_LOG_TRIGGER, &trig), "reading LOG_TRIGGER");
+	check(dmi_read(DBG_LOG_MTRIGGER, &mtrig), "reading LOG_MTRIGGER");
+	armed = (trig & 1) || (mtrig & 1);
+	check(dmi_read(DBG_LOG_ADDR, &laddr), "reading LOG_ADDR");
+	lsize = log_size(laddr, &waddr);
+
+	memset(hdr, 0, sizeof(hdr));
+	memcpy(hdr, LOG_STREAM_MAGIC, 8);
+	hdr[1] = 1;
+	hdr[2] = lsize;
+	fwrite(hdr, sizeof(hdr), 1, f);
+
+	printf("Streaming %" PRIu64 " entry windows %s (^C to stop)\n", lsize,
+	       armed ? "at each trigger" : "continuously");
+	interrupted = 0;
+	signal(SIGINT, sigint_handler);
+	for (seq = 0; (!windows || seq < windows) && !interrupted; seq++) {
+		/* Re-arm the triggers and restart logging */
+		if (trig & 1)
+			check(dmi_write(DBG_LOG_TRIGGER, trig & ~2ull), "writing LOG_TRIGGER");
+		if (mtrig & 1)
+			check(dmi_write(DBG_LOG_MTRIGGER, mtrig & ~2ull), "writing LOG_MTRIGGER");
+		check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
+		log_advance(lsize, &waddr);
+		fresh = 0;
+
+		/*
+		 * A trigger stops the log itself, a little after the hit.
+		 * Between two polls the pointer may have gone all the way
+		 * round, which is only ever undercounted, so nothing stale
+		 * is taken for new.
+		 */
+		if (armed) {
+			uint64_t t = 0, m = 0;
+
+			while (!interrupted) {
+				check(dmi_read(DBG_LOG_TRIGGER, &t), "reading LOG_TRIGGER");
+				check(dmi_read(DBG_LOG_MTRIGGER, &m), "reading LOG_MTRIGGER");
+				fresh += log_advance(lsize, &waddr);
+				if ((t | m) & 2)
+					break;
+			}
+			if (interrupted)
+				break;
+			hdr[3] = ((t >> 1) & 1) | (m & 2);
+		} else {
+			while (fresh < lsize && !interrupted)
+				fresh += log_advance(lsize, &waddr);
+			if (interrupted)
+				break;
+			check(dmi_write(DBG_LOG_ADDR, LOG_STOP), "writing LOG_ADDR");
+			hdr[3] = 0;
 		}
+		check(dmi_read(DBG_CORE_ICOUNT, &icount), "reading ICOUNT");
+		fresh += log_advance(lsize, &waddr);
+		if (fresh > lsize)
+			fresh = lsize;
+
+		memcpy(hdr, LOG_WINDOW_MAGIC, 8);
+		hdr[1] = seq;
+		hdr[2] = icount;
+		fwrite(hdr, sizeof(hdr), 1, f);
+		log_read(f, filename, lsize, (waddr - fresh) & (lsize - 1),
+			 fresh, false);
+		printf("%" PRIu64 " windows\r", seq + 1);
+		fflush(stdout);
 	}
+	signal(SIGINT, SIG_DFL);
 	fclose(f);
-	printf("%" PRIu64 " done\n", lsize * 32);
+	printf("%" PRIu64 " windows written to %s\n", seq, filename);
 
-	check(dmi_write(DBG_LOG_ADDR, orig_laddr), "writing LOG_ADDR");
+	/* Leave the triggers armed and the log running, as after lstart */
+	if (trig & 1)
+		check(dmi_write(DBG_LOG_TRIGGER, trig & ~2ull), "writing LOG_TRIGGER");
+	if (mtrig & 1)
+		check(dmi_write(DBG_LOG_MTRIGGER, mtrig & ~2ull), "writing LOG_MTRIGGER");
+	check(dmi_write(DBG_LOG_ADDR, 0), "writing LOG_ADDR");
 }
 
 static void ltrig_show(void)
@@ -792,9 +1489,858 @@ static void mtrig_set(uint64_t addr)
 	check(dmi_write(DBG_LOG_MTRIGGER, (addr & ~(uint64_t)2) | 1), "writing LOG_MTRIGGER");
 }
 
+/*
+ * Live PC sampling. DBG_CORE_SAMPLE, the address of the last completed
+ * instruction and MSR[PR], is read while the core runs, PERF_BATCH reads
+ * at a time so the backend can stream them, and counted in a hash table.
+ * The histogram is written in the format of core_tb's SIM_PROFILE, for
+ * scripts/profile.py to symbolize. Reading LR as well would take two
+ * more DMI accesses a sample, so it is written as 0 and there are no
+ * callers in the profile.
+ */
+#define PERF_BATCH	256
+#define PERF_BUCKETS	4096
+
+struct perf_bucket {
+	uint64_t sample;
+	uint64_t count;
+};
+
+static struct perf_bucket *perf_table;
+static unsigned long perf_size, perf_used;
+
+static struct perf_bucket *perf_lookup(struct perf_bucket *table,
+				       unsigned long size, uint64_t sample)
+{
+	unsigned long i = ((sample >> 2) * 0x9e3779b97f4a7c15ull >> 20) & (size - 1);
+
+	while (table[i].count && table[i].sample != sample)
+		i = (i + 1) & (size - 1);
+	return &table[i];
+}
+
+static void perf_add(uint64_t sample)
+{
+	struct perf_bucket *p;
+
+	if (perf_used * 2 >= perf_size) {
+		unsigned long size = perf_size ? perf_size * 2 : PERF_BUCKETS;
+		struct perf_bucket *table = calloc(size, sizeof(*table));
+
+		if (!table) {
+			fprintf(stderr, "Out of memory\n");
+			exit(1);
+		}
+		for (unsigned long i = 0; i < perf_size; i++)
+			if (perf_table[i].count)
+				*perf_lookup(table, size, perf_table[i].sample) = perf_table[i];
+		free(perf_table);
+		perf_table = table;
+		perf_size = size;
+	}
+	p = perf_lookup(perf_table, perf_size, sample);
+	if (!p->count) {
+		p->sample = sample;
+		perf_used++;
+	}
+	p->count++;
+}
+
+static int perf_compare(const void *a, const void *b)
+{
+	const struct perf_bucket *x = a, *y = b;
+
+	if (x->count != y->count)
+		return x->count > y->count ? -1 : 1;
+	return x->sample < y->sample ? -1 : x->sample > y->sample;
+}
+
+static double perf_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void perf_record(double seconds, const char *filename)
+{
+	uint64_t samples[PERF_BATCH], stat, total = 0;
+	double start, elapsed;
+	unsigned long i;
+	FILE *f;
+	int rc;
+
+	check(dmi_read(DBG_CORE_STAT, &stat), "reading core status");
+	if (stat & DBG_CORE_STAT_STOPPED)
+		fprintf(stderr, "Warning: core is stopped\n");
+
+	printf("Sampling core %d for %g seconds (^C to stop early)\n", core, seconds);
+	fflush(stdout);
+	interrupted = 0;
+	signal(SIGINT, sigint_handler);
+	start = perf_now();
+	do {
+		rc = dmi_read_block(DBG_CORE_SAMPLE, samples, PERF_BATCH);
+		for (i = 0; rc == DMI_RETRY && i < PERF_BATCH; i++)
+			check(dmi_read(DBG_CORE_SAMPLE, &samples[i]), "reading core sample");
+		check(rc == DMI_RETRY ? 0 : rc, "reading core sample");
+		for (i = 0; i < PERF_BATCH; i++)
+			perf_add(samples[i]);
+		total += PERF_BATCH;
+		elapsed = perf_now() - start;
+	} while (elapsed < seconds && !interrupted);
+	signal(SIGINT, SIG_DFL);
+
+	/* Only needed for the histogram now, so sort in place */
+	for (i = 0, perf_used = 0; i < perf_size; i++)
+		if (perf_table[i].count)
+			perf_table[perf_used++] = perf_table[i];
+	qsort(perf_table, perf_used, sizeof(*perf_table), perf_compare);
+
+	f = fopen(filename, "w");
+	if (!f) {
+		fprintf(stderr, "Failed to create '%s': %s\n", filename, strerror(errno));
+		exit(1);
+	}
+	fprintf(f, "# microwatt profile: %" PRIu64 " samples, mw_debug perf over %.1f seconds\n",
+		total, elapsed);
+	fprintf(f, "# cpu pr nia lr count\n");
+	for (i = 0; i < perf_used; i++)
+		fprintf(f, "%d %d 0x%016" PRIx64 " 0x0 %" PRIu64 "\n", core,
+			(int)(perf_table[i].sample & 1), perf_table[i].sample & ~(uint64_t)3,
+			perf_table[i].count);
+	fclose(f);
+
+	printf("%" PRIu64 " samples in %.1f seconds (%.0f/s), %lu addresses, written to %s\n",
+	       total, elapsed, total / elapsed, perf_used, filename);
+	for (i = 0; i < perf_used && i < 10; i++)
+		printf("%6.2f%% %016" PRIx64 "%s\n",
+		       100.0 * perf_table[i].count / total,
+		       perf_table[i].sample & ~(uint64_t)3,
+		       (perf_table[i].sample & 1) ? " (user)" : "");
+	free(perf_table);
+	perf_table = NULL;
+	perf_size = perf_used = 0;
+}
+
+/*
+ * GDB remote serial protocol server. The core is stopped when gdb
+ * connects and is run with "c" or stepped with "s".
+ *
+ * NIA and the registers can't be written through core_debug, so a trap
+ * or attn can't be used for breakpoints: execution couldn't be resumed
+ * at the breakpoint. Instead a breakpoint is a "b ." written over the
+ * instruction. While the core runs DBG_CORE_SAMPLE is polled, and when
+ * the last completed instruction is a breakpoint the core is stopped
+ * there, with NIA pointing at it and nothing else changed. gdb removes
+ * its breakpoints before stepping off one.
+ *
+ * Registers are read once per stop and memory below the I/O space is
+ * read in cached blocks, both dropped when the core is resumed.
+ */
+#define GDB_PACKET_SIZE	0x4000
+#define GDB_POLL_MS	10
+
+#define GDB_BREAK_INSN	0x48000000	/* b . */
+#define GDB_MAX_BREAKS	64
+
+#define GDB_LINE_WORDS	32
+#define GDB_LINES	64
+#define GDB_IO_BASE	0xc0000000ull
+
+/* The layout of gdb's powerpc:common64 g packet, then the extra SPRs */
+#define GDB_REG_PC	64
+#define GDB_REG_MSR	65
+#define GDB_REG_CR	66
+#define GDB_REG_LR	67
+#define GDB_REG_CTR	68
+#define GDB_REG_XER	69
+#define GDB_REG_FPSCR	70
+#define GDB_G_REGS	71
+
+static const uint8_t gdb_extra_gsprs[] = {
+	34, 35, 36, 37, 38, 39, 40, 41, 42, 43,	/* srr0 - hsprg1 */
+	45, 46, 47, 48, 49, 50, 51,		/* tar - tb */
+	60, 61, 62, 63,				/* pidr - dar */
+};
+#define GDB_NR_REGS	(GDB_G_REGS + sizeof(gdb_extra_gsprs))
+
+static int gdb_fd = -1;
+static bool gdb_noack;
+static uint8_t gdb_inbuf[4096];
+static unsigned int gdb_inpos, gdb_inlen;
+
+static uint64_t gdb_regs[GDB_G_REGS + 32];
+static bool gdb_reg_valid[GDB_G_REGS + 32];
+
+static struct {
+	uint64_t line;
+	bool valid;
+	uint64_t data[GDB_LINE_WORDS];
+} gdb_cache[GDB_LINES];
+
+static struct {
+	uint64_t addr;
+	uint32_t insn;
+} gdb_breaks[GDB_MAX_BREAKS];
+static unsigned int gdb_nr_breaks;
+static bool gdb_code_dirty;
+
+static int gdb_getc(int timeout)
+{
+	struct pollfd pfd = { .fd = gdb_fd, .events = POLLIN };
+	ssize_t n;
+
+	if (gdb_inpos == gdb_inlen) {
+		if (timeout >= 0 && poll(&pfd, 1, timeout) <= 0)
+			return -2;
+		n = read(gdb_fd, gdb_inbuf, sizeof(gdb_inbuf));
+		if (n <= 0)
+			return -1;
+		gdb_inpos = 0;
+		gdb_inlen = n;
+	}
+	return gdb_inbuf[gdb_inpos++];
+}
+
+static int gdb_put(const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(gdb_fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+static int gdb_send(const char *pkt)
+{
+	/* $, up to GDB_PACKET_SIZE characters, #xx and sprintf's NUL */
+	static char out[GDB_PACKET_SIZE + 5];
+	uint8_t cs = 0;
+	size_t len;
+	int c;
+
+	len = strlen(pkt);
+	for (size_t i = 0; i < len; i++)
+		cs += pkt[i];
+	out[0] = '$';
+	memcpy(out + 1, pkt, len);
+	sprintf(out + len + 1, "#%02x", cs);
+	if (debug)
+		printf("gdb <- %s\n", pkt);
+	for (;;) {
+		if (gdb_put(out, len + 4) < 0)
+			return -1;
+		if (gdb_noack)
+			return 0;
+		do {
+			c = gdb_getc(-1);
+			if (c < 0)
+				return -1;
+		} while (c != '+' && c != '-');
+		if (c == '+')
+			return 0;
+	}
+}
+
+/*
+ * Read a packet into buf, returning its length, 0 for an interrupt
+ * (^C) or -1 when gdb goes away.
+ */
+static int gdb_recv(char *buf)
+{
+	unsigned int len, cs;
+	uint8_t sum;
+	char hex[3];
+	int c;
+
+	for (;;) {
+		do {
+			c = gdb_getc(-1);
+			if (c < 0)
+				return -1;
+			if (c == 0x03)
+				return 0;
+		} while (c != '$');
+
+		len = 0;
+		sum = 0;
+		while ((c = gdb_getc(-1)) != '#') {
+			if (c < 0)
+				return -1;
+			if (len < GDB_PACKET_SIZE)
+				buf[len++] = c;
+			sum += c;
+		}
+		for (int i = 0; i < 2; i++) {
+			c = gdb_getc(-1);
+			if (c < 0)
+				return -1;
+			hex[i] = c;
+		}
+		hex[2] = 0;
+		cs = strtoul(hex, NULL, 16);
+		if (gdb_noack)
+			break;
+		if (cs == sum && len < GDB_PACKET_SIZE) {
+			gdb_put("+", 1);
+			break;
+		}
+		gdb_put("-", 1);
+	}
+	buf[len] = 0;
+	if (debug)
+		printf("gdb -> %s\n", buf);
+	return len;
+}
+
+static void gdb_hex(char *p, uint64_t val, int bytes)
+{
+	/* Little endian, as the target */
+	for (int i = 0; i < bytes; i++, val >>= 8)
+		sprintf(p + i * 2, "%02x", (unsigned int)(val & 0xff));
+}
+
+static int gdb_unhex(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+static bool gdb_wait_stopped(void)
+{
+	uint64_t stat;
+
+	for (int i = 0; i < 1000; i++) {
+		check(dmi_read(DBG_CORE_STAT, &stat), "reading core status");
+		if (stat & DBG_CORE_STAT_STOPPED)
+			return true;
+	}
+	return false;
+}
+
+static void gdb_invalidate(void)
+{
+	memset(gdb_reg_valid, 0, sizeof(gdb_reg_valid));
+	for (int i = 0; i < GDB_LINES; i++)
+		gdb_cache[i].valid = false;
+}
+
+/* Returns the register size in bytes, or 0 if there's no such register */
+static int gdb_reg_read(unsigned int n, uint64_t *val, bool *avail)
+{
+	int size = 8, gspr;
+
+	*avail = true;
+	if (n >= GDB_NR_REGS)
+		return 0;
+	if (n == GDB_REG_CR || n == GDB_REG_XER || n == GDB_REG_FPSCR)
+		size = 4;
+	if (n == GDB_REG_FPSCR) {
+		*avail = false;
+		return size;
+	}
+	if (gdb_reg_valid[n]) {
+		*val = gdb_regs[n];
+		return size;
+	}
+
+	if (n < 32)
+		gspr = n;
+	else if (n < 64)
+		gspr = n + 32;
+	else if (n == GDB_REG_LR)
+		gspr = 32;
+	else if (n == GDB_REG_CTR)
+		gspr = 33;
+	else if (n == GDB_REG_XER)
+		gspr = 44;
+	else if (n == GDB_REG_CR)
+		gspr = 52;
+	else if (n >= GDB_G_REGS)
+		gspr = gdb_extra_gsprs[n - GDB_G_REGS];
+	else
+		gspr = -1;
+
+	if (n == GDB_REG_PC)
+		check(dmi_read(DBG_CORE_NIA, val), "reading core NIA");
+	else if (n == GDB_REG_MSR)
+		check(dmi_read(DBG_CORE_MSR, val), "reading core MSR");
+	else {
+		check(dmi_write(DBG_CORE_GSPR_INDEX, gspr), "setting GPR index");
+		check(dmi_read(DBG_CORE_GSPR_DATA, val), "reading GPR data");
+	}
+	gdb_regs[n] = *val;
+	gdb_reg_valid[n] = true;
+	return size;
+}
+
+static char *gdb_target_xml(void)
+{
+	static char xml[8192];
+	char *p = xml;
+	int i;
+
+	p += sprintf(p, "<?xml version=\"1.0\"?>\n"
+		     "<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+		     "<target><architecture>powerpc:common64</architecture>\n"
+		     "<feature name=\"org.gnu.gdb.power.core\">\n");
+	for (i = 0; i < 32; i++)
+		p += sprintf(p, "<reg name=\"r%d\" bitsize=\"64\" type=\"uint64\"/>\n", i);
+	p += sprintf(p, "<reg name=\"pc\" bitsize=\"64\" type=\"code_ptr\" regnum=\"64\"/>\n"
+		     "<reg name=\"msr\" bitsize=\"64\" type=\"uint64\"/>\n"
+		     "<reg name=\"cr\" bitsize=\"32\" type=\"uint32\"/>\n"
+		     "<reg name=\"lr\" bitsize=\"64\" type=\"code_ptr\"/>\n"
+		     "<reg name=\"ctr\" bitsize=\"64\" type=\"uint64\"/>\n"
+		     "<reg name=\"xer\" bitsize=\"32\" type=\"uint32\"/>\n"
+		     "</feature>\n<feature name=\"org.gnu.gdb.power.fpu\">\n");
+	for (i = 0; i < 32; i++)
+		p += sprintf(p, "<reg name=\"f%d\" bitsize=\"64\" type=\"ieee_double\" regnum=\"%d\"/>\n",
+			     i, 32 + i);
+	p += sprintf(p, "<reg name=\"fpscr\" bitsize=\"32\" group=\"float\" regnum=\"70\"/>\n"
+		     "</feature>\n<feature name=\"org.microwatt.spr\">\n");
+	for (i = 0; i < sizeof(gdb_extra_gsprs); i++) {
+		int gspr = gdb_extra_gsprs[i];
+
+		p += sprintf(p, "<reg name=\"%s\" bitsize=\"64\" type=\"uint64\" group=\"system\"/>\n",
+			     gspr < 60 ? fast_spr_names[gspr - 32] : ldst_spr_names[gspr - 60]);
+	}
+	sprintf(p, "</feature>\n</target>\n");
+	return xml;
+}
+
+static bool gdb_cacheable(uint64_t addr, uint64_t len)
+{
+	return addr + len <= GDB_IO_BASE;
+}
+
+/* Read whole words, through the cache for memory */
+static int gdb_read_words(uint64_t addr, uint64_t *data, uint32_t count)
+{
+	uint64_t line;
+	uint32_t i;
+	int idx;
+
+	if (!gdb_cacheable(addr, count * 8))
+		return wb_read(addr, data, count);
+	for (i = 0; i < count; i++, addr += 8) {
+		line = addr / (GDB_LINE_WORDS * 8);
+		idx = line % GDB_LINES;
+		if (!gdb_cache[idx].valid || gdb_cache[idx].line != line) {
+			if (wb_read(line * GDB_LINE_WORDS * 8, gdb_cache[idx].data,
+				    GDB_LINE_WORDS) < 0)
+				return -1;
+			gdb_cache[idx].line = line;
+			gdb_cache[idx].valid = true;
+		}
+		data[i] = gdb_cache[idx].data[(addr / 8) % GDB_LINE_WORDS];
+	}
+	return 0;
+}
+
+static uint8_t *gdb_mem_read(uint64_t addr, uint32_t len)
+{
+	static uint64_t words[GDB_PACKET_SIZE / 16 + 2];
+	uint64_t start = addr & ~7ull;
+	uint32_t count = (addr + len - start + 7) / 8;
+	uint8_t *bytes = (uint8_t *)words;
+	unsigned int i;
+
+	if (gdb_read_words(start, words, count) < 0)
+		return NULL;
+	/* Bytes in memory order, whatever the host */
+	for (i = 0; i < count * 8; i++)
+		bytes[i] = words[i / 8] >> (8 * (i % 8));
+
+	/* gdb shouldn't see its breakpoints */
+	for (i = 0; i < gdb_nr_breaks; i++) {
+		uint64_t a = gdb_breaks[i].addr;
+
+		for (int j = 0; j < 4; j++)
+			if (a + j >= addr && a + j < addr + len)
+				bytes[a + j - start] = gdb_breaks[i].insn >> (8 * j);
+	}
+	return bytes + (addr - start);
+}
+
+static int gdb_mem_write(uint64_t addr, const uint8_t *buf, uint32_t len)
+{
+	static uint64_t words[GDB_PACKET_SIZE / 2 / 8 + 2];
+	uint64_t start = addr & ~7ull;
+	uint32_t count = (addr + len - start + 7) / 8;
+	uint64_t off;
+	unsigned int i;
+
+	if ((addr & 7) && wb_read(start, &words[0], 1) < 0)
+		return -1;
+	if (((addr + len) & 7) && wb_read(start + (count - 1) * 8,
+					  &words[count - 1], 1) < 0)
+		return -1;
+	for (i = 0; i < len; i++) {
+		off = addr + i - start;
+		words[off / 8] &= ~(0xffull << (8 * (off % 8)));
+		words[off / 8] |= (uint64_t)buf[i] << (8 * (off % 8));
+	}
+	gdb_invalidate();
+	gdb_code_dirty = true;
+	return wb_write(start, words, count);
+}
+
+static int gdb_insn_write(uint64_t addr, uint32_t insn, uint32_t *old)
+{
+	uint64_t word;
+	int shift = (addr & 4) * 8;
+
+	if (wb_read(addr & ~7ull, &word, 1) < 0)
+		return -1;
+	if (old)
+		*old = word >> shift;
+	word &= ~(0xffffffffull << shift);
+	word |= (uint64_t)insn << shift;
+	gdb_invalidate();
+	gdb_code_dirty = true;
+	return wb_write(addr & ~7ull, &word, 1);
+}
+
+static int gdb_find_break(uint64_t addr)
+{
+	for (unsigned int i = 0; i < gdb_nr_breaks; i++)
+		if (gdb_breaks[i].addr == addr)
+			return i;
+	return -1;
+}
+
+static const char *gdb_break_set(uint64_t addr)
+{
+	uint32_t insn;
+
+	if ((addr & 3) || gdb_nr_breaks == GDB_MAX_BREAKS)
+		return "E01";
+	if (gdb_find_break(addr) >= 0)
+		return "OK";
+	if (gdb_insn_write(addr, GDB_BREAK_INSN, &insn) < 0)
+		return "E02";
+	gdb_breaks[gdb_nr_breaks].addr = addr;
+	gdb_breaks[gdb_nr_breaks].insn = insn;
+	gdb_nr_breaks++;
+	return "OK";
+}
+
+static const char *gdb_break_clear(uint64_t addr)
+{
+	int i = gdb_find_break(addr);
+
+	if (i < 0)
+		return "OK";
+	if (gdb_insn_write(addr, gdb_breaks[i].insn, NULL) < 0)
+		return "E02";
+	gdb_breaks[i] = gdb_breaks[--gdb_nr_breaks];
+	return "OK";
+}
+
+static void gdb_break_clear_all(void)
+{
+	while (gdb_nr_breaks)
+		gdb_break_clear(gdb_breaks[0].addr);
+	if (gdb_code_dirty)
+		icache_reset();
+}
+
+/* Run or step the core until it stops, returning the stop reply */
+static const char *gdb_resume(bool step)
+{
+	uint64_t stat, sample, nia;
+	int c;
+
+	if (gdb_code_dirty)
+		icache_reset();
+	gdb_code_dirty = false;
+	gdb_invalidate();
+
+	if (step) {
+		check(dmi_write(DBG_CORE_CTRL, DBG_CORE_CTRL_STEP), "stepping core");
+		gdb_wait_stopped();
+		return "S05";
+	}
+
+	core_start();
+	for (;;) {
+		c = gdb_getc(GDB_POLL_MS);
+		if (c == -1)
+			return NULL;
+		if (c == 0x03) {
+			core_stop();
+			gdb_wait_stopped();
+			return "S02";
+		}
+
+		check(dmi_read(DBG_CORE_STAT, &stat), "reading core status");
+		if (stat & DBG_CORE_STAT_STOPPED)
+			return "S05";
+		if (!gdb_nr_breaks)
+			continue;
+		check(dmi_read(DBG_CORE_SAMPLE, &sample), "reading core sample");
+		if (gdb_find_break(sample & ~3ull) < 0)
+			continue;
+
+		/* Spinning on a breakpoint, unless it was just passing */
+		core_stop();
+		gdb_wait_stopped();
+		check(dmi_read(DBG_CORE_NIA, &nia), "reading core NIA");
+		if (gdb_find_break(nia) >= 0)
+			return "S05";
+		core_start();
+	}
+}
+
+static void gdb_reply_regs(char *out)
+{
+	uint64_t val;
+	bool avail;
+	int size;
+
+	for (unsigned int n = 0; n < GDB_G_REGS; n++) {
+		size = gdb_reg_read(n, &val, &avail);
+		if (avail)
+			gdb_hex(out, val, size);
+		else
+			memset(out, 'x', size * 2);
+		out += size * 2;
+	}
+	*out = 0;
+}
+
+static void gdb_reply_xfer(char *out, const char *doc, const char *args)
+{
+	unsigned long off, len, doclen = strlen(doc);
+
+	if (sscanf(args, "%lx,%lx", &off, &len) != 2) {
+		strcpy(out, "E01");
+		return;
+	}
+	if (len > GDB_PACKET_SIZE - 2)
+		len = GDB_PACKET_SIZE - 2;
+	if (off >= doclen) {
+		strcpy(out, "l");
+		return;
+	}
+	if (len > doclen - off)
+		len = doclen - off;
+	out[0] = off + len < doclen ? 'm' : 'l';
+	memcpy(out + 1, doc + off, len);
+	out[len + 1] = 0;
+}
+
+static void gdb_session(void)
+{
+	static char in[GDB_PACKET_SIZE + 1], out[GDB_PACKET_SIZE + 1];
+	const char *reply, *last_stop = "S05";
+	unsigned long long addr, len;
+	unsigned int n;
+	uint64_t val;
+	uint8_t *bytes;
+	bool avail;
+	int rc, size;
+
+	gdb_noack = false;
+	gdb_inpos = gdb_inlen = 0;
+	gdb_invalidate();
+	core_stop();
+	gdb_wait_stopped();
+
+	while ((rc = gdb_recv(in)) >= 0) {
+		reply = out;
+		out[0] = 0;
+		if (rc == 0)
+			continue;	/* ^C while already stopped */
+
+		switch (in[0]) {
+		case '?':
+			reply = last_stop;
+			break;
+		case 'g':
+			gdb_reply_regs(out);
+			break;
+		case 'p':
+			n = strtoul(in + 1, NULL, 16);
+			size = gdb_reg_read(n, &val, &avail);
+			if (!size)
+				reply = "E01";
+			else if (avail)
+				gdb_hex(out, val, size);
+			else {
+				memset(out, 'x', size * 2);
+				out[size * 2] = 0;
+			}
+			break;
+		case 'G':
+		case 'P':
+			/* core_debug has no way to write registers */
+			reply = "E01";
+			break;
+		case 'm':
+			if (sscanf(in + 1, "%llx,%llx", &addr, &len) != 2 ||
+			    len > GDB_PACKET_SIZE / 2) {
+				reply = "E01";
+				break;
+			}
+			bytes = gdb_mem_read(addr, len);
+			if (!bytes) {
+				reply = "E02";
+				break;
+			}
+			for (n = 0; n < len; n++)
+				sprintf(out + n * 2, "%02x", bytes[n]);
+			break;
+		case 'M': {
+			static uint8_t buf[GDB_PACKET_SIZE / 2];
+			char *p = strchr(in, ':');
+
+			if (!p || sscanf(in + 1, "%llx,%llx", &addr, &len) != 2 ||
+			    strlen(p + 1) < len * 2) {
+				reply = "E01";
+				break;
+			}
+			for (n = 0; n < len; n++)
+				buf[n] = gdb_unhex(p[1 + n * 2]) << 4 |
+					gdb_unhex(p[2 + n * 2]);
+			reply = gdb_mem_write(addr, buf, len) < 0 ? "E02" : "OK";
+			break;
+		}
+		case 'c':
+		case 's':
+			/* Resuming at another address isn't possible */
+			if (in[1]) {
+				check(dmi_read(DBG_CORE_NIA, &val), "reading core NIA");
+				if (strtoull(in + 1, NULL, 16) != val) {
+					reply = "E01";
+					break;
+				}
+			}
+			reply = gdb_resume(in[0] == 's');
+			if (!reply)
+				return;
+			last_stop = reply;
+			break;
+		case 'Z':
+		case 'z':
+			if (in[1] != '0')
+				break;	/* only software breakpoints */
+			if (sscanf(in + 2, ",%llx", &addr) != 1) {
+				reply = "E01";
+				break;
+			}
+			reply = in[0] == 'Z' ? gdb_break_set(addr) : gdb_break_clear(addr);
+			break;
+		case 'H':
+		case 'T':
+			reply = "OK";
+			break;
+		case 'D':
+			gdb_break_clear_all();
+			core_start();
+			gdb_send("OK");
+			return;
+		case 'k':
+			gdb_break_clear_all();
+			return;
+		case 'q':
+			if (strncmp(in, "qSupported", 10) == 0)
+				sprintf(out, "PacketSize=%x;qXfer:features:read+;QStartNoAckMode+",
+					GDB_PACKET_SIZE);
+			else if (strncmp(in, "qXfer:features:read:target.xml:", 31) == 0)
+				gdb_reply_xfer(out, gdb_target_xml(), in + 31);
+			else if (strcmp(in, "qAttached") == 0)
+				reply = "1";
+			else if (strcmp(in, "qC") == 0)
+				reply = "QC1";
+			else if (strcmp(in, "qfThreadInfo") == 0)
+				reply = "m1";
+			else if (strcmp(in, "qsThreadInfo") == 0)
+				reply = "l";
+			break;
+		case 'Q':
+			if (strcmp(in, "QStartNoAckMode") == 0) {
+				if (gdb_send("OK") < 0)
+					return;
+				gdb_noack = true;
+				continue;
+			}
+			break;
+		}
+		if (gdb_send(reply) < 0)
+			break;
+	}
+	gdb_break_clear_all();
+}
+
+static void gdb_server(const char *spec)
+{
+	struct sockaddr_in saddr;
+	const char *p = strrchr(spec, ':');
+	int fd, one = 1;
+
+	memset(&saddr, 0, sizeof(saddr));
+	saddr.sin_family = AF_INET;
+	saddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	saddr.sin_port = htons(strtoul(p ? p + 1 : spec, NULL, 10));
+	if (p && p != spec) {
+		char *host = strndup(spec, p - spec);
+		struct hostent *hp = gethostbyname(host);
+
+		if (!hp) {
+			fprintf(stderr, "Unknown host '%s'\n", host);
+			exit(1);
+		}
+		memcpy(&saddr.sin_addr, hp->h_addr, hp->h_length);
+		free(host);
+	}
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Error opening socket: %s\n", strerror(errno));
+		exit(1);
+	}
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (bind(fd, (struct sockaddr *)&saddr, sizeof(saddr)) < 0 ||
+	    listen(fd, 1) < 0) {
+		fprintf(stderr, "Can't listen on '%s': %s\n", spec, strerror(errno));
+		exit(1);
+	}
+	printf("Waiting for gdb on port %d\n", ntohs(saddr.sin_port));
+	fflush(stdout);
+
+	gdb_fd = accept(fd, NULL, NULL);
+	close(fd);
+	if (gdb_fd < 0) {
+		fprintf(stderr, "accept: %s\n", strerror(errno));
+		exit(1);
+	}
+	setsockopt(gdb_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	printf("gdb connected\n");
+	gdb_session();
+	close(gdb_fd);
+	printf("gdb disconnected\n");
+}
+
 static void usage(const char *cmd)
 {
-	fprintf(stderr, "Usage: %s -b <jtag|ecp5|sim> [-c core#] <command> <args>\n", cmd);
+	fprintf(stderr, "Usage: %s -b <jtag|ecp5|sim> [-t target] [-c core#] [-o file] <command> <args>\n", cmd);
+	fprintf(stderr, "  sim target is host:port (default localhost:13245) or unix:<path>\n");
+	fprintf(stderr, "  -o names the file perf writes\n");
 
 	fprintf(stderr, "\n");
 	fprintf(stderr, " CPU core:\n");
@@ -808,7 +2354,9 @@ static void usage(const char *cmd)
 	fprintf(stderr, " Memory:\n");
 	fprintf(stderr, "  mr <hex addr> [count]\n");
 	fprintf(stderr, "  mw <hex addr> <hex value>\n");
-	fprintf(stderr, "  load <file> [addr]		If omitted address is 0\n");
+	fprintf(stderr, "  load <file> [addr]		If omitted address is 0, ELF files\n");
+	fprintf(stderr, "				load at their physical address + addr\n");
+	fprintf(stderr, "  verify <file> [addr]		compare memory with a file loaded as above\n");
 	fprintf(stderr, "  save <file> <addr> <size>\n");
 
 	fprintf(stderr, "\n");
@@ -821,6 +2369,8 @@ static void usage(const char *cmd)
 	fprintf(stderr, "  lstart			start logging\n");
 	fprintf(stderr, "  lstop			stop logging\n");
 	fprintf(stderr, "  ldump <file>			dump log to file\n");
+	fprintf(stderr, "  lstream <file> [windows]	dump the log at each trigger, or\n");
+	fprintf(stderr, "				continuously, until ^C\n");
 	fprintf(stderr, "  ltrig 			show logging stop trigger status\n");
 	fprintf(stderr, "  ltrig off 			clear logging stop trigger address\n");
 	fprintf(stderr, "  ltrig <addr>			set logging stop trigger address\n");
@@ -828,12 +2378,28 @@ static void usage(const char *cmd)
 	fprintf(stderr, "  mtrig off 			clear logging stop trigger address\n");
 	fprintf(stderr, "  mtrig <addr>			set logging stop trigger address\n");
 
+	fprintf(stderr, "\n");
+	fprintf(stderr, " Profiling:\n");
+	fprintf(stderr, "  perf <seconds>		sample NIA into a histogram for\n");
+	fprintf(stderr, "				scripts/profile.py (-o, default perf_profile.txt)\n");
+
+	fprintf(stderr, "\n");
+	fprintf(stderr, " Debugger:\n");
+	fprintf(stderr, "  gdbserver [host:]<port>	serve the GDB remote protocol\n");
+
 	fprintf(stderr, "\n");
 	fprintf(stderr, " JTAG:\n");
 	fprintf(stderr, "  dmiread <hex addr>\n");
 	fprintf(stderr, "  dmiwrite <hex addr> <hex value>\n");
 	fprintf(stderr, "  quit\n");
 
+	fprintf(stderr, "\n");
+	fprintf(stderr, " Simulated RAM (core_tb):\n");
+	fprintf(stderr, "  ramdump			write RAM image\n");
+	fprintf(stderr, "  snapshot			snapshot RAM\n");
+	fprintf(stderr, "  restore			restore RAM from snapshot\n");
+	fprintf(stderr, "  ramwrites			write per page write counts\n");
+
 	exit(1);
 }
 
@@ -841,6 +2407,7 @@ int main(int argc, char *argv[])
 {
 	const char *progname = argv[0];
 	const char *target = NULL;
+	const char *output = "perf_profile.txt";
 	int rc, i = 1, freq = 0;
 
 	b = NULL;
@@ -854,9 +2421,10 @@ int main(int argc, char *argv[])
 			{ "debug",	no_argument,       0, 'd' },
 			{ "frequency",	no_argument,       0, 's' },
 			{ "core",	required_argument, 0, 'c' },
+			{ "output",	required_argument, 0, 'o' },
 			{ 0, 0, 0, 0 }
 		};
-		c = getopt_long(argc, argv, "dhb:t:s:c:", lopts, &oindex);
+		c = getopt_long(argc, argv, "dhb:t:s:c:o:", lopts, &oindex);
 		if (c < 0)
 			break;
 		switch(c) {
@@ -885,6 +2453,9 @@ int main(int argc, char *argv[])
 		case 't':
 			target = optarg;
 			break;
+		case 'o':
+			output = optarg;
+			break;
 		case 's':
 			freq = atoi(optarg);
 			if (freq == 0) {
@@ -934,6 +2505,14 @@ int main(int argc, char *argv[])
 			core_step();
 		} else if (strcmp(argv[i], "quit") == 0) {
 			dmi_write(0xff, 0);
+		} else if (strcmp(argv[i], "ramdump") == 0) {
+			dmi_write(DBG_SIM_RAM, DBG_SIM_RAM_DUMP);
+		} else if (strcmp(argv[i], "snapshot") == 0) {
+			dmi_write(DBG_SIM_RAM, DBG_SIM_RAM_SNAPSHOT);
+		} else if (strcmp(argv[i], "restore") == 0) {
+			dmi_write(DBG_SIM_RAM, DBG_SIM_RAM_RESTORE);
+		} else if (strcmp(argv[i], "ramwrites") == 0) {
+			dmi_write(DBG_SIM_RAM, DBG_SIM_RAM_WRITES);
 		} else if (strcmp(argv[i], "status") == 0) {
 			/* do nothing, always done below */
 		} else if (strcmp(argv[i], "mr") == 0) {
@@ -962,7 +2541,17 @@ int main(int argc, char *argv[])
 			filename = argv[++i];
 			if (((i+1) < argc) && isxdigit(argv[i+1][0]))
 				addr = strtoul(argv[++i], NULL, 16);
-			load(filename, addr);
+			load(filename, addr, false);
+		} else if (strcmp(argv[i], "verify") == 0) {
+			const char *filename;
+			uint64_t addr = 0;
+
+			if ((i+1) >= argc)
+				usage(argv[0]);
+			filename = argv[++i];
+			if (((i+1) < argc) && isxdigit(argv[i+1][0]))
+				addr = strtoul(argv[++i], NULL, 16);
+			load(filename, addr, true);
 		} else if (strcmp(argv[i], "save") == 0) {
 			const char *filename;
 			uint64_t addr, size;
@@ -982,6 +2571,17 @@ int main(int argc, char *argv[])
 			if (((i+1) < argc) && isdigit(argv[i+1][0]))
 				count = strtoul(argv[++i], NULL, 10);
 			gpr_read(reg, count);
+		} else if (strcmp(argv[i], "perf") == 0) {
+			double seconds;
+
+			if ((i+1) >= argc)
+				usage(argv[0]);
+			seconds = strtod(argv[++i], NULL);
+			perf_record(seconds, output);
+		} else if (strcmp(argv[i], "gdbserver") == 0) {
+			if ((i+1) >= argc)
+				usage(argv[0]);
+			gdb_server(argv[++i]);
 		} else if (strcmp(argv[i], "lstart") == 0) {
 			log_start();
 		} else if (strcmp(argv[i], "lstop") == 0) {
@@ -993,6 +2593,16 @@ int main(int argc, char *argv[])
 				usage(argv[0]);
 			filename = argv[++i];
 			log_dump(filename);
+		} else if (strcmp(argv[i], "lstream") == 0) {
+			const char *filename;
+			uint64_t windows = 0;
+
+			if ((i+1) >= argc)
+				usage(argv[0]);
+			filename = argv[++i];
+			if (((i+1) < argc) && isdigit(argv[i+1][0]))
+				windows = strtoul(argv[++i], NULL, 10);
+			log_stream(filename, windows);
 		} else if (strcmp(argv[i], "ltrig") == 0) {
 			uint64_t addr;
 
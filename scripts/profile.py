@@ -0,0 +1,172 @@
+#!/usr/bin/python3
+
+# Symbolize a PC sampling profile written by core_tb (SIM_PROFILE=<n>),
+# microwatt-verilator (--profile <n>) or mw_debug perf on hardware
+# against an ELF file, eg:
+#
+#   profile.py sim_profile.txt micropython/firmware.elf
+#
+# prints a flat profile of samples per function, the hottest call sites
+# (caller -> callee), then the hottest instruction addresses as
+# function+offset. --folded also writes the samples in the folded stack
+# format of flamegraph.pl and speedscope: kernel or user, the caller if
+# known, then the function. Only the symbol table of a little endian
+# ELF64 file is needed, no toolchain.
+#
+# The caller comes from LR, sampled with the address. LR only holds the
+# return address into the caller until the function makes a call of its
+# own, after which it points back into the function itself; those
+# samples, and ones from mw_debug perf (which has no LR), have no caller.
+
+import argparse
+import bisect
+import struct
+import sys
+
+SHT_SYMTAB = 2
+STT_FUNC = 2
+
+def read_symbols(filename):
+    """Return a sorted list of (address, size, name) for the functions"""
+    with open(filename, 'rb') as f:
+        elf = f.read()
+
+    if elf[:4] != b'\x7fELF' or elf[4] != 2 or elf[5] != 1:
+        sys.exit('%s: only little endian ELF64 is supported' % filename)
+
+    shoff, = struct.unpack_from('<Q', elf, 0x28)
+    shentsize, shnum = struct.unpack_from('<HH', elf, 0x3a)
+
+    sections = []
+    for i in range(shnum):
+        sections.append(struct.unpack_from('<IIQQQQIIQQ', elf,
+                                           shoff + i * shentsize))
+
+    syms = []
+    for (name, stype, flags, addr, off, size, link, info, align,
+         entsize) in sections:
+        if stype != SHT_SYMTAB:
+            continue
+        stroff = sections[link][4]
+        for s in range(off, off + size, entsize):
+            st_name, st_info, st_other, st_shndx, st_value, st_size = \
+                struct.unpack_from('<IBBHQQ', elf, s)
+            if st_info & 0xf != STT_FUNC or not st_value:
+                continue
+            end = elf.index(b'\0', stroff + st_name)
+            syms.append((st_value, st_size,
+                         elf[stroff + st_name:end].decode(errors='replace')))
+
+    if not syms:
+        sys.exit('%s: no function symbols' % filename)
+
+    syms.sort()
+    return syms
+
+class Symbolizer:
+    def __init__(self, syms):
+        self.syms = syms
+        self.addrs = [s[0] for s in syms]
+
+    def lookup(self, nia):
+        """Return (function, offset) for an address"""
+        i = bisect.bisect_right(self.addrs, nia) - 1
+        if i < 0:
+            return ('[unknown]', nia)
+        addr, size, name = self.syms[i]
+        if size and nia >= addr + size:
+            return ('[unknown]', nia)
+        return (name, nia - addr)
+
+def read_profile(filename, cpu, mode):
+    samples = []
+    with open(filename) as f:
+        for line in f:
+            if line.startswith('#') or not line.strip():
+                continue
+            fields = line.split()
+            # Profiles from before LR was sampled have no lr column
+            if len(fields) == 4:
+                fields.insert(3, '0')
+            c, pr, nia, lr, count = fields
+            c, pr, count = int(c), int(pr), int(count)
+            nia, lr = int(nia, 16), int(lr, 16)
+            if cpu is not None and c != cpu:
+                continue
+            if (mode == 'user' and not pr) or (mode == 'kernel' and pr):
+                continue
+            samples.append((nia, lr, pr, count))
+    return samples
+
+def main():
+    parser = argparse.ArgumentParser(description='Symbolize a microwatt profile')
+    parser.add_argument('profile',
+                        help='histogram from core_tb, microwatt-verilator or mw_debug perf')
+    parser.add_argument('elf', help='ELF file the profiled code came from')
+    parser.add_argument('-c', '--cpu', type=int,
+                        help='only samples from this CPU')
+    parser.add_argument('-m', '--mode', choices=['user', 'kernel'],
+                        help='only samples with MSR[PR] set (user) or clear')
+    parser.add_argument('-n', '--top', type=int, default=40,
+                        help='lines to print in each table')
+    parser.add_argument('-f', '--folded', metavar='FILE',
+                        help='also write folded stacks to FILE')
+    args = parser.parse_args()
+
+    sym = Symbolizer(read_symbols(args.elf))
+    samples = read_profile(args.profile, args.cpu, args.mode)
+    total = sum(s[3] for s in samples)
+    if not total:
+        sys.exit('No samples')
+
+    funcs = {}
+    calls = {}
+    sites = {}
+    folded = {}
+    for nia, lr, pr, count in samples:
+        name, off = sym.lookup(nia)
+        funcs[name] = funcs.get(name, 0) + count
+        sites[nia] = sites.get(nia, 0) + count
+        stack = '%s;%s' % ('user' if pr else 'kernel', name)
+        # The call is the instruction before the return address
+        if lr >= 4:
+            caller, coff = sym.lookup(lr - 4)
+            if caller != name and caller != '[unknown]':
+                key = (lr - 4, name)
+                calls[key] = calls.get(key, 0) + count
+                stack = '%s;%s;%s' % ('user' if pr else 'kernel',
+                                      caller, name)
+        folded[stack] = folded.get(stack, 0) + count
+
+    if args.folded:
+        with open(args.folded, 'w') as f:
+            for stack, count in sorted(folded.items()):
+                f.write('%s %d\n' % (stack, count))
+
+    print('%d samples' % total)
+    print()
+    print('%7s %7s %10s  %s' % ('%', 'cum %', 'samples', 'function'))
+    cum = 0
+    for name, count in sorted(funcs.items(), key=lambda x: -x[1])[:args.top]:
+        cum += count
+        print('%6.2f%% %6.2f%% %10d  %s' %
+              (100.0 * count / total, 100.0 * cum / total, count, name))
+
+    if calls:
+        print()
+        print('%7s %10s  %s' % ('%', 'samples', 'call site -> function'))
+        for (site, name), count in sorted(calls.items(),
+                                          key=lambda x: -x[1])[:args.top]:
+            caller, coff = sym.lookup(site)
+            print('%6.2f%% %10d  %s+0x%x -> %s' %
+                  (100.0 * count / total, count, caller, coff, name))
+
+    print()
+    print('%7s %10s %18s  %s' % ('%', 'samples', 'address', 'site'))
+    for nia, count in sorted(sites.items(), key=lambda x: -x[1])[:args.top]:
+        name, off = sym.lookup(nia)
+        print('%6.2f%% %10d 0x%016x  %s+0x%x' %
+              (100.0 * count / total, count, nia, name, off))
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,277 @@
+#!/usr/bin/python3
+
+# Run the core_tb test suite (the numbered tests, the console tests and
+# the MicroPython tests) in parallel, one core_tb per host CPU. Each test
+# gets a simulated cycle budget (passed to GHDL as --stop-time) and a
+# wall clock timeout, and a table of results, cycles and wall time is
+# printed at the end. Test names or globs on the command line select a
+# subset, eg: run_regression.py 1 2 'test_*'
+#
+# Run by "make check_parallel".
+
+import argparse
+import concurrent.futures
+import fnmatch
+import json
+import os
+import re
+import shutil
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+CLK_PERIOD_NS = 10
+
+MICROWATT_DIR = os.getcwd()
+CORE_TB = os.path.join(MICROWATT_DIR, 'core_tb')
+MICROPYTHON = os.path.join('micropython', 'firmware.bin')
+
+# (name, lines typed at the prompt, strings expected in order)
+micropython_tests = [
+    ('test_micropython',
+     [ 'print("foo")' ],
+     [ 'foo', 'foo', '>>>' ]),
+    ('test_micropython_long',
+     [ 'n2=0', 'n1=1', 'for i in range(5):', '    n0 = n1 + n2',
+       '    print(n0)', '    n2 = n1', '    n1 = n0', '' ],
+     [ 'n1 = n0', '1', '2', '3', '5', '8', '>>>' ]),
+]
+
+reg_line = re.compile(r'^(GPR[0-9]|LR |CTR |XER |CR [0-9])')
+
+# Written to stderr by sim_stats_c.c, possibly in the middle of a line of
+# console output
+stats_report = re.compile(r'stats( total)?: (\d+) cycles[^\n]*\n')
+
+def strip_stats(s):
+    return stats_report.sub('', s)
+
+class Result:
+    def __init__(self, name):
+        self.name = name
+        self.passed = False
+        self.reason = ''
+        self.cycles = None
+        self.wall = 0.0
+
+def read_expected(path):
+    with open(path) as f:
+        return sorted(l.rstrip('\n') for l in f
+                      if l.strip() and not l.startswith('GPR31'))
+
+class Sim:
+    """core_tb running image in a scratch directory"""
+
+    def __init__(self, image, cycles, timeout):
+        self.dir = tempfile.TemporaryDirectory()
+        shutil.copyfile(image, os.path.join(self.dir.name, 'main_ram.bin'))
+        self.json = os.path.join(self.dir.name, 'stats.json')
+        self.cycles = cycles
+
+        env = dict(os.environ)
+        env['SIM_STATS'] = '1000000'
+        env['SIM_STATS_JSON'] = self.json
+        cmd = [ CORE_TB, '--stop-time=%dns' % (cycles * CLK_PERIOD_NS) ]
+
+        self.stderr = open(os.path.join(self.dir.name, 'stderr'), 'w+b')
+        self.p = subprocess.Popen(cmd, cwd=self.dir.name, env=env,
+                                  stdin=subprocess.PIPE,
+                                  stdout=subprocess.PIPE, stderr=self.stderr)
+        self.timed_out = False
+        self.timer = threading.Timer(timeout, self.kill, [ True ])
+        self.timer.start()
+
+    def kill(self, timed_out=False):
+        self.timed_out = self.timed_out or timed_out
+        try:
+            self.p.kill()
+        except ProcessLookupError:
+            pass
+
+    def stdout_lines(self):
+        for line in self.p.stdout:
+            yield line.decode(errors='replace').rstrip('\n')
+
+    def finish(self, r):
+        self.p.wait()
+        self.timer.cancel()
+
+        self.stderr.seek(0)
+        err = self.stderr.read().decode(errors='replace')
+        self.stderr.close()
+
+        # Exact at exit, otherwise the sum of the periodic reports
+        try:
+            with open(self.json) as f:
+                r.cycles = json.load(f)['cycles']
+        except (OSError, ValueError):
+            r.cycles = sum(int(m.group(2)) for m in
+                           stats_report.finditer(err) if not m.group(1))
+
+        self.dir.cleanup()
+        return strip_stats(err)
+
+    def failed_why(self, r):
+        if self.timed_out:
+            return 'wall clock timeout'
+        if r.cycles is not None and r.cycles >= self.cycles:
+            return 'cycle budget exceeded'
+        return None
+
+def run_numbered(name, args):
+    r = Result(name)
+    sim = Sim(os.path.join('tests', name + '.bin'), args.cycles, args.timeout)
+
+    regs = []
+    for line in sim.stdout_lines():
+        line = line.split(': ')[-1]
+        if reg_line.match(line) and not line.startswith('GPR31'):
+            regs.append(line)
+    sim.finish(r)
+
+    if sorted(regs) == read_expected(os.path.join('tests', name + '.out')):
+        r.passed = True
+    else:
+        r.reason = sim.failed_why(r) or 'registers differ'
+    return r
+
+def run_console(name, args):
+    r = Result(name)
+    sim = Sim(os.path.join('tests', name + '.bin'), args.console_cycles,
+              args.timeout)
+
+    metavalues = sum(1 for l in sim.stdout_lines() if 'metavalue' in l)
+    err = sim.finish(r)
+    err = ''.join(l for l in err.splitlines(keepends=True)
+                  if 'Failed to bind debug socket' not in l)
+
+    with open(os.path.join('tests', name + '.metavalue')) as f:
+        exp_metavalues = int(f.read())
+    with open(os.path.join('tests', name + '.console_out'), newline='') as f:
+        exp = f.read()
+
+    if metavalues > exp_metavalues:
+        r.reason = 'metavalues increased from %d to %d' % (exp_metavalues,
+                                                           metavalues)
+    elif err != exp:
+        r.reason = sim.failed_why(r) or 'console output changed'
+    else:
+        r.passed = True
+    return r
+
+def run_micropython(test, args):
+    name, lines, expect = test
+    r = Result(name)
+    sim = Sim(MICROPYTHON, args.micropython_cycles, args.timeout)
+
+    # The console is on stderr, which Sim collects in a file
+    def console():
+        with open(sim.stderr.name, 'rb') as f:
+            return strip_stats(f.read().decode(errors='replace'))
+
+    def wait_for(s, start):
+        while sim.p.poll() is None:
+            pos = console().find(s, start)
+            if pos >= 0:
+                return pos + len(s)
+            time.sleep(0.5)
+        pos = console().find(s, start)
+        return pos + len(s) if pos >= 0 else -1
+
+    # Drain the register trace so core_tb doesn't block on it
+    drain = threading.Thread(target=lambda: sum(1 for _ in sim.stdout_lines()))
+    drain.start()
+
+    pos = wait_for('>>>', 0)
+    if pos >= 0:
+        for l in lines:
+            sim.p.stdin.write(l.encode() + b'\r\n')
+        sim.p.stdin.flush()
+        for s in expect:
+            pos = wait_for(s, pos)
+            if pos < 0:
+                break
+
+    r.passed = pos >= 0
+    sim.kill()
+    drain.join()
+    sim.finish(r)
+    if not r.passed:
+        r.reason = sim.failed_why(r) or 'console output changed'
+    return r
+
+def timed(fn, t, args):
+    start = time.monotonic()
+    r = fn(t, args)
+    r.wall = time.monotonic() - start
+    return r
+
+def selected(name, patterns):
+    return not patterns or any(fnmatch.fnmatch(name, p) for p in patterns)
+
+def main():
+    parser = argparse.ArgumentParser(description='Run core_tb tests in parallel')
+    parser.add_argument('-j', '--jobs', type=int, default=os.cpu_count(),
+                        help='tests to run at once (default: one per CPU)')
+    parser.add_argument('--cycles', type=int, default=2000000,
+                        help='cycle budget for the numbered tests')
+    parser.add_argument('--console-cycles', type=int, default=20000000,
+                        help='cycle budget for the console tests')
+    parser.add_argument('--micropython-cycles', type=int, default=200000000,
+                        help='cycle budget for the MicroPython tests')
+    parser.add_argument('--timeout', type=float, default=1800,
+                        help='wall clock limit for each test in seconds')
+    parser.add_argument('tests', nargs='*', help='test names or globs')
+    args = parser.parse_args()
+
+    if not os.path.exists(CORE_TB):
+        sys.exit('core_tb not found, run make core_tb')
+
+    jobs = []
+    for f in sorted(os.listdir('tests'), key=lambda n: (len(n), n)):
+        name, ext = os.path.splitext(f)
+        if ext == '.out' and selected(name, args.tests):
+            jobs.append((run_numbered, name))
+    for f in sorted(os.listdir('tests')):
+        name, ext = os.path.splitext(f)
+        if ext == '.console_out' and selected(name, args.tests):
+            jobs.append((run_console, name))
+    for t in micropython_tests:
+        if not selected(t[0], args.tests):
+            continue
+        if not os.path.exists(MICROPYTHON):
+            print('%s not found, skipping %s' % (MICROPYTHON, t[0]))
+            continue
+        jobs.append((run_micropython, t))
+
+    start = time.monotonic()
+    results = [ None ] * len(jobs)
+    with concurrent.futures.ThreadPoolExecutor(max_workers=args.jobs) as ex:
+        # Longest first, so a MicroPython boot doesn't end up last
+        futures = { ex.submit(timed, fn, t, args): i
+                    for i, (fn, t) in reversed(list(enumerate(jobs))) }
+        for f in concurrent.futures.as_completed(futures):
+            r = f.result()
+            results[futures[f]] = r
+            print('%s %s' % (r.name, 'PASS' if r.passed else
+                             'FAIL ******** ' + r.reason), flush=True)
+
+    print()
+    print('%-28s %-6s %12s %10s  %s' %
+          ('test', 'result', 'cycles', 'wall (s)', ''))
+    for r in results:
+        print('%-28s %-6s %12s %10.2f  %s' %
+              (r.name, 'PASS' if r.passed else 'FAIL',
+               '-' if r.cycles is None else r.cycles, r.wall, r.reason))
+
+    failed = sum(1 for r in results if not r.passed)
+    print()
+    print('%d tests, %d passed, %d failed in %.1fs with %d jobs' %
+          (len(results), len(results) - failed, failed,
+           time.monotonic() - start, args.jobs))
+    sys.exit(1 if failed else 0)
+
+if __name__ == '__main__':
+    main()
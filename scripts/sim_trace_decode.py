@@ -0,0 +1,145 @@
+#!/usr/bin/python3
+
+# Decode a binary trace written by core_tb (SIM_TRACE=<categories>) back
+# into the text the register file, CR file, execute1 and RAM used to
+# report, one line per event prefixed by the cycle, eg:
+#
+#   sim_trace_decode.py sim_trace.bin
+#
+# The record format is described in sim_trace_c.c. Instruction types are
+# named from decode_types.vhdl.
+
+import argparse
+import os
+import re
+import sys
+
+MAGIC = b'MWTRACE1'
+
+GPR_WRITE, GPR_READ, CR_WRITE, XERC_WRITE, CR_READ, SPR_WRITE, EXECUTE, \
+    RAM_WRITE, RAM_READ = range(1, 10)
+
+categories = {
+    'gpr': (GPR_WRITE, GPR_READ),
+    'cr': (CR_WRITE, XERC_WRITE, CR_READ),
+    'spr': (SPR_WRITE,),
+    'exec': (EXECUTE,),
+    'ram': (RAM_WRITE, RAM_READ),
+}
+
+def read_insn_types(filename):
+    try:
+        with open(filename) as f:
+            s = f.read()
+    except OSError:
+        return []
+    m = re.search(r'type\s+insn_type_t\s+is\s*\((.*?)\);', s, re.S)
+    if not m:
+        return []
+    return [t.strip() for t in m.group(1).split(',')]
+
+def records(data):
+    pos = len(MAGIC)
+    end = len(data)
+    cycle = 0
+
+    def varint():
+        nonlocal pos
+        v = 0
+        shift = 0
+        while True:
+            b = data[pos]
+            pos += 1
+            v |= (b & 0x7f) << shift
+            if b < 0x80:
+                return v
+            shift += 7
+
+    while pos < end:
+        try:
+            event = data[pos]
+            cpu = data[pos + 1]
+            pos += 2
+            cycle += varint()
+            arg = varint()
+            d = varint()
+        except IndexError:
+            print('Truncated record at end of trace', file=sys.stderr)
+            return
+        yield cycle, event, cpu, arg, d
+
+def sl(b):
+    return "'1'" if b & 1 else "'0'"
+
+def format_event(event, cpu, arg, d, insn_types):
+    if event == GPR_WRITE:
+        kind = 'FPR' if arg & 0x20 else 'GPR'
+        return 'Writing %s %02X %016X' % (kind, arg & 0x1f, d)
+    if event == GPR_READ:
+        return 'Reading GPR %02X %016X' % (arg, d)
+    if event == CR_WRITE:
+        return 'Writing %08X to CR mask %02X' % (d, arg)
+    if event == XERC_WRITE:
+        return 'Writing XERC SO=%s OV=%s CA=%s OV32=%s CA32=%s' % \
+            (sl(d), sl(d >> 1), sl(d >> 2), sl(d >> 3), sl(d >> 4))
+    if event == CR_READ:
+        return 'Reading CR %08X' % d
+    if event == SPR_WRITE:
+        return 'writing %s spr %d data=%016X' % \
+            ('odd' if arg & 0x100 else 'even', arg & 7, d)
+    if event == EXECUTE:
+        op = arg & 0xff
+        op = insn_types[op] if op < len(insn_types) else 'op%d' % op
+        return 'CPU %d execute %016X op=%s wr=%02X we=%s tag=%d%s 2nd=%s' % \
+            (cpu, d, op, (arg >> 8) & 0x3f, sl(arg >> 14), (arg >> 16) & 0xff,
+             sl(arg >> 24), sl(arg >> 15))
+    if event == RAM_WRITE:
+        return 'RAM writing %016X to %014X sel:%02X' % \
+            (d, arg & ((1 << 56) - 1), arg >> 56)
+    if event == RAM_READ:
+        return 'RAM reading from %014X returns %016X' % \
+            (arg & ((1 << 56) - 1), d)
+    return 'unknown event %d arg=%X data=%X' % (event, arg, d)
+
+def main():
+    default_types = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                 '..', 'decode_types.vhdl')
+    parser = argparse.ArgumentParser(description='Decode a core_tb binary trace')
+    parser.add_argument('trace', help='trace written by core_tb')
+    parser.add_argument('-c', '--cpu', type=int,
+                        help='only events from this CPU')
+    parser.add_argument('-e', '--events', default='all',
+                        help='comma separated categories to print: ' +
+                        ', '.join(categories) + ' or all')
+    parser.add_argument('--decode-types', default=default_types,
+                        help='decode_types.vhdl to name instruction types from')
+    args = parser.parse_args()
+
+    wanted = set()
+    for c in args.events.split(','):
+        if c == 'all':
+            wanted.update(e for v in categories.values() for e in v)
+        elif c in categories:
+            wanted.update(categories[c])
+        else:
+            sys.exit('Unknown category %s' % c)
+
+    with open(args.trace, 'rb') as f:
+        data = f.read()
+    if data[:len(MAGIC)] != MAGIC:
+        sys.exit('%s: not a microwatt trace' % args.trace)
+
+    insn_types = read_insn_types(args.decode_types)
+
+    out = sys.stdout
+    try:
+        for cycle, event, cpu, arg, d in records(data):
+            if event not in wanted or (args.cpu is not None and cpu != args.cpu):
+                continue
+            out.write('%12d: %s\n' % (cycle, format_event(event, cpu, arg, d,
+                                                          insn_types)))
+    except BrokenPipeError:
+        sys.stderr.close()
+
+if __name__ == '__main__':
+    main()
@@ -5,7 +5,12 @@ use ieee.numeric_std.all;
 library work;
 use work.sim_console.all;
 
-entity uart_top is
+-- Simulation model of the 16550 UART, instantiated by soc.vhdl in
+-- place of uart_top with the console channel it talks to.
+entity sim_16550_uart is
+    generic (
+        CHANNEL : natural := 0
+        );
     port(
         wb_clk_i    : in std_ulogic;
         wb_rst_i    : in std_ulogic;
@@ -26,9 +31,9 @@ entity uart_top is
         ri_pad_i    : in std_ulogic;
         dcd_pad_i   : in std_ulogic
 	);
-end entity uart_top;
+end entity sim_16550_uart;
 
-architecture behaviour of uart_top is
+architecture behaviour of sim_16550_uart is
 
     -- Call POLL every N clocks to generate interrupts
     constant POLL_DELAY       : natural   := 100;
@@ -233,7 +238,7 @@ begin
                         -- FIFO write
                         -- XXX Simulate the FIFO and delays for more
                         -- accurate behaviour & interrupts
-                        sim_console_write(x"00000000000000" & wb_dat_i);
+                        sim_console_write(CHANNEL, x"00000000000000" & wb_dat_i);
                     end if;
                     if reg_read = '1' then
                         dp := '0';
@@ -243,11 +248,11 @@ begin
 
                 -- Poll for incoming data
                 if poll_cnt = 0 or (reg_read = '1' and reg_idx = REG_IDX_LSR) then
-                    sim_console_poll(sim_tmp);
+                    sim_console_poll(CHANNEL, sim_tmp);
                     poll_cnt := POLL_DELAY;
                     if dp = '0' and sim_tmp(0) = '1' then
                         dp := '1';
-                        sim_console_read(sim_tmp);
+                        sim_console_read(CHANNEL, sim_tmp);
                         data_out <= sim_tmp(7 downto 0);
                     end if;
                     poll_cnt := poll_cnt - 1;
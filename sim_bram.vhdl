@@ -9,7 +9,9 @@ use std.textio.all;
 
 library work;
 use work.utils.all;
+use work.common.all;
 use work.sim_bram_helpers.all;
+use work.sim_trace_helpers.all;
 
 entity main_bram is
     generic(
@@ -32,8 +34,6 @@ end entity main_bram;
 architecture sim of main_bram is
 
     constant WIDTH_BYTES : natural := WIDTH / 8;
-    constant pad_zeros   : std_ulogic_vector(log2(WIDTH_BYTES)-1 downto 0)
-        := (others => '0');
 
     signal identifier : integer := behavioural_initialize(filename => RAM_INIT_FILE,
                                                           size => MEMORY_SIZE);
@@ -45,19 +45,40 @@ begin
     memory_0: process(clk)
         variable ret_dat_v : std_ulogic_vector(63 downto 0);
         variable addr64    : std_ulogic_vector(63 downto 0);
+        variable trace_arg : std_ulogic_vector(63 downto 0);
+        variable trace_write : integer := -1;
+        variable trace_read : integer := -1;
+        variable last_edge : time := 0 fs;
+        variable period    : time := 0 fs;
     begin
         if rising_edge(clk) then
+            -- Timed the same way as sim_trace_event
+            if trace_write < 0 then
+                trace_write := sim_trace_enabled(TRACE_RAM_WRITE);
+                trace_read := sim_trace_enabled(TRACE_RAM_READ);
+            end if;
+            if last_edge > 0 fs then
+                period := now - last_edge;
+            end if;
+            last_edge := now;
+
             addr64 := (others => '0');
             addr64(HEIGHT_BITS + 2 downto 3) := addr;
-            if we = '1' then        
-                report "RAM writing " & to_hstring(din) & " to " &
-                    to_hstring(addr & pad_zeros) & " sel:" & to_hstring(sel);
+            -- Byte address, with the byte selects in the top byte
+            trace_arg := addr64;
+            trace_arg(63 downto 56) := (others => '0');
+            trace_arg(WIDTH_BYTES + 55 downto 56) := sel;
+            if we = '1' then
+                if trace_write > 0 and period > 0 fs then
+                    sim_trace_write(TRACE_RAM_WRITE, 0, now, period, trace_arg, din);
+                end if;
                 behavioural_write(din, addr64, to_integer(unsigned(sel)), identifier);
             end if;
             if re = '1' then
                 behavioural_read(ret_dat_v, addr64, to_integer(unsigned(sel)), identifier);
-                report "RAM reading from " & to_hstring(addr & pad_zeros) &
-                    " returns " & to_hstring(ret_dat_v);
+                if trace_read > 0 and period > 0 fs then
+                    sim_trace_write(TRACE_RAM_READ, 0, now, period, trace_arg, ret_dat_v);
+                end if;
                 obuf <= ret_dat_v(obuf'left downto 0);
             end if;
             dout <= obuf;
@@ -65,3 +86,39 @@ begin
     end process;
 
 end architecture sim;
+
+library ieee;
+use ieee.std_logic_1164.all;
+use ieee.numeric_std.all;
+
+library work;
+use work.sim_bram_helpers.all;
+
+-- Lets a debugger dump, snapshot and restore the behavioural RAM and
+-- write out its page write counts, by writing one of the SIM_RAM_*
+-- commands in sim_bram_helpers_c.c to DMI address 0xfe. Only used when
+-- SIM is set.
+entity sim_ram_control is
+    port (
+        clk      : in std_ulogic;
+        dmi_addr : in std_ulogic_vector(7 downto 0);
+        dmi_din  : in std_ulogic_vector(63 downto 0);
+        dmi_req  : in std_ulogic;
+        dmi_wr   : in std_ulogic
+        );
+end entity sim_ram_control;
+
+architecture sim of sim_ram_control is
+begin
+    control: process(clk)
+        variable prev_req : std_ulogic := '0';
+    begin
+        if rising_edge(clk) then
+            if dmi_req = '1' and prev_req = '0' and dmi_wr = '1' and
+                dmi_addr = x"fe" then
+                behavioural_command(to_integer(unsigned(dmi_din(7 downto 0))));
+            end if;
+            prev_req := dmi_req;
+        end if;
+    end process;
+end architecture sim;
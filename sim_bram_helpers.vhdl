@@ -10,6 +10,9 @@ package sim_bram_helpers is
 
     procedure behavioural_write (val: std_ulogic_vector(63 downto 0); addr: std_ulogic_vector(63 downto 0); length: integer; identifier: integer);
     attribute foreign of behavioural_write : procedure is "VHPIDIRECT behavioural_write";
+
+    procedure behavioural_command (cmd: integer);
+    attribute foreign of behavioural_command : procedure is "VHPIDIRECT behavioural_command";
 end sim_bram_helpers;
 
 package body sim_bram_helpers is
@@ -27,4 +30,9 @@ package body sim_bram_helpers is
     begin
         assert false report "VHPI" severity failure;
     end behavioural_write;
+
+    procedure behavioural_command (cmd: integer) is
+    begin
+        assert false report "VHPI" severity failure;
+    end behavioural_command;
 end sim_bram_helpers;
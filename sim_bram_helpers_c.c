@@ -5,7 +5,6 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -15,148 +14,295 @@
 
 #define ALIGN_UP(VAL, SIZE)	(((VAL) + ((SIZE)-1)) & ~((SIZE)-1))
 
-#define MAX_REGIONS 128
+/*
+ * Behavioural RAM for sim_bram.vhdl. The memory is sparse: a table with
+ * a pointer per RAM_PAGE_SIZE page, each page allocated and filled in from
+ * the backing files the first time it is touched, so a region can be
+ * gigabytes without costing host memory up front. The filename is a
+ * comma separated list of files, each optionally followed by @offset to
+ * load it somewhere other than 0, eg "main_ram.bin,vmlinux.bin@0x500000".
+ * Writes never reach the files.
+ *
+ * A snapshot shares the pages with the live memory, and a shared page
+ * is copied on the next write to it, so taking one costs a copy of the
+ * page table. Restoring it drops whatever was written since. The memory
+ * can also be written out as a sparse image, which loads back as a RAM
+ * file, and the number of writes to each page counted. core_tb looks at
+ * two environment variables:
+ *
+ * SIM_RAM_DUMP=<file>		write the image at exit
+ * SIM_RAM_WRITES=<file>	write per page write counts at exit
+ *
+ * Either can also be done at any time with a DMI write of one of the
+ * SIM_RAM_* commands to DBG_SIM_RAM (see sim_bram.vhdl), as are
+ * snapshot and restore. With more than one region, the region number
+ * is appended to the file names of all but the first.
+ */
+
+#define RAM_PAGE_SHIFT	16
+#define RAM_PAGE_SIZE	(1UL << RAM_PAGE_SHIFT)
+#define RAM_PAGE_MASK	(RAM_PAGE_SIZE - 1)
+
+#define DEFAULT_DUMP_FILE	"sim_ram_dump.bin"
+#define DEFAULT_WRITES_FILE	"sim_ram_writes.txt"
+
+/* Commands from sim_bram.vhdl */
+#define SIM_RAM_DUMP		0
+#define SIM_RAM_SNAPSHOT	1
+#define SIM_RAM_RESTORE		2
+#define SIM_RAM_WRITES		3
+
+struct backing_file {
+	char *filename;
+	int fd;
+	unsigned long offset;
+	unsigned long size;
+};
 
 struct ram_behavioural {
 	char *filename;
 	unsigned long size;
-	void *m;
+	unsigned long nr_pages;
+	unsigned char **pages;
+	struct backing_file *files;
+	unsigned int nr_files;
+
+	/* Per page */
+	uint64_t *writes;
+	unsigned char **snapshot;
+	bool *shared;
+	bool has_snapshot;
 };
 
-static struct ram_behavioural behavioural_regions[MAX_REGIONS];
+static struct ram_behavioural *behavioural_regions;
 static unsigned long region_nr;
+static const char *dump_file;
+static const char *writes_file;
 
-unsigned long behavioural_initialize(void *__f, unsigned long size)
+static void behavioural_exit(void);
+
+static void add_file(struct ram_behavioural *r, const char *spec)
 {
-	struct ram_behavioural *r;
-	int fd;
+	struct backing_file *f;
+	const char *at = strrchr(spec, '@');
 	struct stat buf;
-	unsigned long tmp_size;
-	void *mem;
 
-	if (region_nr == MAX_REGIONS) {
-		fprintf(stderr, "%s: too many regions, bump MAX_REGIONS\n", __func__);
+	r->files = realloc(r->files, (r->nr_files + 1) * sizeof(*r->files));
+	if (!r->files) {
+		perror("realloc");
 		exit(1);
 	}
+	f = &r->files[r->nr_files];
 
-	r = &behavioural_regions[region_nr];
+	f->filename = at ? strndup(spec, at - spec) : strdup(spec);
+	f->offset = at ? strtoul(at + 1, NULL, 0) : 0;
 
-	r->filename = from_string(__f);
-	r->size = ALIGN_UP(size, getpagesize());
-
-	fd = open(r->filename, O_RDWR);
-	if (fd == -1) {
+	f->fd = open(f->filename, O_RDONLY);
+	if (f->fd == -1) {
 		fprintf(stderr, "%s: could not open %s\n", __func__,
-			r->filename);
+			f->filename);
 		exit(1);
 	}
 
-	if (fstat(fd, &buf)) {
+	if (fstat(f->fd, &buf)) {
 		perror("fstat");
 		exit(1);
 	}
+	f->size = buf.st_size;
+
+	if (f->offset >= r->size) {
+		fprintf(stderr, "%s: %s at 0x%lx is outside the 0x%lx byte RAM\n",
+			__func__, f->filename, f->offset, r->size);
+		exit(1);
+	}
+	if (f->offset + f->size > r->size) {
+		fprintf(stderr, "%s: %s truncated to fit the 0x%lx byte RAM\n",
+			__func__, f->filename, r->size);
+		f->size = r->size - f->offset;
+	}
+
+	r->nr_files++;
+}
+
+unsigned long behavioural_initialize(void *__f, unsigned long size)
+{
+	struct ram_behavioural *r;
+	char *spec, *tok, *save;
+
+	behavioural_regions = realloc(behavioural_regions,
+				      (region_nr + 1) * sizeof(*r));
+	if (!behavioural_regions) {
+		perror("realloc");
+		exit(1);
+	}
+
+	r = &behavioural_regions[region_nr];
+	memset(r, 0, sizeof(*r));
 
-	/* XXX Do we need to truncate the underlying file? */
-	tmp_size = ALIGN_UP(buf.st_size, getpagesize());
+	r->filename = from_string(__f);
+	r->size = ALIGN_UP(size, RAM_PAGE_SIZE);
+
+	r->nr_pages = r->size >> RAM_PAGE_SHIFT;
+	r->pages = calloc(r->nr_pages, sizeof(*r->pages));
+	r->writes = calloc(r->nr_pages, sizeof(*r->writes));
+	r->shared = calloc(r->nr_pages, sizeof(*r->shared));
+	if (!r->pages || !r->writes || !r->shared) {
+		perror("calloc");
+		exit(1);
+	}
+
+	spec = strdup(r->filename);
+	for (tok = strtok_r(spec, ",", &save); tok;
+	     tok = strtok_r(NULL, ",", &save))
+		add_file(r, tok);
+	free(spec);
+
+	if (!region_nr) {
+		dump_file = getenv("SIM_RAM_DUMP");
+		writes_file = getenv("SIM_RAM_WRITES");
+		if (dump_file || writes_file)
+			atexit(behavioural_exit);
+	}
+
+	return region_nr++;
+}
 
-	if (r->size > tmp_size) {
-		void *m;
+/* Read whatever the files have for the page at base, which starts zeroed */
+static void fill_page(struct ram_behavioural *r, unsigned long base,
+		      unsigned char *page)
+{
+	for (unsigned int i = 0; i < r->nr_files; i++) {
+		struct backing_file *f = &r->files[i];
+		unsigned long start, end;
+
+		start = f->offset > base ? f->offset : base;
+		end = f->offset + f->size < base + RAM_PAGE_SIZE ?
+			f->offset + f->size : base + RAM_PAGE_SIZE;
+		if (start >= end)
+			continue;
 
-		/*
-		 * We have to pad the file. Allocate the total size, then
-		 * create a space for the file.
-		 */
-		mem = mmap(NULL, r->size, PROT_READ|PROT_WRITE,
-				MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-		if (mem == MAP_FAILED) {
-			perror("mmap");
+		if (pread(f->fd, page + start - base, end - start,
+			  start - f->offset) != (ssize_t)(end - start)) {
+			fprintf(stderr, "%s: short read from %s\n", __func__,
+				f->filename);
 			exit(1);
 		}
+	}
+}
 
-		if (tmp_size) {
-			munmap(mem, tmp_size);
-
-			m = mmap(mem, tmp_size, PROT_READ|PROT_WRITE,
-					MAP_PRIVATE|MAP_FIXED, fd, 0);
-			if (m == MAP_FAILED) {
-				perror("mmap");
-				exit(1);
-			}
-			if (m != mem) {
-				fprintf(stderr, "%s: mmap(MAP_FIXED) failed\n",
-					__func__);
-				exit(1);
-			}
-		}
-	} else {
-		mem = mmap(NULL, tmp_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
-				fd, 0);
-		if (mem == MAP_FAILED) {
-			perror("mmap");
+/* Allocate a page on first touch, with whatever the files have there */
+static unsigned char *populate(struct ram_behavioural *r, unsigned long addr)
+{
+	unsigned char *page;
+
+	page = calloc(1, RAM_PAGE_SIZE);
+	if (!page) {
+		perror("calloc");
+		exit(1);
+	}
+
+	fill_page(r, addr & ~RAM_PAGE_MASK, page);
+	r->pages[addr >> RAM_PAGE_SHIFT] = page;
+
+	return page;
+}
+
+static inline unsigned char *lookup(struct ram_behavioural *r,
+				    unsigned long addr)
+{
+	unsigned char *page = r->pages[addr >> RAM_PAGE_SHIFT];
+
+	if (!page)
+		page = populate(r, addr);
+
+	return page + (addr & RAM_PAGE_MASK);
+}
+
+/* Give a page shared with the snapshot its own copy before writing it */
+static inline unsigned char *lookup_write(struct ram_behavioural *r,
+					  unsigned long addr)
+{
+	unsigned long i = addr >> RAM_PAGE_SHIFT;
+
+	if (r->shared[i]) {
+		unsigned char *page = malloc(RAM_PAGE_SIZE);
+
+		if (!page) {
+			perror("malloc");
 			exit(1);
 		}
+		memcpy(page, r->pages[i], RAM_PAGE_SIZE);
+		r->pages[i] = page;
+		r->shared[i] = false;
 	}
+	r->writes[i]++;
 
-	behavioural_regions[region_nr].m = mem;
-	return region_nr++;
+	return lookup(r, addr);
 }
 
-void behavioural_read(unsigned char *__val, unsigned char *__addr,
-			unsigned long sel, int identifier)
+static struct ram_behavioural *check_access(const char *func, int identifier,
+					    unsigned long addr)
 {
 	struct ram_behavioural *r;
-	unsigned long val = 0;
-	unsigned long addr = from_std_logic_vector(__addr, 64);
-	unsigned char *p;
 
-	if (identifier > region_nr) {
-		fprintf(stderr, "%s: bad index %d\n", __func__, identifier);
+	if (identifier < 0 || (unsigned long)identifier >= region_nr) {
+		fprintf(stderr, "%s: bad index %d\n", func, identifier);
 		exit(1);
 	}
 
 	r = &behavioural_regions[identifier];
 
-	for (unsigned long i = 0; i < 8; i++) {
-#if 0
-		/* sel only used on writes */
-		if (!(sel & (1UL << i)))
-			continue;
-#endif
+	/* Accesses are 8 byte aligned, so never cross a page */
+	if ((addr & 7) || addr + 8 > r->size) {
+		fprintf(stderr, "%s: bad memory access %lx %lx\n", func,
+			addr, r->size);
+		exit(1);
+	}
 
-		if ((addr + i) > r->size) {
-			fprintf(stderr, "%s: bad memory access %lx %lx\n", __func__,
-				addr+i, r->size);
-			exit(1);
-		}
+	return r;
+}
 
-		p = (unsigned char *)(((unsigned long)r->m) + addr + i);
-		val |= (((unsigned long)*p) << (i*8));
-	}
+void behavioural_read(unsigned char *__val, unsigned char *__addr,
+			unsigned long sel, int identifier)
+{
+	struct ram_behavioural *r;
+	uint64_t val;
+	bool meta = false;
+	unsigned long addr = vhpi_get_bits(__addr, 64, &meta);
+
+	if (meta)
+		fprintf(stderr, "%s: metavalue in address\n", __func__);
+
+	r = check_access(__func__, identifier, addr);
+
+	/* sel only used on writes */
+	memcpy(&val, lookup(r, addr), sizeof(val));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	val = __builtin_bswap64(val);
+#endif
 
 #ifdef DEBUG
 	printf("MEM behave %d read  %016lx addr %016lx sel %02lx\n", identifier, val,
 		addr, sel);
 #endif
 
-	to_std_logic_vector(val, __val, 64);
+	vhpi_set_bits(__val, val, 64);
 }
 
 void behavioural_write(unsigned char *__val, unsigned char *__addr,
 			unsigned int sel, int identifier)
 {
 	struct ram_behavioural *r;
-	unsigned long val = from_std_logic_vector(__val, 64);
-	unsigned long addr = from_std_logic_vector(__addr, 64);
+	bool meta = false;
+	unsigned long val = vhpi_get_bits(__val, 64, &meta);
+	unsigned long addr = vhpi_get_bits(__addr, 64, &meta);
 	unsigned char *p;
 
-	if (identifier > region_nr) {
-		fprintf(stderr, "%s: bad index %d\n", __func__, identifier);
-		exit(1);
-	}
-
-	r = &behavioural_regions[identifier];
+	if (meta)
+		fprintf(stderr, "%s: metavalue in address or data\n", __func__);
 
-	p = (unsigned char *)(((unsigned long)r->m) + addr);
+	r = check_access(__func__, identifier, addr);
+	p = lookup_write(r, addr);
 
 #ifdef DEBUG
 	printf("MEM behave %d write %016lx addr %016lx sel %02x\n", identifier, val,
@@ -164,16 +310,195 @@ void behavioural_write(unsigned char *__val, unsigned char *__addr,
 #endif
 
 	for (unsigned long i = 0; i < 8; i++) {
-		if (!(sel & (1UL << i)))
-			continue;
+		if (sel & (1UL << i))
+			p[i] = (val >> (i*8)) & 0xff;
+	}
+}
 
-		if ((addr + i) > r->size) {
-			fprintf(stderr, "%s: bad memory access %lx %lx\n", __func__,
-				addr+i, r->size);
+static void snapshot(struct ram_behavioural *r)
+{
+	if (!r->snapshot) {
+		r->snapshot = calloc(r->nr_pages, sizeof(*r->snapshot));
+		if (!r->snapshot) {
+			perror("calloc");
 			exit(1);
 		}
+	}
+
+	for (unsigned long i = 0; i < r->nr_pages; i++) {
+		if (r->snapshot[i] && !r->shared[i])
+			free(r->snapshot[i]);
+		r->snapshot[i] = r->pages[i];
+		r->shared[i] = r->pages[i] != NULL;
+	}
+	r->has_snapshot = true;
+}
+
+static void restore(struct ram_behavioural *r)
+{
+	if (!r->has_snapshot) {
+		fprintf(stderr, "%s: no snapshot to restore\n", __func__);
+		return;
+	}
+
+	/* Pages first touched since are reloaded from the files if needed */
+	for (unsigned long i = 0; i < r->nr_pages; i++) {
+		if (r->pages[i] && !r->shared[i])
+			free(r->pages[i]);
+		r->pages[i] = r->snapshot[i];
+		r->shared[i] = r->snapshot[i] != NULL;
+	}
+}
+
+static bool file_backed(struct ram_behavioural *r, unsigned long base)
+{
+	for (unsigned int i = 0; i < r->nr_files; i++) {
+		struct backing_file *f = &r->files[i];
+
+		if (f->offset < base + RAM_PAGE_SIZE &&
+		    f->offset + f->size > base)
+			return true;
+	}
+
+	return false;
+}
+
+static char *region_file_name(const char *name, int identifier)
+{
+	char *s = malloc(strlen(name) + 16);
+
+	if (!s) {
+		perror("malloc");
+		exit(1);
+	}
+	if (identifier)
+		sprintf(s, "%s.%d", name, identifier);
+	else
+		strcpy(s, name);
+
+	return s;
+}
+
+/*
+ * Everything ever touched or loaded, with holes for the rest. Pages only
+ * the files have are read into a scratch page rather than populated, so
+ * dumping doesn't grow the memory.
+ */
+static void dump(struct ram_behavioural *r, int identifier)
+{
+	char *name = region_file_name(dump_file ? dump_file : DEFAULT_DUMP_FILE,
+				      identifier);
+	unsigned long written = 0;
+	unsigned char *scratch;
+	int fd;
+
+	scratch = malloc(RAM_PAGE_SIZE);
+	if (!scratch) {
+		perror("malloc");
+		exit(1);
+	}
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		perror(name);
+		free(scratch);
+		free(name);
+		return;
+	}
+
+	for (unsigned long i = 0; i < r->nr_pages; i++) {
+		unsigned long base = i << RAM_PAGE_SHIFT;
+		unsigned char *page = r->pages[i];
+
+		if (!page) {
+			if (!file_backed(r, base))
+				continue;
+			memset(scratch, 0, RAM_PAGE_SIZE);
+			fill_page(r, base, scratch);
+			page = scratch;
+		}
+		if (pwrite(fd, page, RAM_PAGE_SIZE, base) !=
+		    (ssize_t)RAM_PAGE_SIZE) {
+			perror(name);
+			break;
+		}
+		written++;
+	}
+	if (ftruncate(fd, r->size))
+		perror(name);
+	close(fd);
+	free(scratch);
+
+	fprintf(stderr, "RAM %d: %lu of %lu pages dumped to %s\n", identifier,
+		written, r->nr_pages, name);
+	free(name);
+}
+
+static void write_counts(struct ram_behavioural *r, int identifier)
+{
+	char *name = region_file_name(writes_file ? writes_file :
+				      DEFAULT_WRITES_FILE, identifier);
+	unsigned long touched = 0, dirty = 0;
+	FILE *f;
+
+	f = fopen(name, "w");
+	if (!f) {
+		perror(name);
+		free(name);
+		return;
+	}
+
+	for (unsigned long i = 0; i < r->nr_pages; i++) {
+		touched += r->pages[i] != NULL;
+		dirty += r->writes[i] != 0;
+	}
+
+	fprintf(f, "# %lu of %lu %lukB pages touched, %lu written\n",
+		touched, r->nr_pages, RAM_PAGE_SIZE / 1024, dirty);
+	fprintf(f, "# address writes\n");
+	for (unsigned long i = 0; i < r->nr_pages; i++) {
+		if (r->writes[i])
+			fprintf(f, "0x%016lx %llu\n", i << RAM_PAGE_SHIFT,
+				(unsigned long long)r->writes[i]);
+	}
+	fclose(f);
 
-		p = (unsigned char *)(((unsigned long)r->m) + addr + i);
-		*p = (val >> (i*8)) & 0xff;
+	fprintf(stderr, "RAM %d: %lu pages touched, %lu written, counts in %s\n",
+		identifier, touched, dirty, name);
+	free(name);
+}
+
+static void behavioural_exit(void)
+{
+	for (unsigned long i = 0; i < region_nr; i++) {
+		if (dump_file)
+			dump(&behavioural_regions[i], i);
+		if (writes_file)
+			write_counts(&behavioural_regions[i], i);
+	}
+}
+
+void behavioural_command(int cmd)
+{
+	for (unsigned long i = 0; i < region_nr; i++) {
+		struct ram_behavioural *r = &behavioural_regions[i];
+
+		switch (cmd) {
+		case SIM_RAM_DUMP:
+			dump(r, i);
+			break;
+		case SIM_RAM_SNAPSHOT:
+			snapshot(r);
+			break;
+		case SIM_RAM_RESTORE:
+			restore(r);
+			break;
+		case SIM_RAM_WRITES:
+			write_counts(r, i);
+			break;
+		default:
+			fprintf(stderr, "%s: unknown command %d\n", __func__, cmd);
+			return;
+		}
 	}
 }
@@ -2,28 +2,29 @@ library ieee;
 use ieee.std_logic_1164.all;
 
 package sim_console is
-    procedure sim_console_read (val: out std_ulogic_vector(63 downto 0));
+    -- channel is 0 for UART0 and 1 for UART1, see sim_console_c.c
+    procedure sim_console_read (channel: integer; val: out std_ulogic_vector(63 downto 0));
     attribute foreign of sim_console_read : procedure is "VHPIDIRECT sim_console_read";
 
-    procedure sim_console_poll (val: out std_ulogic_vector(63 downto 0));
+    procedure sim_console_poll (channel: integer; val: out std_ulogic_vector(63 downto 0));
     attribute foreign of sim_console_poll : procedure is "VHPIDIRECT sim_console_poll";
 
-    procedure sim_console_write (val: std_ulogic_vector(63 downto 0));
+    procedure sim_console_write (channel: integer; val: std_ulogic_vector(63 downto 0));
     attribute foreign of sim_console_write : procedure is "VHPIDIRECT sim_console_write";
 end sim_console;
 
 package body sim_console is
-    procedure sim_console_read (val: out std_ulogic_vector(63 downto 0)) is
+    procedure sim_console_read (channel: integer; val: out std_ulogic_vector(63 downto 0)) is
     begin
         assert false report "VHPI" severity failure;
     end sim_console_read;
 
-    procedure sim_console_poll (val: out std_ulogic_vector(63 downto 0)) is
+    procedure sim_console_poll (channel: integer; val: out std_ulogic_vector(63 downto 0)) is
     begin
         assert false report "VHPI" severity failure;
     end sim_console_poll;
 
-    procedure sim_console_write (val: std_ulogic_vector(63 downto 0)) is
+    procedure sim_console_write (channel: integer; val: std_ulogic_vector(63 downto 0)) is
     begin
         assert false report "VHPI" severity failure;
     end sim_console_write;
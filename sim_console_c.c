@@ -1,16 +1,89 @@
+#define _GNU_SOURCE
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <termios.h>
 #include <unistd.h>
 #include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "sim_vhpi_c.h"
 
+/*
+ * Console backends for the simulated UARTs. Each UART is a channel, 0
+ * for UART0 and 1 for UART1, configured by SIM_CONSOLE0 and
+ * SIM_CONSOLE1 (SIM_CONSOLE is the same as SIM_CONSOLE0):
+ *
+ * stdio			stdin in raw mode, output on stderr (default)
+ * pty				a pseudo-terminal, its name is printed at start
+ * unix:<path>			a Unix socket to connect to, eg with socat
+ * script:<file>		input and expected output from a file
+ *
+ * Output is buffered, and flushed on a newline or once the guest has
+ * polled for input IDLE_POLLS times without writing anything, ie it is
+ * waiting rather than checking the transmitter between characters.
+ * Input is read in blocks, and the file descriptor is only polled every
+ * POLL_INTERVAL status reads while nothing is buffered.
+ *
+ * A script has one command per line, with C escapes (\r, \n, \\):
+ *
+ * send <text>			queue text as input
+ * expect <text>		wait until the output contains text
+ *
+ * Input queued after an expect only becomes available once it has
+ * matched. The simulation exits when the end of the script is reached,
+ * and an unmatched expect is reported at exit.
+ */
+
 /* Should we exit simulation on ctrl-c or pass it through? */
 #define EXIT_ON_CTRL_C
 
+#define NR_CHANNELS	2
+#define OUT_BUF_SIZE	4096
+#define IN_BUF_SIZE	4096
+#define POLL_INTERVAL	32
+#define IDLE_POLLS	16
+#define MATCH_WINDOW	4096
+
+enum backend {
+	BACKEND_STDIO,
+	BACKEND_PTY,
+	BACKEND_UNIX,
+	BACKEND_SCRIPT,
+};
+
+struct channel {
+	bool initialized;
+	enum backend backend;
+	int in_fd;
+	int out_fd;
+	int listen_fd;
+	const char *name;
+
+	char out[OUT_BUF_SIZE];
+	unsigned int out_len;
+
+	unsigned char *in;
+	unsigned long in_head;
+	unsigned long in_tail;
+	unsigned long in_size;
+	unsigned int poll_countdown;
+	unsigned int idle_polls;
+
+	/* script */
+	FILE *script;
+	unsigned int script_line;
+	char *expect;
+	char window[MATCH_WINDOW + 1];
+	unsigned int window_len;
+};
+
+static struct channel channels[NR_CHANNELS];
 static struct termios oldt;
 
 static void disable_raw_mode(void)
@@ -37,54 +110,370 @@ static void enable_raw_mode(void)
 	}
 }
 
-void sim_console_read(unsigned char *__rt)
+static void set_nonblock(int fd)
 {
-	int ret;
-	unsigned long val = 0;
+	int flags = fcntl(fd, F_GETFL);
+
+	if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+		perror("fcntl");
+		exit(1);
+	}
+}
+
+static void flush_output(struct channel *c)
+{
+	unsigned int done = 0;
+
+	while (done < c->out_len && c->out_fd >= 0) {
+		ssize_t rc = write(c->out_fd, c->out + done, c->out_len - done);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		/* Nobody reading a pty or socket, drop it */
+		if (rc <= 0)
+			break;
+		done += rc;
+	}
+	c->out_len = 0;
+}
+
+static void flush_all(void)
+{
+	for (unsigned int i = 0; i < NR_CHANNELS; i++)
+		if (channels[i].initialized)
+			flush_output(&channels[i]);
+}
+
+static void queue_input(struct channel *c, const void *buf, unsigned long len)
+{
+	if (c->in_head == c->in_tail)
+		c->in_head = c->in_tail = 0;
+
+	if (c->in_tail + len > c->in_size) {
+		/* Move what's left to the start, grow if that's not enough */
+		memmove(c->in, c->in + c->in_head, c->in_tail - c->in_head);
+		c->in_tail -= c->in_head;
+		c->in_head = 0;
+		while (c->in_tail + len > c->in_size)
+			c->in_size *= 2;
+		c->in = (unsigned char *)realloc(c->in, c->in_size);
+		if (!c->in) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	memcpy(c->in + c->in_tail, buf, len);
+	c->in_tail += len;
+}
+
+static bool input_pending(struct channel *c)
+{
+	return c->in_head != c->in_tail;
+}
+
+/* Process C escapes in place */
+static void unescape(char *s)
+{
+	char *d = s;
+
+	for (; *s; s++) {
+		if (*s != '\\' || !s[1]) {
+			*d++ = *s;
+			continue;
+		}
+		switch (*++s) {
+		case 'r':
+			*d++ = '\r';
+			break;
+		case 'n':
+			*d++ = '\n';
+			break;
+		case 't':
+			*d++ = '\t';
+			break;
+		default:
+			*d++ = *s;
+			break;
+		}
+	}
+	*d = '\0';
+}
+
+/* Run the script up to the next expect */
+static void script_advance(struct channel *c)
+{
+	char *line = NULL;
+	size_t len = 0;
+
+	while (!c->expect) {
+		if (getline(&line, &len, c->script) < 0) {
+			flush_all();
+			fprintf(stderr, "\r\nconsole %s: script complete\r\n",
+				c->name);
+			free(line);
+			exit(0);
+		}
+		c->script_line++;
+		line[strcspn(line, "\r\n")] = '\0';
+		unescape(line);
+
+		if (!strncmp(line, "send ", 5)) {
+			queue_input(c, line + 5, strlen(line + 5));
+		} else if (!strncmp(line, "expect ", 7)) {
+			c->expect = strdup(line + 7);
+		} else if (line[0] && line[0] != '#') {
+			fprintf(stderr, "console %s: line %u: unknown command\n",
+				c->name, c->script_line);
+			exit(1);
+		}
+	}
+	free(line);
+}
+
+static void script_output(struct channel *c, char ch)
+{
+	if (c->window_len == MATCH_WINDOW) {
+		memmove(c->window, c->window + MATCH_WINDOW / 2, MATCH_WINDOW / 2);
+		c->window_len = MATCH_WINDOW / 2;
+	}
+	c->window[c->window_len++] = ch;
+	c->window[c->window_len] = '\0';
+
+	if (c->expect && strstr(c->window, c->expect)) {
+		free(c->expect);
+		c->expect = NULL;
+		c->window_len = 0;
+		script_advance(c);
+	}
+}
+
+static void script_exit(void)
+{
+	for (unsigned int i = 0; i < NR_CHANNELS; i++) {
+		struct channel *c = &channels[i];
+
+		if (c->backend == BACKEND_SCRIPT && c->expect)
+			fprintf(stderr, "\r\nconsole %s: line %u: still waiting for \"%s\"\r\n",
+				c->name, c->script_line, c->expect);
+	}
+}
+
+static void open_pty(struct channel *c)
+{
+	struct termios t;
+	int fd;
+
+	fd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (fd < 0 || grantpt(fd) || unlockpt(fd)) {
+		perror("posix_openpt");
+		exit(1);
+	}
+
+	/* No echo or line editing, the guest does that */
+	if (!tcgetattr(fd, &t)) {
+		cfmakeraw(&t);
+		tcsetattr(fd, TCSANOW, &t);
+	}
+	set_nonblock(fd);
+
+	c->in_fd = c->out_fd = fd;
+	fprintf(stderr, "console %s on %s\r\n", c->name, ptsname(fd));
+}
 
-	enable_raw_mode();
+static void open_unix(struct channel *c, const char *path)
+{
+	struct sockaddr_un addr;
 
-	ret = read(STDIN_FILENO, &val, 1);
-	if (ret != 1) {
-		fprintf(stderr, "%s: read of stdin returns %d\n", __func__, ret);
+	signal(SIGPIPE, SIG_IGN);
+	c->listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (c->listen_fd < 0) {
+		perror("socket");
 		exit(1);
 	}
 
-	//fprintf(stderr, "read returns %c\n", val);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if (bind(c->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+	    listen(c->listen_fd, 1) < 0) {
+		fprintf(stderr, "console %s: can't listen on %s: %s\n", c->name,
+			path, strerror(errno));
+		exit(1);
+	}
+	set_nonblock(c->listen_fd);
+	fprintf(stderr, "console %s on %s\r\n", c->name, path);
+}
 
-	to_std_logic_vector(val, __rt, 64);
+static void open_script(struct channel *c, const char *path)
+{
+	c->script = fopen(path, "r");
+	if (!c->script) {
+		perror(path);
+		exit(1);
+	}
+	atexit(script_exit);
+	script_advance(c);
 }
 
-void sim_console_poll(unsigned char *__rt)
+static struct channel *get_channel(int channel)
 {
-	int ret;
+	static const char *names[NR_CHANNELS] = { "UART0", "UART1" };
+	struct channel *c;
+	const char *spec;
+	char var[16];
+
+	if (channel < 0 || channel >= NR_CHANNELS) {
+		fprintf(stderr, "sim_console: bad channel %d\n", channel);
+		exit(1);
+	}
+
+	c = &channels[channel];
+	if (c->initialized)
+		return c;
+
+	c->initialized = true;
+	c->name = names[channel];
+	c->in_fd = c->out_fd = c->listen_fd = -1;
+	c->in_size = IN_BUF_SIZE;
+	c->in = (unsigned char *)malloc(c->in_size);
+	if (!c->in) {
+		perror("malloc");
+		exit(1);
+	}
+
+	snprintf(var, sizeof(var), "SIM_CONSOLE%d", channel);
+	spec = getenv(var);
+	if (!spec && channel == 0)
+		spec = getenv("SIM_CONSOLE");
+	if (!spec)
+		spec = "stdio";
+
+	if (!strcmp(spec, "stdio")) {
+		c->backend = BACKEND_STDIO;
+		c->in_fd = STDIN_FILENO;
+		c->out_fd = STDERR_FILENO;
+		enable_raw_mode();
+	} else if (!strcmp(spec, "pty")) {
+		c->backend = BACKEND_PTY;
+		open_pty(c);
+	} else if (!strncmp(spec, "unix:", 5)) {
+		c->backend = BACKEND_UNIX;
+		open_unix(c, spec + 5);
+	} else if (!strncmp(spec, "script:", 7)) {
+		c->backend = BACKEND_SCRIPT;
+		c->out_fd = STDERR_FILENO;
+		open_script(c, spec + 7);
+	} else {
+		fprintf(stderr, "%s: unknown console %s\n", var, spec);
+		exit(1);
+	}
+
+	if (channel == 0)
+		atexit(flush_all);
+
+	return c;
+}
+
+static void disconnect(struct channel *c)
+{
+	close(c->in_fd);
+	c->in_fd = c->out_fd = -1;
+	fprintf(stderr, "console %s: client disconnected\r\n", c->name);
+}
+
+/* Read whatever is available, blocking only for stdio */
+static void fill_input(struct channel *c, bool block)
+{
+	unsigned char buf[IN_BUF_SIZE];
 	struct pollfd fdset[1];
-	uint8_t val = 0;
+	ssize_t rc;
+
+	if (c->backend == BACKEND_SCRIPT)
+		return;
+
+	if (c->backend == BACKEND_UNIX && c->in_fd < 0) {
+		c->in_fd = accept(c->listen_fd, NULL, NULL);
+		if (c->in_fd < 0)
+			return;
+		set_nonblock(c->in_fd);
+		c->out_fd = c->in_fd;
+		fprintf(stderr, "console %s: client connected\r\n", c->name);
+	}
+
+	if (!block) {
+		memset(fdset, 0, sizeof(fdset));
+		fdset[0].fd = c->in_fd;
+		fdset[0].events = POLLIN;
+		if (poll(fdset, 1, 0) != 1 || !(fdset[0].revents & (POLLIN | POLLHUP)))
+			return;
+	}
+
+	rc = read(c->in_fd, buf, sizeof(buf));
+	if (rc > 0) {
+		queue_input(c, buf, rc);
+		return;
+	}
+	if (rc < 0 && (errno == EAGAIN || errno == EINTR || errno == EIO))
+		return;
 
-	enable_raw_mode();
+	switch (c->backend) {
+	case BACKEND_STDIO:
+		fprintf(stderr, "%s: read of stdin returns %zd\n", __func__, rc);
+		exit(1);
+	case BACKEND_UNIX:
+		disconnect(c);
+		break;
+	default:
+		break;
+	}
+}
+
+void sim_console_read(int channel, unsigned char *__rt)
+{
+	struct channel *c = get_channel(channel);
+	unsigned long val = 0;
 
-	memset(fdset, 0, sizeof(fdset));
+	flush_output(c);
 
-	fdset[0].fd = STDIN_FILENO;
-	fdset[0].events = POLLIN;
+	if (!input_pending(c))
+		fill_input(c, c->backend == BACKEND_STDIO);
 
-	ret = poll(fdset, 1, 0);
-	//fprintf(stderr, "poll returns %d\n", ret);
+	if (input_pending(c))
+		val = c->in[c->in_head++];
 
-	if (ret == 1) {
-		if (fdset[0].revents & POLLIN)
-			val = 1;
-//		fprintf(stderr, "poll revents: 0x%x\n", fdset[0].revents);
+	vhpi_set_bits(__rt, val, 64);
+}
+
+void sim_console_poll(int channel, unsigned char *__rt)
+{
+	struct channel *c = get_channel(channel);
+
+	/* The guest is waiting for something, let it be seen */
+	if (c->out_len && ++c->idle_polls >= IDLE_POLLS)
+		flush_output(c);
+
+	if (!input_pending(c) && !c->poll_countdown--) {
+		c->poll_countdown = POLL_INTERVAL;
+		fill_input(c, false);
 	}
 
-	to_std_logic_vector(val, __rt, 64);
+	vhpi_set_bits(__rt, input_pending(c), 64);
 }
 
-void sim_console_write(unsigned char *__rs)
+void sim_console_write(int channel, unsigned char *__rs)
 {
-	uint8_t val;
+	struct channel *c = get_channel(channel);
+	char val;
+
+	val = vhpi_get_bits(__rs, 64, NULL);
 
-	val = from_std_logic_vector(__rs, 64);
+	c->out[c->out_len++] = val;
+	c->idle_polls = 0;
+	if (val == '\n' || c->out_len == OUT_BUF_SIZE)
+		flush_output(c);
 
-	fprintf(stderr, "%c", val);
+	if (c->backend == BACKEND_SCRIPT)
+		script_output(c, val);
 }
@@ -22,8 +22,8 @@ begin
 	-- more realistic conditions.
 	constant jclk_period : time := 1 ns;
 
-	-- Polling the socket... this could be made slower when nothing
-	-- is connected once we have that indication from the C code.
+	-- Polling the socket when there is nothing to do. While a client's
+	-- request is in progress the C code hands out scans back to back.
 	constant poll_period : time := 100 ns;
 
 	-- Number of dummy JTAG clocks to inject after a command. (I haven't
@@ -91,7 +91,6 @@ begin
 	clock(1);
 	rsp := (others => '0');
 	while true loop
-	    wait for poll_period;
 	    sim_jtag_read_msg(cmd, msize);
 	    size := to_integer(unsigned(msize));
 	    if size /= 0 and size < 248 then
@@ -99,6 +98,8 @@ begin
 			      rsp(0 to size-1));
 		sim_jtag_write_msg(rsp, msize);
 		clock(dummy_clocks);
+	    else
+		wait for poll_period;
 	    end if;
 	end loop;
     end process;    
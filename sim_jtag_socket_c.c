@@ -1,33 +1,159 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <poll.h>
 #include <signal.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include "sim_vhpi_c.h"
 
-/* XXX Make that some parameter */
-#define TCP_PORT	13245
+/*
+ * Debug socket for "mw_debug -b sim", shared by core_tb, where
+ * sim_jtag.vhdl clocks requests through the JTAG DTM model, and
+ * microwatt-verilator, which puts them straight on the DMI bus. It
+ * listens on SIM_DEBUG_SOCKET (--debug-socket=<...> for verilator),
+ * either a TCP port or unix:<path>, by default TCP port 13245. Several
+ * clients can be connected, and are served a packet at a time in turn.
+ *
+ * A packet is one of two things, told apart by the first byte:
+ *
+ * A DR scan of the DMI DTM: a size in bits (255 for a JTAG reset, which
+ * is ignored), then op (2 bits), data (64) and address (8), LSB first.
+ * The reply is a packet of the same size with the bits shifted out.
+ *
+ * A frame of DMI operations: DMI_FRAME_MAGIC, a status byte (0), two
+ * reserved bytes, the length of the rest as 32 bits, then operations:
+ *
+ * DMI_FRAME_READ <addr>
+ * DMI_FRAME_WRITE <addr> <data, 64 bits>
+ * DMI_FRAME_READ_BLOCK <addr> <count, 32 bits>
+ * DMI_FRAME_WRITE_BLOCK <addr> <count, 32 bits> <count x data>
+ *
+ * Multi-byte fields are little endian. The block forms repeat the
+ * access, eg on DBG_WB_DATA with the wishbone debug master's address
+ * auto-increment enabled. Every operation is run to completion before
+ * the next starts, so the client doesn't have to poll for status. The
+ * reply has the same header, with a DMI_FRAME_* status, followed by the
+ * data from each read in order. A frame asking for more than MAX_FRAME
+ * bytes of read data gets DMI_FRAME_EBADOP and nothing in it is run.
+ * Nothing from another client is run in the middle of a frame, so a
+ * client sharing the debug master should set its address in the same
+ * frame as the accesses.
+ */
+
+#define DEFAULT_PORT	13245
+#define MAX_CLIENTS	8
+#define MAX_FRAME	(1024 * 1024)
+
+#define DMI_FRAME_MAGIC		0xfd
+#define DMI_FRAME_HDR		8
+
+#define DMI_FRAME_READ		1
+#define DMI_FRAME_WRITE		2
+#define DMI_FRAME_READ_BLOCK	3
+#define DMI_FRAME_WRITE_BLOCK	4
+
+#define DMI_FRAME_OK		0
+#define DMI_FRAME_EBADOP	1
+#define DMI_FRAME_EDMI		2
+
+/* What sim_debug_socket_next() hands out, op as in a DTM scan */
+#define DMI_REQ_NOP	0
+#define DMI_REQ_RD	1
+#define DMI_REQ_WR	2
+#define DMI_SCAN	3
+
+#define DMI_RSP_OK	0
+#define DMI_RSP_BSY	3
+
+#define SCAN_BITS	74
 #define MAX_PACKET	32
 
+struct client {
+	int fd;
+	uint8_t *buf;
+	unsigned long len;
+	unsigned long size;
+};
+
 static int fd = -1;
-static int cfd = -1;
+static struct client clients[MAX_CLIENTS];
+static unsigned int nr_clients;
+static unsigned int next_client;
+
+/* The packet being worked on */
+static struct client *cur;
+static unsigned long cur_len;
+static bool scan_issued;
 
-static void open_socket(void)
+/* Frame state */
+static const uint8_t *op_p, *op_end;
+static uint8_t op_type, op_addr;
+static uint32_t op_count;
+static bool op_pending;
+static uint8_t frame_status;
+static uint8_t *results;
+static unsigned long results_len, results_size;
+
+static uint32_t get_le32(const uint8_t *p)
 {
-	struct sockaddr_in addr;
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+	return get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+	for (int i = 0; i < 4; i++)
+		p[i] = v >> (i * 8);
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+	put_le32(p, v);
+	put_le32(p + 4, v >> 32);
+}
+
+void sim_debug_socket_open(const char *spec)
+{
+	union {
+		struct sockaddr_in in;
+		struct sockaddr_un un;
+	} addr;
+	socklen_t addr_len;
 	int opt, rc, flags;
 
 	if (fd >= 0 || fd < -1)
 		return;
 
+	if (!spec)
+		spec = getenv("SIM_DEBUG_SOCKET");
+
 	signal(SIGPIPE, SIG_IGN);
-	fd = socket(AF_INET, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	if (spec && !strncmp(spec, "unix:", 5)) {
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		addr.un.sun_family = AF_UNIX;
+		strncpy(addr.un.sun_path, spec + 5, sizeof(addr.un.sun_path) - 1);
+		addr_len = sizeof(addr.un);
+		unlink(addr.un.sun_path);
+	} else {
+		fd = socket(AF_INET, SOCK_STREAM, 0);
+		addr.in.sin_family = AF_INET;
+		addr.in.sin_port = htons(spec ? atoi(spec) : DEFAULT_PORT);
+		addr.in.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr_len = sizeof(addr.in);
+	}
 	if (fd < 0) {
 		fprintf(stderr, "Failed to open debug socket !\r\n");
 		goto fail;
@@ -41,18 +167,14 @@ static void open_socket(void)
 		fprintf(stderr, "Failed to configure debug socket !\r\n");
 	}
 
-	memset(&addr, 0, sizeof(addr));
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(TCP_PORT);
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
 	opt = 1;
 	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-	rc = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+	rc = bind(fd, (struct sockaddr *)&addr, addr_len);
 	if (rc < 0) {
 		fprintf(stderr, "Failed to bind debug socket !\r\n");
 		goto fail;
 	}
-	rc = listen(fd,1);
+	rc = listen(fd, MAX_CLIENTS);
 	if (rc < 0) {
 		fprintf(stderr, "Failed to listen to debug socket !\r\n");
 		goto fail;
@@ -65,110 +187,458 @@ fail:
 	fd = -2;
 }
 
+bool sim_debug_socket_connected(void)
+{
+	return nr_clients != 0;
+}
+
 static void check_connection(void)
 {
-	struct sockaddr_in addr;
-	socklen_t addr_len = sizeof(addr);
+	struct client *c;
+	int cfd;
+
+	while (nr_clients < MAX_CLIENTS) {
+		cfd = accept(fd, NULL, NULL);
+		if (cfd < 0)
+			return;
+		c = &clients[nr_clients++];
+		memset(c, 0, sizeof(*c));
+		c->fd = cfd;
+		fprintf(stdout, "Debug client connected !\r\n");
+	}
+}
+
+static void disconnect(struct client *c)
+{
+	close(c->fd);
+	free(c->buf);
+	*c = clients[--nr_clients];
+	fprintf(stdout, "Debug client disconnected !\r\n");
+}
+
+static bool fill(struct client *c)
+{
+	ssize_t rc;
+
+	if (c->size - c->len < MAX_PACKET) {
+		c->size = c->size ? c->size * 2 : 4096;
+		c->buf = (uint8_t *)realloc(c->buf, c->size);
+		if (!c->buf) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+
+	rc = read(c->fd, c->buf + c->len, c->size - c->len);
+	if (rc < 0)
+		fprintf(stderr, "Debug read error, assuming client disconnected !\r\n");
+	if (rc <= 0)
+		return false;
+	c->len += rc;
+	return true;
+}
+
+static bool is_scan(const uint8_t *buf)
+{
+	return buf[0] != 0 && buf[0] < 248;
+}
+
+/*
+ * Length of the packet at the start of the buffer, 0 if incomplete or
+ * -1 if the client is sending something we can't follow
+ */
+static long packet_len(struct client *c)
+{
+	unsigned long len;
+
+	if (!c->len)
+		return 0;
+
+	if (c->buf[0] != DMI_FRAME_MAGIC) {
+		/* A JTAG reset or nonsense is dropped a byte at a time */
+		if (!is_scan(c->buf))
+			return 1;
+		len = 1 + (c->buf[0] + 7) / 8;
+		return c->len >= len ? len : 0;
+	}
+
+	if (c->len < DMI_FRAME_HDR)
+		return 0;
+	if (get_le32(c->buf + 4) > MAX_FRAME)
+		return -1;
+	len = DMI_FRAME_HDR + get_le32(c->buf + 4);
+	if (len > c->size) {
+		c->size = len;
+		c->buf = (uint8_t *)realloc(c->buf, c->size);
+		if (!c->buf) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	return c->len >= len ? len : 0;
+}
+
+static void send_all(const uint8_t *buf, unsigned long len)
+{
+	while (len) {
+		ssize_t rc = write(cur->fd, buf, len);
+
+		if (rc < 0 && errno == EINTR)
+			continue;
+		if (rc <= 0) {
+			fprintf(stderr, "Debug write error, ignoring\r\n");
+			return;
+		}
+		buf += rc;
+		len -= rc;
+	}
+}
+
+static void finish_packet(void)
+{
+	memmove(cur->buf, cur->buf + cur_len, cur->len - cur_len);
+	cur->len -= cur_len;
+	cur = NULL;
+}
+
+/* Check a frame's operations before running any of them */
+static bool frame_valid(const uint8_t *p, const uint8_t *end,
+			unsigned long *nr_reads)
+{
+	uint32_t count;
+
+	*nr_reads = 0;
+	while (p < end) {
+		switch (p[0]) {
+		case DMI_FRAME_READ:
+			(*nr_reads)++;
+			p += 2;
+			break;
+		case DMI_FRAME_WRITE:
+			p += 10;
+			break;
+		case DMI_FRAME_READ_BLOCK:
+			if (end - p < 6)
+				return false;
+			*nr_reads += get_le32(p + 2);
+			p += 6;
+			break;
+		case DMI_FRAME_WRITE_BLOCK:
+			if (end - p < 6)
+				return false;
+			count = get_le32(p + 2);
+			if ((unsigned long)(end - p - 6) / 8 < count)
+				return false;
+			p += 6 + (unsigned long)count * 8;
+			break;
+		default:
+			return false;
+		}
+		/* The reply is held to the same size as a request */
+		if (*nr_reads > MAX_FRAME / 8)
+			return false;
+	}
+	return p == end;
+}
+
+static void frame_reply(void)
+{
+	uint8_t hdr[DMI_FRAME_HDR];
 
-	cfd = accept(fd, (struct sockaddr *)&addr, &addr_len);
-	if (cfd < 0)
+	memset(hdr, 0, sizeof(hdr));
+	hdr[0] = DMI_FRAME_MAGIC;
+	hdr[1] = frame_status;
+	put_le32(hdr + 4, results_len);
+	send_all(hdr, sizeof(hdr));
+	send_all(results, results_len);
+	finish_packet();
+}
+
+static void frame_start(void)
+{
+	unsigned long nr_reads;
+
+	op_p = cur->buf + DMI_FRAME_HDR;
+	op_end = cur->buf + cur_len;
+	op_count = 0;
+	op_pending = false;
+	results_len = 0;
+	frame_status = DMI_FRAME_OK;
+
+	if (!frame_valid(op_p, op_end, &nr_reads)) {
+		frame_status = DMI_FRAME_EBADOP;
+		op_p = op_end;
 		return;
-	fprintf(stdout, "Debug client connected !\r\n");
+	}
+
+	if (nr_reads * 8 > results_size) {
+		results_size = nr_reads * 8;
+		results = (uint8_t *)realloc(results, results_size);
+		if (!results) {
+			perror("realloc");
+			exit(1);
+		}
+	}
 }
 
-void sim_jtag_read_msg(unsigned char *out_msg, unsigned char *out_size)
+/* The next DMI access in the frame, false at the end */
+static bool frame_next(uint8_t *addr, uint64_t *data)
 {
-	unsigned char data[MAX_PACKET];
-	unsigned char size = 0;
-	struct pollfd fdset[1];
-	int rc, i;
+	if (!op_count) {
+		if (op_p >= op_end)
+			return false;
+		op_type = op_p[0];
+		op_addr = op_p[1];
+		op_count = 1;
+		if (op_type == DMI_FRAME_READ_BLOCK ||
+		    op_type == DMI_FRAME_WRITE_BLOCK) {
+			op_count = get_le32(op_p + 2);
+			op_p += 6;
+		} else {
+			op_p += 2;
+		}
+		if (!op_count)
+			return frame_next(addr, data);
+	}
+
+	op_count--;
+	*addr = op_addr;
+	*data = 0;
+	if (op_type == DMI_FRAME_WRITE || op_type == DMI_FRAME_WRITE_BLOCK) {
+		*data = get_le64(op_p);
+		op_p += 8;
+	}
+	return true;
+}
+
+static bool next_packet(void)
+{
+	struct pollfd fdset[MAX_CLIENTS + 1];
+	unsigned int i, n;
 
 	if (fd == -1)
-		open_socket();
+		sim_debug_socket_open(NULL);
 	if (fd < 0)
-		goto finish;
-	if (cfd < 0)
-		check_connection();
-	if (cfd < 0)
-		goto finish;
+		return false;
 
 	memset(fdset, 0, sizeof(fdset));
-	fdset[0].fd = cfd;
+	fdset[0].fd = fd;
 	fdset[0].events = POLLIN;
-	rc = poll(fdset, 1, 0);
-	if (rc <= 0)
-		goto finish;
-	rc = read(cfd, data, MAX_PACKET);
-	if (rc < 0)
-		fprintf(stderr, "Debug read error, assuming client disconnected !\r\n");
-	if (rc == 0)
-		fprintf(stdout, "Debug client disconnected !\r\n");
-	if (rc <= 0) {
-		close(cfd);
-		cfd = -1;
-		goto finish;
+	for (i = 0; i < nr_clients; i++) {
+		fdset[i + 1].fd = clients[i].fd;
+		fdset[i + 1].events = POLLIN;
+	}
+	if (poll(fdset, nr_clients + 1, 0) > 0) {
+		/* Backwards, as disconnect() moves the last client down */
+		for (i = nr_clients; i > 0; i--) {
+			if (fdset[i].revents && !fill(&clients[i - 1]))
+				disconnect(&clients[i - 1]);
+		}
+		if (fdset[0].revents)
+			check_connection();
 	}
 
-#if 0
-	fprintf(stderr, "Got message:\n\r");
-	{
-		for (i=0; i<rc; i++)
-			fprintf(stderr, "%02x ", data[i]);
-		fprintf(stderr, "\n\r");
+	for (n = 0; n < nr_clients; n++) {
+		struct client *c = &clients[(next_client + n) % nr_clients];
+		long len = packet_len(c);
+
+		if (len < 0) {
+			fprintf(stderr, "Debug frame too big, disconnecting client\r\n");
+			disconnect(c);
+			return false;
+		}
+		if (!len)
+			continue;
+		next_client = (next_client + n + 1) % nr_clients;
+		cur = c;
+		cur_len = len;
+		if (c->buf[0] != DMI_FRAME_MAGIC && !is_scan(c->buf)) {
+			/* Nothing to reply */
+			finish_packet();
+			continue;
+		}
+		scan_issued = false;
+		if (c->buf[0] == DMI_FRAME_MAGIC)
+			frame_start();
+		return true;
 	}
-#endif
-	size = data[0]; /* Size in bits */
 
-	/* Special sizes */
-	if (size == 255) {
-		/* JTAG reset, message to translate */
-		goto finish;
+	return false;
+}
+
+/*
+ * Returns the next thing to do: nothing, a DTM scan of len bytes into
+ * msg, or a DMI read or write. A scan is answered with
+ * sim_debug_socket_reply(), a DMI access with sim_debug_socket_done().
+ */
+int sim_debug_socket_next(uint8_t *msg, unsigned int *len, uint8_t *addr,
+			  uint64_t *data)
+{
+	if (!cur && !next_packet())
+		return DMI_REQ_NOP;
+
+	if (cur->buf[0] != DMI_FRAME_MAGIC) {
+		if (scan_issued)
+			return DMI_REQ_NOP;
+		scan_issued = true;
+		*len = cur_len;
+		memcpy(msg, cur->buf, cur_len);
+		return DMI_SCAN;
+	}
+
+	if (op_pending)
+		return DMI_REQ_NOP;
+
+	if (frame_status != DMI_FRAME_OK || !frame_next(addr, data)) {
+		frame_reply();
+		return DMI_REQ_NOP;
 	}
 
-	if (((rc - 1) * 8) < size) {
-		fprintf(stderr, "Debug short read: %d bytes for %d bits, truncating\r\n",
-			rc - 1, size);
-		size = (rc - 1) * 8;
+	op_pending = true;
+	if (op_type == DMI_FRAME_READ || op_type == DMI_FRAME_READ_BLOCK)
+		return DMI_REQ_RD;
+	return DMI_REQ_WR;
+}
+
+void sim_debug_socket_reply(const uint8_t *msg, unsigned int len)
+{
+	send_all(msg, len);
+	finish_packet();
+}
+
+void sim_debug_socket_done(bool ok, uint64_t data)
+{
+	op_pending = false;
+	if (!ok) {
+		frame_status = DMI_FRAME_EDMI;
+		return;
+	}
+	if (op_type == DMI_FRAME_READ || op_type == DMI_FRAME_READ_BLOCK) {
+		put_le64(results + results_len, data);
+		results_len += 8;
+	}
+}
+
+/*
+ * core_tb: sim_jtag.vhdl asks for a scan to clock through the DTM and
+ * hands back what came out. A DMI access from a frame is a command scan
+ * followed by status scans until the DTM is no longer busy, the last of
+ * which has the read data.
+ */
+enum {
+	JTAG_IDLE,
+	JTAG_SCAN,
+	JTAG_CMD,
+	JTAG_STATUS,
+};
+
+static int jtag_state = JTAG_IDLE;
+
+static void add_bits(uint8_t *buf, unsigned int *pos, uint64_t d,
+		     unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++, (*pos)++) {
+		if (d & (1ULL << i))
+			buf[*pos / 8] |= 1 << (*pos % 8);
 	}
+}
+
+static uint64_t get_bits(const uint8_t *buf, unsigned int *pos,
+			 unsigned int count)
+{
+	uint64_t d = 0;
 
+	for (unsigned int i = 0; i < count; i++, (*pos)++) {
+		if (buf[*pos / 8] & (1 << (*pos % 8)))
+			d |= 1ULL << i;
+	}
+	return d;
+}
+
+static void make_scan(uint8_t *msg, uint64_t op, uint8_t addr, uint64_t data)
+{
+	unsigned int pos = 0;
+
+	memset(msg, 0, MAX_PACKET);
+	msg[0] = SCAN_BITS;
+	add_bits(msg + 1, &pos, op, 2);
+	add_bits(msg + 1, &pos, data, 64);
+	add_bits(msg + 1, &pos, addr, 8);
+}
+
+void sim_jtag_read_msg(unsigned char *out_msg, unsigned char *out_size)
+{
+	uint8_t data[MAX_PACKET];
+	unsigned char size = 0;
+	unsigned int len = 0;
+	uint8_t addr;
+	uint64_t d;
+	int i, op;
+
+	switch (jtag_state) {
+	case JTAG_IDLE:
+		op = sim_debug_socket_next(data, &len, &addr, &d);
+		if (op == DMI_REQ_NOP)
+			goto finish;
+		if (op == DMI_SCAN) {
+			jtag_state = JTAG_SCAN;
+		} else {
+			make_scan(data, op, addr, d);
+			len = 1 + (SCAN_BITS + 7) / 8;
+			jtag_state = JTAG_CMD;
+		}
+		break;
+	case JTAG_STATUS:
+		make_scan(data, DMI_REQ_NOP, 0, 0);
+		len = 1 + (SCAN_BITS + 7) / 8;
+		break;
+	default:
+		goto finish;
+	}
+
+	size = data[0]; /* Size in bits */
 	for (i = 0; i < size; i++) {
 		int byte = i >> 3;
 		int bit = 1 << (i & 7);
 		out_msg[i] = (data[byte+1] & bit) ? vhpi1 : vhpi0;
 	}
 finish:
-	to_std_logic_vector(size, out_size, 8);
+	vhpi_set_bits(out_size, size, 8);
 }
 
 void sim_jtag_write_msg(unsigned char *in_msg, unsigned char *in_size)
 {
 	unsigned char data[MAX_PACKET];
 	unsigned char size;
-	int rc, i;
+	unsigned int pos = 0;
+	int i, status;
 
-	size = from_std_logic_vector(in_size, 8);
+	size = vhpi_get_bits(in_size, 8, NULL);
+	memset(data, 0, sizeof(data));
 	data[0] = size;
 	for (i = 0; i < size; i++) {
 		int byte = i >> 3;
 		int bit = 1 << (i & 7);
 		if (in_msg[i] == vhpi1)
 			data[byte+1] |= bit;
-		else
-			data[byte+1] &= ~bit;
 	}
-	rc = (size + 7) / 8;
 
-#if 0
-	fprintf(stderr, "Sending response:\n\r");
-	{
-		for (i=0; i<rc; i++)
-			fprintf(stderr, "%02x ", data[i]);
-		fprintf(stderr, "\n\r");
+	switch (jtag_state) {
+	case JTAG_SCAN:
+		sim_debug_socket_reply(data, 1 + (size + 7) / 8);
+		jtag_state = JTAG_IDLE;
+		break;
+	case JTAG_CMD:
+		/* Reports the previous request, which had completed */
+		jtag_state = JTAG_STATUS;
+		break;
+	case JTAG_STATUS:
+		status = get_bits(data + 1, &pos, 2);
+		if (status == DMI_RSP_BSY)
+			break;
+		sim_debug_socket_done(status == DMI_RSP_OK,
+				      get_bits(data + 1, &pos, 64));
+		jtag_state = JTAG_IDLE;
+		break;
 	}
-#endif
-
-	rc = write(cfd, data, rc);
-	if (rc < 0)
-		fprintf(stderr, "Debug write error, ignoring\r\n");
 }
-
@@ -93,7 +93,7 @@ begin
 		    if wb_cyc_in = '1' and wb_stb_in = '1' then
 			if wb_we_in = '1' then -- Write to register
 			    if wb_adr_in(11 downto 0) = x"000" then
-				sim_console_write(x"00000000000000" & wb_dat_in);
+				sim_console_write(0, x"00000000000000" & wb_dat_in);
 			    elsif wb_adr_in(11 downto 0) = x"018" then
 				sample_clk_divisor <= wb_dat_in;
 			    elsif wb_adr_in(11 downto 0) = x"020" then
@@ -104,10 +104,10 @@ begin
 			    wb_state <= WRITE_ACK;
 			else -- Read from register
 			    if wb_adr_in(11 downto 0) = x"008" then
-				sim_console_read(sim_tmp);
+				sim_console_read(0, sim_tmp);
 				wb_dat_out <= sim_tmp(7 downto 0);
 			    elsif wb_adr_in(11 downto 0) = x"010" then
-				sim_console_poll(sim_tmp);
+				sim_console_poll(0, sim_tmp);
 				wb_dat_out <= "00000" & sim_tmp(0) & '1' & not sim_tmp(0);
 			    elsif wb_adr_in(11 downto 0) = x"018" then
 				wb_dat_out <= sample_clk_divisor;
@@ -0,0 +1,73 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+package sim_profile_helpers is
+    function sim_profile_interval (cpu: integer) return integer;
+    attribute foreign of sim_profile_interval : function is "VHPIDIRECT sim_profile_interval";
+
+    -- Returns the number of cycles to the next sample
+    impure function sim_profile_sample (cpu: integer;
+                                        nia: std_ulogic_vector(63 downto 0);
+                                        lr: std_ulogic_vector(63 downto 0);
+                                        pr: std_ulogic) return integer;
+    attribute foreign of sim_profile_sample : function is "VHPIDIRECT sim_profile_sample_vhpi";
+end sim_profile_helpers;
+
+package body sim_profile_helpers is
+    function sim_profile_interval (cpu: integer) return integer is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_profile_interval;
+
+    impure function sim_profile_sample (cpu: integer;
+                                        nia: std_ulogic_vector(63 downto 0);
+                                        lr: std_ulogic_vector(63 downto 0);
+                                        pr: std_ulogic) return integer is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_profile_sample;
+end sim_profile_helpers;
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+library work;
+use work.sim_profile_helpers.all;
+
+-- Hands the address of the last executed instruction, LR and MSR[PR] of
+-- one core to sim_profile_c.c every so many cycles. The interval comes
+-- from the C side, 0 means profiling is off, and each sample returns a
+-- jittered wait until the next one. Only used when SIM is set.
+entity sim_core_profile is
+    generic (
+        CPU_INDEX : natural := 0
+        );
+    port (
+        clk : in std_ulogic;
+        rst : in std_ulogic;
+        nia : in std_ulogic_vector(63 downto 0);
+        lr  : in std_ulogic_vector(63 downto 0);
+        pr  : in std_ulogic
+        );
+end entity sim_core_profile;
+
+architecture behaviour of sim_core_profile is
+begin
+    sample: process(clk)
+        variable interval : integer := -1;
+        variable count : integer := 0;
+    begin
+        if rising_edge(clk) and rst = '0' then
+            if interval < 0 then
+                interval := sim_profile_interval(CPU_INDEX);
+                count := interval;
+            end if;
+            if interval > 0 then
+                count := count - 1;
+                if count <= 0 then
+                    count := sim_profile_sample(CPU_INDEX, nia, lr, pr);
+                end if;
+            end if;
+        end if;
+    end process;
+end architecture behaviour;
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sim_vhpi_c.h"
+
+/*
+ * PC sampling profiler. Every so many cycles each core's last executed
+ * instruction address, LR and MSR[PR] are counted in a hash table, which
+ * is written out at exit as a histogram for scripts/profile.py. LR lets
+ * it attribute samples in a leaf function to its caller. Shared by
+ * core_tb, through sim_profile.vhdl, and microwatt-verilator. core_tb
+ * looks at two environment variables:
+ *
+ * SIM_PROFILE=<n>		sample every n cycles on average
+ * SIM_PROFILE_FILE=<file>	histogram to write (default sim_profile.txt)
+ *
+ * The gap between samples is picked at random from n/2 to 3n/2 - 1
+ * cycles, so the samples don't lock on to a loop whose period divides n.
+ */
+
+#define DEFAULT_PROFILE_FILE	"sim_profile.txt"
+#define INITIAL_BUCKETS		4096
+
+struct bucket {
+	uint64_t nia;
+	uint64_t lr;
+	uint64_t count;
+	unsigned int cpu;
+	bool pr;
+	bool used;
+};
+
+static uint64_t interval;
+static const char *profile_file;
+static struct bucket *buckets;
+static unsigned long nr_buckets;
+static unsigned long nr_used;
+static uint64_t nr_samples;
+static uint64_t rand_state = 0x9e3779b97f4a7c15ULL;
+
+static unsigned long hash(uint64_t nia, uint64_t lr, unsigned int cpu,
+			  bool pr)
+{
+	uint64_t h = (nia >> 2) ^ (lr << 30) ^ (lr >> 34) ^
+		((uint64_t)cpu << 48) ^ ((uint64_t)pr << 63);
+
+	h *= 0x9e3779b97f4a7c15ULL;
+	return h >> 20;
+}
+
+static struct bucket *lookup(struct bucket *table, unsigned long size,
+			     uint64_t nia, uint64_t lr, unsigned int cpu,
+			     bool pr)
+{
+	unsigned long i = hash(nia, lr, cpu, pr) & (size - 1);
+
+	while (table[i].used &&
+	       (table[i].nia != nia || table[i].lr != lr ||
+		table[i].cpu != cpu || table[i].pr != pr))
+		i = (i + 1) & (size - 1);
+
+	return &table[i];
+}
+
+static void grow(void)
+{
+	unsigned long size = nr_buckets ? nr_buckets * 2 : INITIAL_BUCKETS;
+	struct bucket *table;
+
+	table = (struct bucket *)calloc(size, sizeof(*table));
+	if (!table) {
+		perror("calloc");
+		exit(1);
+	}
+
+	for (unsigned long i = 0; i < nr_buckets; i++) {
+		struct bucket *b = &buckets[i];
+
+		if (b->used)
+			*lookup(table, size, b->nia, b->lr, b->cpu, b->pr) = *b;
+	}
+
+	free(buckets);
+	buckets = table;
+	nr_buckets = size;
+}
+
+static int compare_count(const void *a, const void *b)
+{
+	const struct bucket *x = (const struct bucket *)a;
+	const struct bucket *y = (const struct bucket *)b;
+
+	if (x->used != y->used)
+		return x->used ? -1 : 1;
+	if (x->count != y->count)
+		return x->count > y->count ? -1 : 1;
+	return x->nia < y->nia ? -1 : x->nia > y->nia;
+}
+
+static void sim_profile_write(void)
+{
+	FILE *f;
+
+	f = fopen(profile_file, "w");
+	if (!f) {
+		perror(profile_file);
+		return;
+	}
+
+	/* The table isn't used after this, so sort it in place */
+	qsort(buckets, nr_buckets, sizeof(*buckets), compare_count);
+
+	fprintf(f, "# microwatt profile: %llu samples, every %llu cycles on average\n",
+		(unsigned long long)nr_samples, (unsigned long long)interval);
+	fprintf(f, "# cpu pr nia lr count\n");
+	for (unsigned long i = 0; i < nr_used; i++)
+		fprintf(f, "%u %d 0x%016llx 0x%016llx %llu\n", buckets[i].cpu,
+			buckets[i].pr, (unsigned long long)buckets[i].nia,
+			(unsigned long long)buckets[i].lr,
+			(unsigned long long)buckets[i].count);
+	fclose(f);
+
+	fprintf(stderr, "profile: %llu samples written to %s\r\n",
+		(unsigned long long)nr_samples, profile_file);
+}
+
+void sim_profile_enable(uint64_t every, const char *file)
+{
+	interval = every;
+	profile_file = file ? file : DEFAULT_PROFILE_FILE;
+	grow();
+	atexit(sim_profile_write);
+}
+
+/* Cycles to the next sample, n/2 to 3n/2 - 1 */
+uint64_t sim_profile_next(void)
+{
+	/* xorshift64, so that runs are repeatable */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 7;
+	rand_state ^= rand_state << 17;
+	return interval - interval / 2 + rand_state % interval;
+}
+
+void sim_profile_sample(unsigned int cpu, uint64_t nia, uint64_t lr, bool pr)
+{
+	struct bucket *b;
+
+	/* Keep the table at most half full */
+	if (2 * (nr_used + 1) > nr_buckets)
+		grow();
+
+	b = lookup(buckets, nr_buckets, nia, lr, cpu, pr);
+	if (!b->used) {
+		b->used = true;
+		b->nia = nia;
+		b->lr = lr;
+		b->cpu = cpu;
+		b->pr = pr;
+		nr_used++;
+	}
+	b->count++;
+	nr_samples++;
+}
+
+/* VHPI entries from sim_profile.vhdl */
+int sim_profile_interval(int cpu)
+{
+	static int every = -1;
+
+	if (every < 0) {
+		const char *s = getenv("SIM_PROFILE");
+
+		every = s ? strtol(s, NULL, 0) : 0;
+		if (every > 0)
+			sim_profile_enable(every, getenv("SIM_PROFILE_FILE"));
+		else
+			every = 0;
+	}
+
+	return every;
+}
+
+int sim_profile_sample_vhpi(int cpu, unsigned char *nia, unsigned char *lr,
+			    unsigned char pr)
+{
+	sim_profile_sample(cpu, vhpi_get_bits(nia, 64, NULL),
+			   vhpi_get_bits(lr, 64, NULL), pr == vhpi1);
+	return sim_profile_next();
+}
@@ -0,0 +1,59 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+package sim_stats_helpers is
+    function sim_stats_enabled (cpu: integer) return integer;
+    attribute foreign of sim_stats_enabled : function is "VHPIDIRECT sim_stats_enabled";
+
+    procedure sim_stats_cycle (cpu: integer; instr_complete: std_ulogic);
+    attribute foreign of sim_stats_cycle : procedure is "VHPIDIRECT sim_stats_cycle";
+end sim_stats_helpers;
+
+package body sim_stats_helpers is
+    function sim_stats_enabled (cpu: integer) return integer is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_stats_enabled;
+
+    procedure sim_stats_cycle (cpu: integer; instr_complete: std_ulogic) is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_stats_cycle;
+end sim_stats_helpers;
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+library work;
+use work.sim_stats_helpers.all;
+
+-- Counts cycles and completed instructions for one core so sim_stats_c.c
+-- can report how fast the simulation runs. The C side is asked once
+-- whether stats are on, and isn't called again if not. Only used when SIM
+-- is set.
+entity sim_core_stats is
+    generic (
+        CPU_INDEX : natural := 0
+        );
+    port (
+        clk            : in std_ulogic;
+        rst            : in std_ulogic;
+        instr_complete : in std_ulogic
+        );
+end entity sim_core_stats;
+
+architecture behaviour of sim_core_stats is
+begin
+    count: process(clk)
+        variable enabled : integer := -1;
+    begin
+        if rising_edge(clk) and rst = '0' then
+            if enabled < 0 then
+                enabled := sim_stats_enabled(CPU_INDEX);
+            end if;
+            if enabled > 0 then
+                sim_stats_cycle(CPU_INDEX, instr_complete);
+            end if;
+        end if;
+    end process;
+end architecture behaviour;
@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sim_vhpi_c.h"
+
+/*
+ * Simulation speed statistics: simulated cycles, completed instructions
+ * and wall time. Shared by core_tb, which feeds it through VHPI (see
+ * sim_stats.vhdl), and microwatt-verilator. Nothing is printed unless
+ * enabled; core_tb looks at two environment variables:
+ *
+ * SIM_STATS=<n>	report on stderr every n cycles (0 for only at exit)
+ * SIM_STATS_JSON=<file>	write a summary as JSON at exit
+ */
+
+#define MAX_CPUS 32
+
+struct sample {
+	double wall;
+	uint64_t cycles;
+	uint64_t instrs;
+};
+
+static bool started;
+static uint64_t interval;
+static uint64_t next_report;
+static const char *json_file;
+static unsigned int ncpus;
+static uint64_t cycles;
+static uint64_t instrs[MAX_CPUS];
+static uint64_t base_instrs[MAX_CPUS];
+static bool seen[MAX_CPUS];
+static struct sample start, last;
+
+static double wall_time(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t total_instrs(void)
+{
+	uint64_t total = 0;
+
+	for (unsigned int i = 0; i < ncpus; i++)
+		total += instrs[i] - base_instrs[i];
+	return total;
+}
+
+static struct sample now(void)
+{
+	struct sample s;
+
+	s.wall = wall_time();
+	s.cycles = cycles;
+	s.instrs = total_instrs();
+	return s;
+}
+
+static void print_rates(const char *what, struct sample *from,
+			struct sample *to)
+{
+	double wall = to->wall - from->wall;
+	uint64_t c = to->cycles - from->cycles;
+	uint64_t i = to->instrs - from->instrs;
+
+	if (wall <= 0)
+		wall = 1e-9;
+
+	fprintf(stderr, "%s: %llu cycles %llu instrs in %.2fs, %.3f MHz %.1f KIPS IPC %.3f\r\n",
+		what, (unsigned long long)c, (unsigned long long)i, wall,
+		c / wall / 1e6, i / wall / 1e3, c ? (double)i / c : 0.0);
+}
+
+static void write_json(struct sample *end)
+{
+	double wall = end->wall - start.wall;
+	uint64_t c = end->cycles - start.cycles;
+	uint64_t i = end->instrs - start.instrs;
+	FILE *f;
+
+	f = fopen(json_file, "w");
+	if (!f) {
+		perror(json_file);
+		return;
+	}
+
+	if (wall <= 0)
+		wall = 1e-9;
+
+	fprintf(f, "{\n");
+	fprintf(f, "  \"cycles\": %llu,\n", (unsigned long long)c);
+	fprintf(f, "  \"instructions\": %llu,\n", (unsigned long long)i);
+	fprintf(f, "  \"wall_seconds\": %.6f,\n", wall);
+	fprintf(f, "  \"mhz\": %.6f,\n", c / wall / 1e6);
+	fprintf(f, "  \"kips\": %.3f,\n", i / wall / 1e3);
+	fprintf(f, "  \"ipc\": %.6f,\n", c ? (double)i / c : 0.0);
+	fprintf(f, "  \"cpu_instructions\": [");
+	for (unsigned int n = 0; n < ncpus; n++)
+		fprintf(f, "%s%llu", n ? ", " : "",
+			(unsigned long long)(instrs[n] - base_instrs[n]));
+	fprintf(f, "]\n");
+	fprintf(f, "}\n");
+	fclose(f);
+}
+
+static void sim_stats_summary(void)
+{
+	struct sample end;
+
+	if (!started)
+		return;
+
+	end = now();
+	print_rates("stats total", &start, &end);
+	if (json_file)
+		write_json(&end);
+}
+
+void sim_stats_enable(uint64_t every, const char *json)
+{
+	interval = every;
+	json_file = json;
+	atexit(sim_stats_summary);
+}
+
+/* Instructions completed by a core so far */
+void sim_stats_instrs(unsigned int cpu, uint64_t count)
+{
+	if (cpu >= MAX_CPUS)
+		return;
+
+	if (!seen[cpu]) {
+		seen[cpu] = true;
+		base_instrs[cpu] = count;
+	}
+	instrs[cpu] = count;
+	if (cpu >= ncpus)
+		ncpus = cpu + 1;
+}
+
+/* Current simulated cycle, called every cycle */
+void sim_stats_tick(uint64_t cycle)
+{
+	cycles = cycle;
+
+	if (!started) {
+		started = true;
+		start = last = now();
+		next_report = cycle + interval;
+		return;
+	}
+
+	if (interval && cycle >= next_report) {
+		struct sample s = now();
+
+		print_rates("stats", &last, &s);
+		last = s;
+		next_report += interval;
+	}
+}
+
+/* VHPI entry from sim_stats.vhdl, asked once by each core */
+int sim_stats_enabled(int cpu)
+{
+	static int enabled = -1;
+
+	if (enabled < 0) {
+		const char *every = getenv("SIM_STATS");
+		const char *json = getenv("SIM_STATS_JSON");
+
+		enabled = every || json;
+		if (enabled)
+			sim_stats_enable(every ? strtoull(every, NULL, 0) : 0, json);
+	}
+
+	return enabled;
+}
+
+/* VHPI entry from sim_stats.vhdl, once per cycle for each core if enabled */
+void sim_stats_cycle(int cpu, unsigned char instr_complete)
+{
+	static uint64_t ghdl_cycles;
+	static uint64_t count[MAX_CPUS];
+
+	if (cpu < 0 || cpu >= MAX_CPUS)
+		return;
+
+	if (instr_complete == vhpi1)
+		count[cpu]++;
+	sim_stats_instrs(cpu, count[cpu]);
+
+	if (cpu == 0)
+		sim_stats_tick(++ghdl_cycles);
+}
@@ -0,0 +1,79 @@
+library ieee;
+use ieee.std_logic_1164.all;
+
+package sim_trace_helpers is
+    function sim_trace_enabled (event: integer) return integer;
+    attribute foreign of sim_trace_enabled : function is "VHPIDIRECT sim_trace_enabled";
+
+    procedure sim_trace_write (event: integer; cpu: integer;
+                               t: time; period: time;
+                               arg: std_ulogic_vector(63 downto 0);
+                               data: std_ulogic_vector(63 downto 0));
+    attribute foreign of sim_trace_write : procedure is "VHPIDIRECT sim_trace_write";
+end sim_trace_helpers;
+
+package body sim_trace_helpers is
+    function sim_trace_enabled (event: integer) return integer is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_trace_enabled;
+
+    procedure sim_trace_write (event: integer; cpu: integer;
+                               t: time; period: time;
+                               arg: std_ulogic_vector(63 downto 0);
+                               data: std_ulogic_vector(63 downto 0)) is
+    begin
+        assert false report "VHPI" severity failure;
+    end sim_trace_write;
+end sim_trace_helpers;
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+library work;
+use work.sim_trace_helpers.all;
+
+-- Passes arg and data to sim_trace_c.c as event EVENT (TRACE_* in
+-- common.vhdl) on every rising edge of clk where valid is set. Whether
+-- the event's category is wanted is asked once, so with tracing off
+-- this costs a test per cycle and nothing is formatted or written.
+-- The record's cycle is worked out from now and the clock period in
+-- sim_trace_c.c, so all units agree on it without sharing a counter.
+-- Only used when SIM is set.
+entity sim_trace_event is
+    generic (
+        EVENT     : natural;
+        CPU_INDEX : natural := 0
+        );
+    port (
+        clk   : in std_ulogic;
+        valid : in std_ulogic;
+        arg   : in std_ulogic_vector(63 downto 0);
+        data  : in std_ulogic_vector(63 downto 0)
+        );
+end entity sim_trace_event;
+
+architecture behaviour of sim_trace_event is
+begin
+    trace: process(clk)
+        variable enabled : integer := -1;
+        variable last_edge : time := 0 fs;
+        variable period : time := 0 fs;
+    begin
+        if rising_edge(clk) then
+            if enabled < 0 then
+                enabled := sim_trace_enabled(EVENT);
+            end if;
+            if enabled > 0 then
+                -- The period is known from the second edge on
+                if last_edge > 0 fs then
+                    period := now - last_edge;
+                end if;
+                last_edge := now;
+                if valid = '1' and period > 0 fs then
+                    sim_trace_write(EVENT, CPU_INDEX, now, period, arg, data);
+                end if;
+            end if;
+        end if;
+    end process;
+end architecture behaviour;
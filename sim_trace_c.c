@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "sim_vhpi_c.h"
+
+/*
+ * Binary trace of register file, CR, SPR, execute and RAM activity in
+ * core_tb, replacing the text reports those units used to print every
+ * cycle. The units hand raw values to sim_trace.vhdl, and the records
+ * are written here, unformatted, for scripts/sim_trace_decode.py to turn
+ * back into text. Controlled by two environment variables:
+ *
+ * SIM_TRACE=<categories>	comma separated list of gpr, cr, spr, exec,
+ *				ram or all, or a mask of them as a number
+ * SIM_TRACE_FILE=<file>	trace to write (default sim_trace.bin)
+ *
+ * The file starts with TRACE_MAGIC. Each record is the event and CPU
+ * numbers as a byte each, then the cycles since the previous record,
+ * arg and data as LEB128 varints.
+ *
+ * The cycle is the simulation time over the clock period, both as GHDL
+ * passes a time (a 64-bit count of its resolution unit), so it is the
+ * same for every unit on the clock and doesn't wrap.
+ */
+
+#define DEFAULT_TRACE_FILE	"sim_trace.bin"
+#define TRACE_MAGIC		"MWTRACE1"
+#define BUFFER_SIZE		(1024 * 1024)
+
+/* Event numbers, TRACE_* in common.vhdl */
+enum {
+	EV_GPR_WRITE = 1,
+	EV_GPR_READ,
+	EV_CR_WRITE,
+	EV_XERC_WRITE,
+	EV_CR_READ,
+	EV_SPR_WRITE,
+	EV_EXECUTE,
+	EV_RAM_WRITE,
+	EV_RAM_READ,
+	NR_EVENTS
+};
+
+#define CAT_GPR		0x01
+#define CAT_CR		0x02
+#define CAT_SPR		0x04
+#define CAT_EXEC	0x08
+#define CAT_RAM		0x10
+
+static const unsigned int event_category[NR_EVENTS] = {
+	[EV_GPR_WRITE]	= CAT_GPR,
+	[EV_GPR_READ]	= CAT_GPR,
+	[EV_CR_WRITE]	= CAT_CR,
+	[EV_XERC_WRITE]	= CAT_CR,
+	[EV_CR_READ]	= CAT_CR,
+	[EV_SPR_WRITE]	= CAT_SPR,
+	[EV_EXECUTE]	= CAT_EXEC,
+	[EV_RAM_WRITE]	= CAT_RAM,
+	[EV_RAM_READ]	= CAT_RAM,
+};
+
+static const struct {
+	const char *name;
+	unsigned int mask;
+} categories[] = {
+	{ "gpr", CAT_GPR },
+	{ "cr", CAT_CR },
+	{ "spr", CAT_SPR },
+	{ "exec", CAT_EXEC },
+	{ "ram", CAT_RAM },
+	{ "all", ~0U },
+};
+
+static bool initialized;
+static unsigned int mask;
+static FILE *trace;
+static uint64_t last_cycle;
+static uint64_t nr_records;
+
+static unsigned int parse_mask(const char *s)
+{
+	unsigned int m;
+	char *end;
+
+	m = strtoul(s, &end, 0);
+	if (*s && !*end)
+		return m;
+
+	m = 0;
+	while (*s) {
+		size_t len = strcspn(s, ",");
+		unsigned int i;
+
+		for (i = 0; i < sizeof(categories) / sizeof(categories[0]); i++) {
+			if (strlen(categories[i].name) == len &&
+			    !strncmp(s, categories[i].name, len))
+				break;
+		}
+		if (i < sizeof(categories) / sizeof(categories[0]))
+			m |= categories[i].mask;
+		else
+			fprintf(stderr, "SIM_TRACE: unknown category %.*s\n",
+				(int)len, s);
+
+		s += len;
+		if (*s)
+			s++;
+	}
+
+	return m;
+}
+
+static void sim_trace_close(void)
+{
+	fclose(trace);
+	fprintf(stderr, "trace: %llu records\n", (unsigned long long)nr_records);
+}
+
+static void sim_trace_open(void)
+{
+	const char *file = getenv("SIM_TRACE_FILE");
+
+	if (!file)
+		file = DEFAULT_TRACE_FILE;
+
+	trace = fopen(file, "wb");
+	if (!trace) {
+		perror(file);
+		exit(1);
+	}
+	setvbuf(trace, NULL, _IOFBF, BUFFER_SIZE);
+	fwrite(TRACE_MAGIC, 1, strlen(TRACE_MAGIC), trace);
+	atexit(sim_trace_close);
+}
+
+static inline void put_varint(uint64_t v)
+{
+	while (v >= 0x80) {
+		putc_unlocked((v & 0x7f) | 0x80, trace);
+		v >>= 7;
+	}
+	putc_unlocked(v, trace);
+}
+
+/* VHPI entries from sim_trace.vhdl */
+int sim_trace_enabled(int event)
+{
+	if (!initialized) {
+		const char *s = getenv("SIM_TRACE");
+
+		initialized = true;
+		mask = s ? parse_mask(s) : 0;
+		if (mask)
+			sim_trace_open();
+	}
+
+	if (event <= 0 || event >= NR_EVENTS)
+		return 0;
+
+	return (mask & event_category[event]) != 0;
+}
+
+void sim_trace_write(int event, int cpu, int64_t t, int64_t period,
+		     unsigned char *arg, unsigned char *data)
+{
+	uint64_t cycle = t / period;
+	uint64_t delta = cycle - last_cycle;
+
+	last_cycle = cycle;
+
+	putc_unlocked(event, trace);
+	putc_unlocked(cpu, trace);
+	put_varint(delta);
+	/* Metavalues read as 0, they aren't worth a warning in a trace */
+	put_varint(vhpi_get_bits(arg, 64, NULL));
+	put_varint(vhpi_get_bits(data, 64, NULL));
+	nr_records++;
+}
@@ -39,28 +39,17 @@ char *from_string(void *__p)
 
 uint64_t from_std_logic_vector(unsigned char *p, unsigned long len)
 {
-	unsigned long ret = 0;
+	bool meta = false;
+	uint64_t ret;
 
 	if (len > 64) {
 		fprintf(stderr, "%s: invalid length %lu\n", __func__, len);
 		exit(1);
 	}
 
-	for (unsigned long i = 0; i < len; i++) {
-		unsigned char bit;
-
-		if (*p == vhpi0) {
-			bit = 0;
-		} else if (*p == vhpi1) {
-			bit = 1;
-		} else {
-			fprintf(stderr, "%s: bad bit %d\n", __func__, *p);
-			bit = 0;
-		}
-
-		ret = (ret << 1) | bit;
-		p++;
-	}
+	ret = vhpi_get_bits(p, len, &meta);
+	if (meta)
+		fprintf(stderr, "%s: metavalue in %lu bit vector\n", __func__, len);
 
 	return ret;
 }
@@ -73,12 +62,5 @@ void to_std_logic_vector(unsigned long val, unsigned char *p,
 		exit(1);
 	}
 
-	for (unsigned long i = 0; i < len; i++) {
-		if ((val >> (len-1-i) & 1))
-			*p = vhpi1;
-		else
-			*p = vhpi0;
-
-		p++;
-	}
+	vhpi_set_bits(p, val, len);
 }
@@ -1,11 +1,143 @@
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
 
 #define vhpi0	2	/* forcing 0 */
 #define vhpi1	3	/* forcing 1 */
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 char *from_string(void *__p);
 
 uint64_t from_std_logic_vector(unsigned char *p, unsigned long len);
 
 void to_std_logic_vector(unsigned long val, unsigned char *p,
 			 unsigned long len);
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * GHDL passes a std_ulogic_vector as one byte per bit, leftmost (MSB)
+ * first. These convert 8 bits at a time: '0' and '1' differ only in
+ * bit 0, so the low bits of eight bytes are gathered into a byte with
+ * one multiply, and spread back out the same way. Anything other than
+ * '0' or '1' (U, X, Z, W, L, H, -) reads as 0 and sets *meta, for the
+ * caller to complain about once rather than per bit. They are inline so
+ * that helpers shared with microwatt-verilator needn't link
+ * sim_vhpi_c.c, and work in C and C++.
+ */
+#define VHPI_LSB_BYTES	0x0101010101010101ULL
+#define VHPI_ZERO_BYTES	0x0202020202020202ULL
+#define VHPI_GATHER	0x8040201008040201ULL
+
+static inline uint64_t vhpi_load8(const unsigned char *p)
+{
+	uint64_t x;
+
+	memcpy(&x, p, sizeof(x));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	x = __builtin_bswap64(x);
+#endif
+	return x;
+}
+
+static inline void vhpi_store8(unsigned char *p, uint64_t x)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	x = __builtin_bswap64(x);
+#endif
+	memcpy(p, &x, sizeof(x));
+}
+
+/* Eight std_ulogics to a byte, the first one in bit 7 */
+static inline unsigned int vhpi_get8(const unsigned char *p, uint64_t *bad)
+{
+	uint64_t x = vhpi_load8(p);
+
+	*bad |= (x & ~VHPI_LSB_BYTES) ^ VHPI_ZERO_BYTES;
+	return ((x & VHPI_LSB_BYTES) * VHPI_GATHER) >> 56;
+}
+
+static inline void vhpi_set8(unsigned char *p, unsigned int v)
+{
+	uint64_t x = (((v & 0xff) * VHPI_GATHER) >> 7) & VHPI_LSB_BYTES;
+
+	vhpi_store8(p, x | VHPI_ZERO_BYTES);
+}
+
+/* Up to 64 bits */
+static inline uint64_t vhpi_get_bits(const unsigned char *p, unsigned int len,
+				     bool *meta)
+{
+	uint64_t val = 0, bad = 0;
+	unsigned int i;
+
+	for (i = 0; i < len % 8; i++) {
+		bad |= (p[i] & ~1) ^ vhpi0;
+		val = (val << 1) | (p[i] & 1);
+	}
+	for (; i < len; i += 8)
+		val = (val << 8) | vhpi_get8(p + i, &bad);
+
+	/* Keep metavalues from turning into ones */
+	if (bad) {
+		val = 0;
+		for (i = 0; i < len; i++)
+			val = (val << 1) | (p[i] == vhpi1);
+		if (meta)
+			*meta = true;
+	}
+
+	return val;
+}
+
+static inline void vhpi_set_bits(unsigned char *p, uint64_t val,
+				 unsigned int len)
+{
+	unsigned int i;
+
+	for (i = 0; i < len % 8; i++)
+		p[i] = (val >> (len - 1 - i)) & 1 ? vhpi1 : vhpi0;
+	for (; i < len; i += 8)
+		vhpi_set8(p + i, val >> (len - 8 - i));
+}
+
+/*
+ * Any width, as 64 bit words with the least significant in val[0], so
+ * the vector's rightmost bit is bit 0 of val[0]. Returns true if there
+ * were metavalues.
+ */
+static inline bool vhpi_get_wide(const unsigned char *p, unsigned long len,
+				 uint64_t *val)
+{
+	unsigned long words = (len + 63) / 64;
+	unsigned int top = len - (words - 1) * 64;
+	bool meta = false;
+
+	for (unsigned long w = 0; w < words; w++) {
+		unsigned int n = w ? 64 : top;
+
+		val[words - 1 - w] = vhpi_get_bits(p, n, &meta);
+		p += n;
+	}
+
+	return meta;
+}
+
+static inline void vhpi_set_wide(unsigned char *p, const uint64_t *val,
+				 unsigned long len)
+{
+	unsigned long words = (len + 63) / 64;
+	unsigned int top = len - (words - 1) * 64;
+
+	for (unsigned long w = 0; w < words; w++) {
+		unsigned int n = w ? 64 : top;
+
+		vhpi_set_bits(p, val[words - 1 - w], n);
+		p += n;
+	}
+}
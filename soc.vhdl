@@ -72,6 +72,9 @@ entity soc is
         NCPUS              : positive := 1;
         HAS_FPU            : boolean := true;
         HAS_BTC            : boolean := true;
+        HAS_TIME_SKIP      : boolean := false;
+        HAS_ICOUNT         : boolean := false;
+        HAS_NIA_TRIGGER    : boolean := false;
 	DISABLE_FLATTEN_CORE : boolean := false;
         ALT_RESET_ADDRESS  : std_logic_vector(63 downto 0) := (23 downto 0 => '0', others => '1');
 	HAS_DRAM           : boolean  := false;
@@ -244,6 +247,17 @@ architecture behaviour of soc is
     signal dmi_core_req   : std_ulogic_vector(NCPUS-1 downto 0);
     signal dmi_core_ack   : std_ulogic_vector(NCPUS-1 downto 0);
 
+    -- Behavioural RAM dump/snapshot commands, sim_bram.vhdl
+    component sim_ram_control is
+        port (
+            clk      : in std_ulogic;
+            dmi_addr : in std_ulogic_vector(7 downto 0);
+            dmi_din  : in std_ulogic_vector(63 downto 0);
+            dmi_req  : in std_ulogic;
+            dmi_wr   : in std_ulogic
+            );
+    end component;
+
     -- Delayed/latched resets and alt_reset
     signal rst_core    : std_ulogic_vector(NCPUS-1 downto 0);
     signal rst_uart    : std_ulogic;
@@ -338,6 +352,34 @@ architecture behaviour of soc is
         );
     end component;
 
+    -- The simulation model used in its place, sim_16550_uart.vhdl.
+    -- CHANNEL is the console it talks to: 0 for UART0, 1 for UART1.
+    component sim_16550_uart is
+        generic (
+            CHANNEL : natural := 0
+            );
+        port (
+            wb_clk_i    : in std_ulogic;
+            wb_rst_i    : in std_ulogic;
+            wb_adr_i    : in std_ulogic_vector(2 downto 0);
+            wb_dat_i    : in std_ulogic_vector(7 downto 0);
+            wb_dat_o    : out std_ulogic_vector(7 downto 0);
+            wb_we_i     : in std_ulogic;
+            wb_stb_i    : in std_ulogic;
+            wb_cyc_i    : in std_ulogic;
+            wb_ack_o    : out std_ulogic;
+            int_o       : out std_ulogic;
+            stx_pad_o   : out std_ulogic;
+            srx_pad_i   : in std_ulogic;
+            rts_pad_o   : out std_ulogic;
+            cts_pad_i   : in std_ulogic;
+            dtr_pad_o   : out std_ulogic;
+            dsr_pad_i   : in std_ulogic;
+            ri_pad_i    : in std_ulogic;
+            dcd_pad_i   : in std_ulogic
+            );
+    end component;
+
 begin
 
     -- either external reset, or from syscon
@@ -374,6 +416,9 @@ begin
             NCPUS => NCPUS,
             HAS_FPU => HAS_FPU,
             HAS_BTC => HAS_BTC,
+            HAS_TIME_SKIP => HAS_TIME_SKIP,
+            HAS_ICOUNT => HAS_ICOUNT,
+            HAS_NIA_TRIGGER => HAS_NIA_TRIGGER,
 	    DISABLE_FLATTEN => DISABLE_FLATTEN_CORE,
 	    ALT_RESET_ADDRESS => ALT_RESET_ADDRESS,
             LOG_LENGTH => LOG_LENGTH,
@@ -879,27 +924,55 @@ begin
     uart0_16550 : if UART0_IS_16550 generate
         signal irq_l : std_ulogic;
     begin
-	uart0: uart_top
-	    port map (
-		wb_clk_i   => system_clk,
-		wb_rst_i   => rst_uart,
-		wb_adr_i   => wb_uart0_in.adr(2 downto 0),
-		wb_dat_i   => wb_uart0_in.dat(7 downto 0),
-		wb_dat_o   => uart0_dat8,
-		wb_we_i    => wb_uart0_in.we,
-		wb_stb_i   => wb_uart0_in.stb,
-		wb_cyc_i   => wb_uart0_in.cyc,
-		wb_ack_o   => wb_uart0_out.ack,
-		int_o      => irq_l,
-		stx_pad_o  => uart0_txd,
-		srx_pad_i  => uart0_rxd,
-		rts_pad_o  => open,
-		cts_pad_i  => '1',
-		dtr_pad_o  => open,
-		dsr_pad_i  => '1',
-		ri_pad_i   => '0',
-		dcd_pad_i  => '1'
-		);
+	uart0_sim: if SIM generate
+	    uart0: sim_16550_uart
+		generic map (
+		    CHANNEL => 0
+		    )
+		port map (
+		    wb_clk_i   => system_clk,
+		    wb_rst_i   => rst_uart,
+		    wb_adr_i   => wb_uart0_in.adr(2 downto 0),
+		    wb_dat_i   => wb_uart0_in.dat(7 downto 0),
+		    wb_dat_o   => uart0_dat8,
+		    wb_we_i    => wb_uart0_in.we,
+		    wb_stb_i   => wb_uart0_in.stb,
+		    wb_cyc_i   => wb_uart0_in.cyc,
+		    wb_ack_o   => wb_uart0_out.ack,
+		    int_o      => irq_l,
+		    stx_pad_o  => uart0_txd,
+		    srx_pad_i  => uart0_rxd,
+		    rts_pad_o  => open,
+		    cts_pad_i  => '1',
+		    dtr_pad_o  => open,
+		    dsr_pad_i  => '1',
+		    ri_pad_i   => '0',
+		    dcd_pad_i  => '1'
+		    );
+	end generate;
+	uart0_hw: if not SIM generate
+	    uart0: uart_top
+		port map (
+		    wb_clk_i   => system_clk,
+		    wb_rst_i   => rst_uart,
+		    wb_adr_i   => wb_uart0_in.adr(2 downto 0),
+		    wb_dat_i   => wb_uart0_in.dat(7 downto 0),
+		    wb_dat_o   => uart0_dat8,
+		    wb_we_i    => wb_uart0_in.we,
+		    wb_stb_i   => wb_uart0_in.stb,
+		    wb_cyc_i   => wb_uart0_in.cyc,
+		    wb_ack_o   => wb_uart0_out.ack,
+		    int_o      => irq_l,
+		    stx_pad_o  => uart0_txd,
+		    srx_pad_i  => uart0_rxd,
+		    rts_pad_o  => open,
+		    cts_pad_i  => '1',
+		    dtr_pad_o  => open,
+		    dsr_pad_i  => '1',
+		    ri_pad_i   => '0',
+		    dcd_pad_i  => '1'
+		    );
+	end generate;
 
         -- Add a register on the irq out, helps timing
         uart0_irq_latch: process(system_clk)
@@ -921,27 +994,55 @@ begin
     uart1_16550: if HAS_UART1 generate
         signal irq_l : std_ulogic;
     begin
-	uart1: uart_top
-	    port map (
-		wb_clk_i   => system_clk,
-		wb_rst_i   => rst_uart,
-		wb_adr_i   => wb_uart1_in.adr(2 downto 0),
-		wb_dat_i   => wb_uart1_in.dat(7 downto 0),
-		wb_dat_o   => uart1_dat8,
-		wb_we_i    => wb_uart1_in.we,
-		wb_stb_i   => wb_uart1_in.stb,
-		wb_cyc_i   => wb_uart1_in.cyc,
-		wb_ack_o   => wb_uart1_out.ack,
-		int_o      => irq_l,
-		stx_pad_o  => uart1_txd,
-		srx_pad_i  => uart1_rxd,
-		rts_pad_o  => open,
-		cts_pad_i  => '1',
-		dtr_pad_o  => open,
-		dsr_pad_i  => '1',
-		ri_pad_i   => '0',
-		dcd_pad_i  => '1'
-		);
+	uart1_sim: if SIM generate
+	    uart1: sim_16550_uart
+		generic map (
+		    CHANNEL => 1
+		    )
+		port map (
+		    wb_clk_i   => system_clk,
+		    wb_rst_i   => rst_uart,
+		    wb_adr_i   => wb_uart1_in.adr(2 downto 0),
+		    wb_dat_i   => wb_uart1_in.dat(7 downto 0),
+		    wb_dat_o   => uart1_dat8,
+		    wb_we_i    => wb_uart1_in.we,
+		    wb_stb_i   => wb_uart1_in.stb,
+		    wb_cyc_i   => wb_uart1_in.cyc,
+		    wb_ack_o   => wb_uart1_out.ack,
+		    int_o      => irq_l,
+		    stx_pad_o  => uart1_txd,
+		    srx_pad_i  => uart1_rxd,
+		    rts_pad_o  => open,
+		    cts_pad_i  => '1',
+		    dtr_pad_o  => open,
+		    dsr_pad_i  => '1',
+		    ri_pad_i   => '0',
+		    dcd_pad_i  => '1'
+		    );
+	end generate;
+	uart1_hw: if not SIM generate
+	    uart1: uart_top
+		port map (
+		    wb_clk_i   => system_clk,
+		    wb_rst_i   => rst_uart,
+		    wb_adr_i   => wb_uart1_in.adr(2 downto 0),
+		    wb_dat_i   => wb_uart1_in.dat(7 downto 0),
+		    wb_dat_o   => uart1_dat8,
+		    wb_we_i    => wb_uart1_in.we,
+		    wb_stb_i   => wb_uart1_in.stb,
+		    wb_cyc_i   => wb_uart1_in.cyc,
+		    wb_ack_o   => wb_uart1_out.ack,
+		    int_o      => irq_l,
+		    stx_pad_o  => uart1_txd,
+		    srx_pad_i  => uart1_rxd,
+		    rts_pad_o  => open,
+		    cts_pad_i  => '1',
+		    dtr_pad_o  => open,
+		    dsr_pad_i  => '1',
+		    ri_pad_i   => '0',
+		    dcd_pad_i  => '1'
+		    );
+	end generate;
         -- Add a register on the irq out, helps timing
         uart0_irq_latch: process(system_clk)
         begin
@@ -1135,6 +1236,18 @@ begin
 	end if;
     end process;
 
+    -- SIM magic RAM commands at 0xfe
+    sim_ram: if SIM generate
+        sim_ram_0: sim_ram_control
+            port map (
+                clk => system_clk,
+                dmi_addr => dmi_addr,
+                dmi_din => dmi_dout,
+                dmi_req => dmi_req,
+                dmi_wr => dmi_wr
+                );
+    end generate;
+
     -- Wishbone debug master (TODO: Add a DMI address decoder)
     wishbone_debug: entity work.wishbone_debug_master
 	port map(clk => system_clk,
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Vtoplevel.h"
+#include "verilated.h"
+#include "microwatt-verilator.h"
+
+/*
+ * Run a list of test images (tests/<n>.bin) in one process, the way
+ * scripts/run_test.sh does with core_tb. For each one the RAM is
+ * reloaded and the SoC reset, then it runs until core 0 executes attn.
+ * The registers core_tb dumps at that point (GPRs, CR, LR, CTR, XER)
+ * are read over DMI and compared with the .out file next to the image.
+ *
+ * GPR31 is skipped like in run_test.sh, and XER only has the bits
+ * cr_file.vhdl prints: SO, OV, CA, OV32, CA32 and bits 17:0.
+ */
+
+#define DEFAULT_TEST_CYCLES	10000000
+
+/* core_debug GSPR indices */
+#define GSPR_LR		0x20
+#define GSPR_CTR	0x21
+#define GSPR_XER	0x2c
+#define GSPR_CR		0x34
+
+#define XER_MASK	0xe00fffffUL
+
+#define MAX_LINES	64
+#define LINE_LEN	64
+
+struct dmi_result {
+	uint64_t data;
+	bool done;
+};
+
+static void dmi_sync_done(uint64_t data, void *arg)
+{
+	struct dmi_result *r = (struct dmi_result *)arg;
+
+	r->data = data;
+	r->done = true;
+}
+
+/* Run one DMI request to completion */
+static uint64_t dmi_sync(Vtoplevel *top, uint8_t addr, bool wr, uint64_t data)
+{
+	struct dmi_result r = { 0, false };
+
+	while (!dmi_queue(addr, wr, data, dmi_sync_done, &r))
+		tick(top);
+	while (!r.done)
+		tick(top);
+
+	return r.data;
+}
+
+static uint64_t read_gspr(Vtoplevel *top, unsigned int index)
+{
+	dmi_sync(top, DBG_CORE_GSPR_INDEX(0), true, index);
+	return dmi_sync(top, DBG_CORE_GSPR_DATA(0), false, 0);
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+	return strcmp((const char *)a, (const char *)b);
+}
+
+static unsigned int read_expected(const char *filename,
+				  char lines[MAX_LINES][LINE_LEN])
+{
+	char buf[LINE_LEN];
+	unsigned int n = 0;
+	FILE *f;
+
+	f = fopen(filename, "r");
+	if (!f)
+		return 0;
+
+	while (n < MAX_LINES && fgets(buf, sizeof(buf), f)) {
+		buf[strcspn(buf, "\r\n")] = '\0';
+		for (size_t len = strlen(buf); len && buf[len - 1] == ' '; len--)
+			buf[len - 1] = '\0';
+		if (!buf[0] || !strncmp(buf, "GPR31", 5))
+			continue;
+		strcpy(lines[n++], buf);
+	}
+	fclose(f);
+
+	qsort(lines, n, LINE_LEN, compare_lines);
+	return n;
+}
+
+static unsigned int read_results(Vtoplevel *top,
+				 char lines[MAX_LINES][LINE_LEN])
+{
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < 31; i++)
+		snprintf(lines[n++], LINE_LEN, "GPR%u %016llX", i,
+			 (unsigned long long)read_gspr(top, i));
+	snprintf(lines[n++], LINE_LEN, "CR %016llX",
+		 (unsigned long long)read_gspr(top, GSPR_CR));
+	snprintf(lines[n++], LINE_LEN, "LR %016llX",
+		 (unsigned long long)read_gspr(top, GSPR_LR));
+	snprintf(lines[n++], LINE_LEN, "CTR %016llX",
+		 (unsigned long long)read_gspr(top, GSPR_CTR));
+	snprintf(lines[n++], LINE_LEN, "XER %016llX",
+		 (unsigned long long)(read_gspr(top, GSPR_XER) & XER_MASK));
+
+	qsort(lines, n, LINE_LEN, compare_lines);
+	return n;
+}
+
+static const char *test_name(const char *filename)
+{
+	const char *p = strrchr(filename, '/');
+
+	return p ? p + 1 : filename;
+}
+
+/* Returns true if the test terminated and its registers match */
+static bool run_one(Vtoplevel *top, const char *filename, uint64_t cycles)
+{
+	static char got[MAX_LINES][LINE_LEN], exp[MAX_LINES][LINE_LEN];
+	char *out_file, *dot;
+	unsigned int ngot, nexp;
+	uint64_t start = main_time / 2;
+	bool pass;
+
+	out_file = (char *)malloc(strlen(filename) + 5);
+	strcpy(out_file, filename);
+	dot = strrchr((char *)test_name(out_file), '.');
+	if (dot)
+		*dot = '\0';
+	strcat(out_file, ".out");
+	nexp = read_expected(out_file, exp);
+	if (!nexp) {
+		printf("%s FAIL (no %s) ********\n", test_name(filename), out_file);
+		free(out_file);
+		return false;
+	}
+	free(out_file);
+
+	top->ext_rst = 0;
+	for (unsigned long i = 0; i < 5; i++)
+		tick(top);
+	top->ext_rst = 1;
+
+	while (!(dmi_sync(top, DBG_CORE_STAT(0), false, 0) &
+		 DBG_CORE_STAT_TERM)) {
+		if (main_time / 2 - start >= cycles) {
+			printf("%s FAIL (timeout) ********\n", test_name(filename));
+			return false;
+		}
+		if (Verilated::gotFinish())
+			return false;
+	}
+
+	ngot = read_results(top, got);
+
+	pass = ngot == nexp;
+	for (unsigned int i = 0; pass && i < ngot; i++)
+		pass = !strcmp(got[i], exp[i]);
+
+	printf("%s %s\n", test_name(filename), pass ? "PASS" : "FAIL ********");
+	if (!pass) {
+		for (unsigned int i = 0; i < ngot || i < nexp; i++) {
+			const char *g = i < ngot ? got[i] : "";
+			const char *e = i < nexp ? exp[i] : "";
+
+			if (strcmp(g, e))
+				printf("    got %-24s expected %s\n", g, e);
+		}
+	}
+	fflush(stdout);
+
+	return pass;
+}
+
+int batch_run(Vtoplevel *top, int count, char **files, uint64_t cycles)
+{
+	int failed = 0;
+
+	if (!cycles)
+		cycles = DEFAULT_TEST_CYCLES;
+
+#if !FAST_UART
+	top->uart0_rxd = 1;
+#endif
+
+	for (int i = 0; i < count && !Verilated::gotFinish(); i++) {
+		/* The first image is loaded by main_mem_init() */
+		if (i)
+			mem_reload(files[i]);
+		if (!run_one(top, files[i], cycles))
+			failed++;
+	}
+
+	printf("%d tests, %d passed, %d failed\n", count, count - failed,
+	       failed);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,159 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "microwatt-verilator.h"
+
+/*
+ * Debug socket for "mw_debug -b sim", using the server in
+ * sim_jtag_socket_c.c so the protocol is the same as the GHDL
+ * simulation's. A DR scan of the DMI DTM (a size in bits followed by
+ * op (2 bits), data (64) and address (8), LSB first) isn't clocked
+ * through a JTAG model: the request goes straight onto the DMI bus via
+ * dmi_queue(), and the reply is what dmi_dtm_xilinx.vhdl would have
+ * captured: status, then the data of the last request. DMI accesses
+ * from a frame are queued directly.
+ *
+ * While a request is on the bus nothing more is taken from the socket,
+ * so like in the GHDL sim the following scan always finds it complete.
+ */
+
+#define MAX_PACKET	32
+
+/* Cycles between polls of the socket while idle */
+#define POLL_INTERVAL	20
+
+#define DMI_REQ_NOP	0
+#define DMI_REQ_RD	1
+#define DMI_REQ_WR	2
+#define DMI_SCAN	3
+#define DMI_RSP_OK	0
+
+static bool enabled;
+static unsigned long countdown;
+
+/* Latched request, as in dmi_dtm_xilinx.vhdl */
+static uint8_t req_addr;
+static uint64_t req_data;
+static bool req_busy;
+
+/* A DMI access from a frame waiting for room in the queue */
+static bool op_waiting;
+static uint8_t op_addr;
+static uint64_t op_data;
+static bool op_wr;
+
+void dmi_socket_enable(const char *spec)
+{
+	enabled = true;
+	sim_debug_socket_open(spec);
+}
+
+bool dmi_socket_connected(void)
+{
+	return sim_debug_socket_connected();
+}
+
+static void req_done(uint64_t data, void *arg)
+{
+	req_data = data;
+	req_busy = false;
+}
+
+static void op_done(uint64_t data, void *arg)
+{
+	req_busy = false;
+	sim_debug_socket_done(true, data);
+}
+
+static void add_bits(uint8_t *buf, unsigned int *pos, uint64_t d,
+		     unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++, (*pos)++) {
+		if (d & (1ULL << i))
+			buf[*pos / 8] |= 1 << (*pos % 8);
+	}
+}
+
+static uint64_t get_bits(const uint8_t *buf, unsigned int *pos,
+			 unsigned int count)
+{
+	uint64_t d = 0;
+
+	for (unsigned int i = 0; i < count; i++, (*pos)++) {
+		if (buf[*pos / 8] & (1 << (*pos % 8)))
+			d |= 1ULL << i;
+	}
+	return d;
+}
+
+static void handle_message(const uint8_t *msg, unsigned int len)
+{
+	uint8_t rsp[MAX_PACKET];
+	unsigned int size = msg[0];
+	unsigned int pos = 0;
+	uint64_t op, data, addr;
+
+	/* What the DTM captured before this scan */
+	memset(rsp, 0, sizeof(rsp));
+	rsp[0] = size;
+	add_bits(rsp + 1, &pos, DMI_RSP_OK, 2);
+	add_bits(rsp + 1, &pos, req_data, 64);
+	add_bits(rsp + 1, &pos, req_addr, 8);
+
+	if (size >= 74) {
+		pos = 0;
+		op = get_bits(msg + 1, &pos, 2);
+		data = get_bits(msg + 1, &pos, 64);
+		addr = get_bits(msg + 1, &pos, 8);
+
+		if (op == DMI_REQ_RD || op == DMI_REQ_WR) {
+			req_addr = addr;
+			req_data = data;
+			req_busy = dmi_queue(addr, op == DMI_REQ_WR, data,
+					     req_done, NULL);
+			if (!req_busy)
+				fprintf(stderr, "Debug request dropped, DMI queue full\r\n");
+		}
+	}
+
+	sim_debug_socket_reply(rsp, len);
+}
+
+void dmi_socket_cycle(void)
+{
+	uint8_t msg[MAX_PACKET];
+	unsigned int len;
+	int op;
+
+	/* Leave scans in the socket while the bus drains for a checkpoint */
+	if (!enabled || req_busy || dmi_draining())
+		return;
+
+	if (op_waiting) {
+		req_busy = dmi_queue(op_addr, op_wr, op_data, op_done, NULL);
+		op_waiting = !req_busy;
+		return;
+	}
+
+	if (countdown) {
+		countdown--;
+		return;
+	}
+
+	op = sim_debug_socket_next(msg, &len, &op_addr, &op_data);
+	switch (op) {
+	case DMI_REQ_NOP:
+		countdown = POLL_INTERVAL;
+		break;
+	case DMI_SCAN:
+		handle_message(msg, len);
+		break;
+	default:
+		op_wr = op == DMI_REQ_WR;
+		req_busy = dmi_queue(op_addr, op_wr, op_data, op_done, NULL);
+		op_waiting = !req_busy;
+		break;
+	}
+}
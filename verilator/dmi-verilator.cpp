@@ -0,0 +1,108 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "Vtoplevel__Dpi.h"
+#include "microwatt-verilator.h"
+
+/*
+ * DMI bus master, driven once per clock by dmi_dtm_dpi.v. Requests from
+ * the different users in the harness are queued and run one at a time.
+ * Each is held until the slave acks, then req is dropped for a cycle so
+ * that core_debug sees a new edge for the next one. When a request
+ * completes its callback gets the data read (or written).
+ *
+ * The queue holds callbacks, so it can't go in a checkpoint. Instead the
+ * bus is drained before one is saved: dmi_drain() turns new requests
+ * away until the queue is empty and the last request's handshake with
+ * core_debug is over, which dmi_idle() tells. A restored run then starts
+ * the same way, with an idle bus and an empty queue.
+ */
+
+#define DMI_QUEUE_SIZE	16
+
+enum dmi_state {
+	DMI_IDLE, DMI_REQ, DMI_GAP
+};
+
+struct dmi_op {
+	uint8_t addr;
+	bool wr;
+	uint64_t data;
+	dmi_done_fn done;
+	void *arg;
+};
+
+static enum dmi_state state;
+static struct dmi_op queue[DMI_QUEUE_SIZE];
+static unsigned int queue_head;
+static unsigned int queue_len;
+static bool draining;
+
+void dmi_drain(bool drain)
+{
+	draining = drain;
+}
+
+bool dmi_draining(void)
+{
+	return draining;
+}
+
+bool dmi_idle(void)
+{
+	return state == DMI_IDLE && !queue_len;
+}
+
+bool dmi_queue(uint8_t addr, bool wr, uint64_t data, dmi_done_fn done,
+	       void *arg)
+{
+	struct dmi_op *op;
+
+	if (draining || queue_len == DMI_QUEUE_SIZE)
+		return false;
+
+	op = &queue[(queue_head + queue_len) % DMI_QUEUE_SIZE];
+	op->addr = addr;
+	op->wr = wr;
+	op->data = data;
+	op->done = done;
+	op->arg = arg;
+	queue_len++;
+
+	return true;
+}
+
+void dmi_dpi_tick(svBit ack, long long din, svBit *req, svBit *wr,
+		  char *addr, long long *dout)
+{
+	struct dmi_op *op = &queue[queue_head];
+
+	switch (state) {
+	case DMI_IDLE:
+		if (queue_len)
+			state = DMI_REQ;
+		break;
+
+	case DMI_REQ:
+		if (ack) {
+			struct dmi_op done = *op;
+
+			queue_head = (queue_head + 1) % DMI_QUEUE_SIZE;
+			queue_len--;
+			state = DMI_GAP;
+
+			if (done.done)
+				done.done(done.wr ? done.data : din, done.arg);
+		}
+		break;
+
+	case DMI_GAP:
+		state = DMI_IDLE;
+		break;
+	}
+
+	*req = state == DMI_REQ;
+	*wr = op->wr;
+	*addr = op->addr;
+	*dout = op->data;
+}
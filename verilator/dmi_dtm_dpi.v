@@ -0,0 +1,41 @@
+// DMI master for the Verilator build. Each clock the harness is given the
+// slave side signals and returns the next request to drive, see
+// dmi-verilator.cpp.
+
+module dmi_dtm_dpi #(
+	parameter abits = 8,
+	parameter dbits = 64
+) (
+	input sys_clk,
+	input sys_reset,
+	output reg [abits-1:0] dmi_addr,
+	input [dbits-1:0] dmi_din,
+	output reg [dbits-1:0] dmi_dout,
+	output reg dmi_req,
+	output reg dmi_wr,
+	input dmi_ack
+);
+	import "DPI-C" function void dmi_dpi_tick(input bit ack,
+						  input longint din,
+						  output bit req,
+						  output bit wr,
+						  output byte addr,
+						  output longint dout);
+
+	bit req, wr;
+	byte addr;
+	longint dout;
+
+	always @(posedge sys_clk) begin
+		if (sys_reset) begin
+			dmi_req <= 0;
+			dmi_wr <= 0;
+		end else begin
+			dmi_dpi_tick(dmi_ack, dmi_din, req, wr, addr, dout);
+			dmi_req <= req;
+			dmi_wr <= wr;
+			dmi_addr <= addr;
+			dmi_dout <= dout;
+		end
+	end
+endmodule
@@ -0,0 +1,59 @@
+-- DMI interface for the Verilator build. There's no JTAG here, the DMI
+-- bus is driven from the C++ harness (dmi-verilator.cpp) through DPI
+-- calls in dmi_dtm_dpi.v.
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+library work;
+use work.wishbone_types.all;
+
+entity dmi_dtm is
+    generic(ABITS : INTEGER:=8;
+	    DBITS : INTEGER:=32);
+
+    port(sys_clk	: in std_ulogic;
+	 sys_reset	: in std_ulogic;
+	 dmi_addr	: out std_ulogic_vector(ABITS - 1 downto 0);
+	 dmi_din	: in std_ulogic_vector(DBITS - 1 downto 0);
+	 dmi_dout	: out std_ulogic_vector(DBITS - 1 downto 0);
+	 dmi_req	: out std_ulogic;
+	 dmi_wr		: out std_ulogic;
+	 dmi_ack	: in std_ulogic
+	 );
+end entity dmi_dtm;
+
+architecture verilator of dmi_dtm is
+
+    -- Implemented in Verilog, left as a black box by ghdl/yosys
+    component dmi_dtm_dpi is
+        generic(abits : integer;
+                dbits : integer);
+        port(sys_clk	: in std_ulogic;
+             sys_reset	: in std_ulogic;
+             dmi_addr	: out std_ulogic_vector(abits - 1 downto 0);
+             dmi_din	: in std_ulogic_vector(dbits - 1 downto 0);
+             dmi_dout	: out std_ulogic_vector(dbits - 1 downto 0);
+             dmi_req	: out std_ulogic;
+             dmi_wr	: out std_ulogic;
+             dmi_ack	: in std_ulogic
+             );
+    end component;
+
+begin
+    dtm_0: dmi_dtm_dpi
+        generic map(
+            abits => ABITS,
+            dbits => DBITS
+            )
+        port map(
+            sys_clk => sys_clk,
+            sys_reset => sys_reset,
+            dmi_addr => dmi_addr,
+            dmi_din => dmi_din,
+            dmi_dout => dmi_dout,
+            dmi_req => dmi_req,
+            dmi_wr => dmi_wr,
+            dmi_ack => dmi_ack
+            );
+end architecture verilator;
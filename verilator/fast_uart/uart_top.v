@@ -0,0 +1,121 @@
+// Register level 16550 model for the Verilator build, used in place of
+// uart16550/uart_top.v when building with VERILATOR_FAST_UART=1. Bytes
+// are handed straight to and from the harness (uart-verilator.c)
+// instead of being serialised on stx_pad_o/srx_pad_i, so console output
+// doesn't cost any simulated baud time. Transmit is instantaneous: THR
+// is always empty and there is no FIFO to overrun.
+
+module uart_top (
+	input wb_clk_i,
+	input wb_rst_i,
+	input [2:0] wb_adr_i,
+	input [7:0] wb_dat_i,
+	output reg [7:0] wb_dat_o,
+	input wb_we_i,
+	input wb_stb_i,
+	input wb_cyc_i,
+	output reg wb_ack_o,
+	output int_o,
+	output stx_pad_o,
+	input srx_pad_i,
+	output rts_pad_o,
+	input cts_pad_i,
+	output dtr_pad_o,
+	input dsr_pad_i,
+	input ri_pad_i,
+	input dcd_pad_i
+);
+	import "DPI-C" function void uart_dpi_tx(input byte c);
+	import "DPI-C" function bit uart_dpi_rx_ready();
+	import "DPI-C" function byte uart_dpi_rx();
+
+	reg [7:0] lcr, scr, dll, dlm;
+	reg [4:0] mcr;
+	reg [3:0] ier;
+	reg fifo_en;
+	reg rx_ready;
+	reg thre_int;
+	reg [1:0] ack_wait;
+
+	wire dlab = lcr[7];
+	wire rx_int = ier[0] & rx_ready;
+	wire tx_int = ier[1] & thre_int;
+
+	wire [7:0] lsr = { 1'b0, 1'b1, 1'b1, 4'b0, rx_ready };
+	wire [7:0] iir = { fifo_en, fifo_en, 2'b0,
+			   rx_int ? 4'b0100 : tx_int ? 4'b0010 : 4'b0001 };
+	wire [7:0] msr = { ~dcd_pad_i, ~ri_pad_i, ~dsr_pad_i, ~cts_pad_i, 4'b0 };
+
+	assign int_o = rx_int | tx_int;
+	assign stx_pad_o = 1'b1;
+	assign rts_pad_o = ~mcr[1];
+	assign dtr_pad_o = ~mcr[0];
+
+	always @(posedge wb_clk_i) begin
+		if (wb_rst_i) begin
+			lcr <= 8'b00000011;
+			mcr <= 0;
+			ier <= 0;
+			fifo_en <= 0;
+			rx_ready <= 0;
+			thre_int <= 0;
+			wb_ack_o <= 0;
+			ack_wait <= 0;
+		end else begin
+			if (!rx_ready)
+				rx_ready <= uart_dpi_rx_ready();
+
+			// Same ack pattern as uart_wb.v: one cycle, then idle
+			wb_ack_o <= 0;
+			if (ack_wait != 0) begin
+				ack_wait <= ack_wait - 1;
+			end else if (wb_cyc_i && wb_stb_i) begin
+				wb_ack_o <= 1;
+				ack_wait <= 3;
+				if (wb_we_i) begin
+					case (wb_adr_i)
+					0: if (dlab)
+						dll <= wb_dat_i;
+					   else begin
+						uart_dpi_tx(wb_dat_i);
+						thre_int <= 1;
+					   end
+					1: if (dlab)
+						dlm <= wb_dat_i;
+					   else begin
+						ier <= wb_dat_i[3:0];
+						if (wb_dat_i[1])
+							thre_int <= 1;
+					   end
+					2: fifo_en <= wb_dat_i[0];
+					3: lcr <= wb_dat_i;
+					4: mcr <= wb_dat_i[4:0];
+					7: scr <= wb_dat_i;
+					default: ;
+					endcase
+				end else begin
+					case (wb_adr_i)
+					0: if (dlab)
+						wb_dat_o <= dll;
+					   else begin
+						wb_dat_o <= rx_ready ? uart_dpi_rx() : 8'h00;
+						rx_ready <= 0;
+					   end
+					1: wb_dat_o <= dlab ? dlm : { 4'b0, ier };
+					2: begin
+						wb_dat_o <= iir;
+						// Reading IIR clears a THRE interrupt it reports
+						if (!rx_int)
+							thre_int <= 0;
+					   end
+					3: wb_dat_o <= lcr;
+					4: wb_dat_o <= { 3'b0, mcr };
+					5: wb_dat_o <= lsr;
+					6: wb_dat_o <= msr;
+					7: wb_dat_o <= scr;
+					endcase
+				end
+			end
+		end
+	end
+endmodule
@@ -0,0 +1,267 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "microwatt-verilator.h"
+
+/*
+ * Fast forward over idle time. Software spends a lot of a simulation
+ * idle, either in the wait instruction (Linux in its idle loop) or
+ * polling the UART for input (MicroPython at its prompt), and nothing
+ * changes until the decrementer fires or a key is pressed. Once every
+ * core has been idle for SETTLE_CYCLES with the UART quiet, each idle
+ * core's DEC is read over DMI and the simulation time jumps to a little
+ * before the earliest one goes negative. Writing the number of cycles
+ * skipped to each core's TB_SKIP register moves its timebase and
+ * decrementer on by the same amount, so software sees the time it
+ * expects to have passed.
+ *
+ * A core counts as idle if it is waiting, or if it is running but every
+ * NIA sampled over the window is within POLL_RANGE bytes and nothing in
+ * RAM has changed: a poll loop, which can only be ended by an interrupt
+ * or by the UART. Such a core's DEC only limits the jump if MSR[EE] is
+ * set. A loop that only counts in registers looks the same, and simply
+ * gets less done in the time skipped.
+ *
+ * A core with an external interrupt pending from the XICS counts as
+ * busy, and the cores are checked once more after DEC has been read, so
+ * one that woke up meanwhile stops the jump. Nothing is skipped while a
+ * debug client is connected, or when every core is stopped, as nothing
+ * would ever end the jump.
+ *
+ * Cores don't notice the jump, but the PMU counters don't count the
+ * skipped cycles and cycle triggers inside a skipped stretch fire late.
+ */
+
+#define SETTLE_CYCLES	10000
+#define MIN_SKIP	1000
+#define MAX_SKIP	100000000
+#define DEC_MARGIN	256
+#define POLL_RANGE	16384
+
+/* core_debug GSPR index of DEC */
+#define GSPR_DEC	0x32
+
+#define MSR_EE		(1ULL << 15)
+
+enum idle_state {
+	IDLE_STAT, IDLE_DEC, IDLE_CHECK, IDLE_SKIP
+};
+
+static bool enabled;
+static enum idle_state state;
+static unsigned int pending;
+static bool busy = true;
+static uint64_t quiet_since;
+static uint64_t mem_changes;
+static unsigned int core;
+static bool waiting[NCPUS];
+static bool polling[NCPUS];
+static uint64_t nia_lo[NCPUS], nia_hi[NCPUS];
+static uint64_t dec[NCPUS];
+static uint64_t msr[NCPUS];
+static uint64_t skip;
+static uint64_t skipped;
+static unsigned long jumps;
+
+static void idle_summary(void)
+{
+	fprintf(stderr, "fast forward: skipped %llu cycles in %lu jumps\r\n",
+		(unsigned long long)skipped, jumps);
+}
+
+void idle_enable(void)
+{
+	enabled = true;
+	atexit(idle_summary);
+}
+
+/* Start the settle window again */
+static void unsettle(uint64_t cycle)
+{
+	quiet_since = cycle;
+	for (unsigned int i = 0; i < NCPUS; i++) {
+		nia_lo[i] = UINT64_MAX;
+		nia_hi[i] = 0;
+	}
+}
+
+static void stat_done(uint64_t stat, void *arg)
+{
+	uintptr_t i = (uintptr_t)arg;
+
+	waiting[i] = stat & DBG_CORE_STAT_WAITING;
+	polling[i] = !(stat & (DBG_CORE_STAT_STOPPED | DBG_CORE_STAT_WAITING));
+	if (stat & DBG_CORE_STAT_IRQ)
+		busy = true;
+	pending--;
+}
+
+static void sample_done(uint64_t sample, void *arg)
+{
+	uintptr_t i = (uintptr_t)arg;
+	uint64_t nia = sample & ~3ULL;
+
+	if (polling[i]) {
+		if (nia < nia_lo[i])
+			nia_lo[i] = nia;
+		if (nia > nia_hi[i])
+			nia_hi[i] = nia;
+		if (nia_hi[i] - nia_lo[i] >= POLL_RANGE)
+			busy = true;
+	}
+	pending--;
+}
+
+static void dec_done(uint64_t val, void *arg)
+{
+	dec[(uintptr_t)arg] = val;
+	pending--;
+}
+
+static void msr_done(uint64_t val, void *arg)
+{
+	msr[(uintptr_t)arg] = val;
+	pending--;
+}
+
+/*
+ * Cycles before DEC goes negative. Without LPCR[LD] only the bottom 32
+ * bits are returned and bit 31 is the sign.
+ */
+static uint64_t dec_cycles(uint64_t val)
+{
+	int64_t d = (val >> 32) ? (int64_t)val : (int32_t)val;
+
+	return d < 0 ? 0 : d;
+}
+
+static void poll_stat(void)
+{
+	busy = false;
+	for (uintptr_t i = 0; i < NCPUS; i++) {
+		if (dmi_queue(DBG_CORE_STAT(i), false, 0, stat_done, (void *)i))
+			pending++;
+		else
+			busy = true;
+		if (dmi_queue(DBG_CORE_SAMPLE(i), false, 0, sample_done,
+			      (void *)i))
+			pending++;
+		else
+			busy = true;
+	}
+}
+
+/*
+ * Called every cycle, returns the number of cycles to skip. max_cycles
+ * (if set) is never skipped past.
+ */
+uint64_t idle_cycle(uint64_t cycle, uint64_t max_cycles)
+{
+	bool idle;
+
+	if (!enabled)
+		return 0;
+
+	/* Leave the debug bus alone while mw_debug is connected */
+	if (!uart_idle(false) || dmi_socket_connected() ||
+	    mem_changes != mem_change_count()) {
+		mem_changes = mem_change_count();
+		unsettle(cycle);
+	}
+
+	if (pending)
+		return 0;
+
+	switch (state) {
+	case IDLE_STAT:
+		if (busy)
+			unsettle(cycle);
+
+		if (cycle - quiet_since < SETTLE_CYCLES) {
+			poll_stat();
+			break;
+		}
+
+		/* Settled, read DEC of the idle cores one at a time */
+		state = IDLE_DEC;
+		core = 0;
+		/* fall through */
+
+	case IDLE_DEC:
+		while (core < NCPUS && !waiting[core] && !polling[core])
+			core++;
+
+		if (core < NCPUS) {
+			if (dmi_queue(DBG_CORE_GSPR_INDEX(core), true, GSPR_DEC,
+				      NULL, NULL) &&
+			    dmi_queue(DBG_CORE_GSPR_DATA(core), false, 0,
+				      dec_done, (void *)(uintptr_t)core) &&
+			    dmi_queue(DBG_CORE_MSR(core), false, 0,
+				      msr_done, (void *)(uintptr_t)core)) {
+				pending += 2;
+				core++;
+			}
+			break;
+		}
+
+		idle = false;
+		skip = MAX_SKIP;
+		for (unsigned int i = 0; i < NCPUS; i++) {
+			uint64_t d;
+
+			if (!waiting[i] && !polling[i])
+				continue;
+			idle = true;
+			/* A poll loop with interrupts off only ends on input */
+			if (polling[i] && !(msr[i] & MSR_EE))
+				continue;
+			d = dec_cycles(dec[i]);
+			d = d > DEC_MARGIN ? d - DEC_MARGIN : 0;
+			if (d < skip)
+				skip = d;
+		}
+		if (max_cycles && cycle + skip > max_cycles)
+			skip = max_cycles > cycle ? max_cycles - cycle : 0;
+
+		if (!idle || skip < MIN_SKIP) {
+			state = IDLE_STAT;
+			unsettle(cycle);
+			poll_stat();
+			break;
+		}
+
+		/* Make sure nothing woke up while DEC was being read */
+		state = IDLE_CHECK;
+		poll_stat();
+		break;
+
+	case IDLE_CHECK:
+		if (busy || cycle - quiet_since < SETTLE_CYCLES ||
+		    !uart_idle(true)) {
+			state = IDLE_STAT;
+			unsettle(cycle);
+			poll_stat();
+			break;
+		}
+
+		skipped += skip;
+		jumps++;
+		state = IDLE_SKIP;
+		core = 0;
+		return skip;
+
+	case IDLE_SKIP:
+		/* The jump has been made, tell each core about it */
+		if (dmi_queue(DBG_CORE_TB_SKIP(core), true, skip, NULL, NULL))
+			core++;
+		if (core == NCPUS) {
+			state = IDLE_STAT;
+			unsettle(cycle);
+			poll_stat();
+		}
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,38 @@
+// Main memory for the Verilator build. Same timing as fpga/main_bram.vhdl
+// (one cycle output buffer) but the array itself is held by the C++
+// memory model in mem-verilator.cpp.
+
+module main_bram_dpi #(
+	parameter width = 64,
+	parameter height_bits = 1024,
+	parameter memory_size = 65536,
+	parameter ram_init_file = ""
+) (
+	input clk,
+	input [height_bits-1:0] addr,
+	input [width-1:0] din,
+	output reg [width-1:0] dout,
+	input [(width/8)-1:0] sel,
+	input re,
+	input we
+);
+	import "DPI-C" function void main_mem_init(input longint size,
+						   input string init_file);
+	import "DPI-C" function longint main_mem_read(input longint index);
+	import "DPI-C" function void main_mem_write(input longint index,
+						    input longint data,
+						    input byte sel);
+
+	wire [63:0] index = addr;
+	reg [width-1:0] obuf;
+
+	initial main_mem_init(64'd1 << (height_bits + 3), ram_init_file);
+
+	always @(posedge clk) begin
+		if (we)
+			main_mem_write(index, din, sel);
+		if (re)
+			obuf <= main_mem_read(index);
+		dout <= obuf;
+	end
+endmodule
@@ -0,0 +1,71 @@
+-- Single port Block RAM with one cycle output buffer
+--
+-- Verilator version. The storage lives in a host side memory model
+-- (see mem-verilator.cpp) reached via DPI from main_bram_dpi.v, so
+-- images can be loaded when the simulator starts rather than being
+-- baked into the netlist by yosys.
+
+library ieee;
+use ieee.std_logic_1164.all;
+
+library work;
+
+entity main_bram is
+    generic(
+        WIDTH        : natural := 64;
+        HEIGHT_BITS  : natural := 1024;
+        MEMORY_SIZE  : natural := 65536;
+        RAM_INIT_FILE : string
+        );
+    port(
+        clk  : in std_logic;
+        addr : in std_logic_vector(HEIGHT_BITS - 1 downto 0) ;
+        din  : in std_logic_vector(WIDTH-1 downto 0);
+        dout : out std_logic_vector(WIDTH-1 downto 0);
+        sel  : in std_logic_vector((WIDTH/8)-1 downto 0);
+        re   : in std_ulogic;
+        we   : in std_ulogic
+        );
+end entity main_bram;
+
+architecture verilator of main_bram is
+
+    -- Implemented in Verilog, left as a black box by ghdl/yosys
+    component main_bram_dpi is
+        generic(
+            width         : natural;
+            height_bits   : natural;
+            memory_size   : natural;
+            ram_init_file : string
+            );
+        port(
+            clk  : in std_logic;
+            addr : in std_logic_vector(height_bits - 1 downto 0) ;
+            din  : in std_logic_vector(width-1 downto 0);
+            dout : out std_logic_vector(width-1 downto 0);
+            sel  : in std_logic_vector((width/8)-1 downto 0);
+            re   : in std_ulogic;
+            we   : in std_ulogic
+            );
+    end component;
+
+begin
+
+    ram_0: main_bram_dpi
+        generic map(
+            width => WIDTH,
+            height_bits => HEIGHT_BITS,
+            memory_size => MEMORY_SIZE,
+            ram_init_file => RAM_INIT_FILE
+            )
+        port map(
+            clk => clk,
+            addr => addr,
+            din => din,
+            dout => dout,
+            sel => sel,
+            re => re,
+            we => we
+            );
+
+end architecture verilator;
@@ -0,0 +1,266 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Vtoplevel__Dpi.h"
+#include "microwatt-verilator.h"
+
+/*
+ * Host side model of the main block RAM. The memory is a private
+ * anonymous mapping sized to the RAM address space, with images placed
+ * in it at startup. Page aligned raw binaries are mmapped straight
+ * over it like behavioural_initialize() in sim_bram_helpers_c.c does,
+ * everything else is copied in.
+ */
+
+#define ALIGN_UP(VAL, SIZE)	(((VAL) + ((SIZE)-1)) & ~((SIZE)-1))
+
+#define MAX_LOADS 16
+
+struct mem_load {
+	const char *filename;
+	unsigned long addr;
+};
+
+static struct mem_load loads[MAX_LOADS];
+static unsigned long load_nr;
+
+static unsigned char *mem;
+static unsigned long mem_size;
+
+/* Writes that changed the RAM contents, for the idle fast forward */
+static uint64_t mem_changes;
+
+void mem_add_load(const char *spec)
+{
+	char *filename, *p;
+	unsigned long addr = 0;
+
+	if (load_nr == MAX_LOADS) {
+		fprintf(stderr, "%s: too many images, bump MAX_LOADS\n", __func__);
+		exit(1);
+	}
+
+	filename = strdup(spec);
+	p = strrchr(filename, '@');
+	if (p) {
+		*p++ = '\0';
+		addr = strtoul(p, NULL, 0);
+	}
+
+	loads[load_nr].filename = filename;
+	loads[load_nr].addr = addr;
+	load_nr++;
+}
+
+static void check_range(const char *filename, unsigned long addr,
+			unsigned long size)
+{
+	if (addr > mem_size || size > mem_size - addr) {
+		fprintf(stderr, "%s: %lx bytes at %lx doesn't fit in %lx of RAM\n",
+			filename, size, addr, mem_size);
+		exit(1);
+	}
+}
+
+static void load_hex(const char *filename, FILE *f, unsigned long addr)
+{
+	char line[64];
+	uint64_t *p;
+
+	while (fgets(line, sizeof(line), f)) {
+		check_range(filename, addr, 8);
+		p = (uint64_t *)(mem + addr);
+		*p = strtoull(line, NULL, 16);
+		addr += 8;
+	}
+}
+
+static void load_elf(const char *filename, int fd)
+{
+	Elf64_Ehdr ehdr;
+	Elf64_Phdr phdr;
+
+	if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr) ||
+	    ehdr.e_ident[EI_CLASS] != ELFCLASS64 ||
+	    ehdr.e_ident[EI_DATA] != ELFDATA2LSB) {
+		fprintf(stderr, "%s: only little endian ELF64 is supported\n",
+			filename);
+		exit(1);
+	}
+
+	for (unsigned int i = 0; i < ehdr.e_phnum; i++) {
+		off_t off = ehdr.e_phoff + i * ehdr.e_phentsize;
+
+		if (pread(fd, &phdr, sizeof(phdr), off) != sizeof(phdr)) {
+			fprintf(stderr, "%s: truncated program headers\n", filename);
+			exit(1);
+		}
+		if (phdr.p_type != PT_LOAD || !phdr.p_memsz)
+			continue;
+
+		check_range(filename, phdr.p_paddr, phdr.p_memsz);
+		if (pread(fd, mem + phdr.p_paddr, phdr.p_filesz,
+			  phdr.p_offset) != (ssize_t)phdr.p_filesz) {
+			fprintf(stderr, "%s: short read of segment %u\n", filename, i);
+			exit(1);
+		}
+		memset(mem + phdr.p_paddr + phdr.p_filesz, 0,
+		       phdr.p_memsz - phdr.p_filesz);
+	}
+}
+
+static void load_bin(const char *filename, int fd, unsigned long addr)
+{
+	struct stat buf;
+	void *m;
+
+	if (fstat(fd, &buf)) {
+		perror("fstat");
+		exit(1);
+	}
+	check_range(filename, addr, buf.st_size);
+
+	if (!(addr % getpagesize())) {
+		m = mmap(mem + addr, buf.st_size, PROT_READ|PROT_WRITE,
+			 MAP_PRIVATE|MAP_FIXED, fd, 0);
+		if (m == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+		return;
+	}
+
+	if (pread(fd, mem + addr, buf.st_size, 0) != buf.st_size) {
+		fprintf(stderr, "%s: short read\n", filename);
+		exit(1);
+	}
+}
+
+static void mem_load(const char *filename, unsigned long addr)
+{
+	unsigned char ident[SELFMAG];
+	const char *ext;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr, "%s: could not open %s\n", __func__, filename);
+		exit(1);
+	}
+
+	ext = strrchr(filename, '.');
+	if (ext && !strcmp(ext, ".hex")) {
+		FILE *f = fdopen(fd, "r");
+
+		load_hex(filename, f, addr);
+		fclose(f);
+		return;
+	}
+
+	if (pread(fd, ident, SELFMAG, 0) == SELFMAG &&
+	    !memcmp(ident, ELFMAG, SELFMAG))
+		load_elf(filename, fd);
+	else
+		load_bin(filename, fd, addr);
+	close(fd);
+}
+
+void main_mem_init(long long size, const char *init_file)
+{
+	mem_size = ALIGN_UP(size, getpagesize());
+	mem = (unsigned char *)mmap(NULL, mem_size, PROT_READ|PROT_WRITE,
+				    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+
+	/* Without any --load, fall back to the image given at synthesis */
+	if (!load_nr) {
+		if (init_file && *init_file)
+			mem_load(init_file, 0);
+		return;
+	}
+
+	for (unsigned long i = 0; i < load_nr; i++)
+		mem_load(loads[i].filename, loads[i].addr);
+}
+
+/* Replace the RAM contents with a single image, for batch runs */
+void mem_reload(const char *filename)
+{
+	if (mmap(mem, mem_size, PROT_READ|PROT_WRITE,
+		 MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED, -1, 0) == MAP_FAILED) {
+		perror("mmap");
+		exit(1);
+	}
+	mem_load(filename, 0);
+}
+
+long long main_mem_read(long long index)
+{
+	return ((uint64_t *)mem)[index];
+}
+
+void main_mem_write(long long index, long long data, char sel)
+{
+	unsigned char *p = mem + index * 8;
+	bool changed = false;
+
+	for (unsigned long i = 0; i < 8; i++) {
+		if (sel & (1UL << i)) {
+			unsigned char b = (data >> (i*8)) & 0xff;
+
+			changed |= p[i] != b;
+			p[i] = b;
+		}
+	}
+	mem_changes += changed;
+}
+
+uint64_t mem_change_count(void)
+{
+	return mem_changes;
+}
+
+#if VM_SAVABLE
+/*
+ * A restored model doesn't run its initial blocks again, so
+ * main_mem_init() is never called and the mapping is set up here.
+ */
+void mem_save(VerilatedSerialize &os)
+{
+	SAVE(os, mem_size);
+	os.write(mem, mem_size);
+}
+
+void mem_restore(VerilatedDeserialize &is)
+{
+	unsigned long size;
+
+	RESTORE(is, size);
+	if (mem && size != mem_size) {
+		fprintf(stderr, "%s: checkpoint has %lx bytes of RAM, not %lx\n",
+			__func__, size, mem_size);
+		exit(1);
+	}
+
+	if (!mem) {
+		mem_size = size;
+		mem = (unsigned char *)mmap(NULL, mem_size, PROT_READ|PROT_WRITE,
+					    MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (mem == MAP_FAILED) {
+			perror("mmap");
+			exit(1);
+		}
+	}
+	is.read(mem, mem_size);
+}
+#endif
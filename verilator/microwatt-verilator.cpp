@@ -1,14 +1,17 @@
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
 #include "Vtoplevel.h"
 #include "verilated.h"
-#include "verilated_vcd_c.h"
+#include "microwatt-verilator.h"
 
 /*
  * Current simulation time
  * This is a 64-bit integer to reduce wrap over issues and
  * allow modulus.  You can also use a double, if you wish.
  */
-vluint64_t main_time = 0;
+uint64_t main_time = 0;
 
 /*
  * Called by $time in Verilog
@@ -20,64 +23,343 @@ double sc_time_stamp(void)
 	return main_time;
 }
 
-#if VM_TRACE
-VerilatedVcdC *tfp;
-#endif
-
 void tick(Vtoplevel *top)
 {
 	top->ext_clk = 1;
 	top->eval();
-#if VM_TRACE
-	if (tfp)
-		tfp->dump((double) main_time);
-#endif
+	trace_dump(main_time);
 	main_time++;
 
 	top->ext_clk = 0;
 	top->eval();
-#if VM_TRACE
-	if (tfp)
-		tfp->dump((double) main_time);
-#endif
+	trace_dump(main_time);
 	main_time++;
 }
 
-void uart_tx(unsigned char tx);
-unsigned char uart_rx(void);
+#define DEFAULT_CHECKPOINT	"microwatt-verilator.ckpt"
+
+static uint64_t max_cycles;
+static const char *checkpoint_file = DEFAULT_CHECKPOINT;
+static const char *restore_file;
+static struct trigger save_at;
+static bool save_pending;
+
+#if VM_SAVABLE
+static void save_checkpoint(Vtoplevel *top)
+{
+	VerilatedSave os;
+
+	os.open(checkpoint_file);
+	if (!os.isOpen()) {
+		fprintf(stderr, "Could not create %s\n", checkpoint_file);
+		exit(1);
+	}
+
+	SAVE(os, main_time);
+	os << *top;
+	uart_save(os);
+	mem_save(os);
+	os.close();
+
+	fprintf(stderr, "\r\nSaved checkpoint %s at cycle %llu\r\n",
+		checkpoint_file, (unsigned long long)main_time / 2);
+}
+
+static void restore_checkpoint(Vtoplevel *top)
+{
+	VerilatedRestore is;
+
+	is.open(restore_file);
+	if (!is.isOpen()) {
+		fprintf(stderr, "Could not open %s\n", restore_file);
+		exit(1);
+	}
+
+	RESTORE(is, main_time);
+	is >> *top;
+	uart_restore(is);
+	mem_restore(is);
+	is.close();
+}
+#else
+static void save_checkpoint(Vtoplevel *top)
+{
+}
+
+static void restore_checkpoint(Vtoplevel *top)
+{
+}
+#endif
+
+/*
+ * The completed instruction counts for --stats are read over DMI, all
+ * the time, so they lag the cycle count by a few cycles.
+ */
+static bool stats;
+static unsigned int icount_polling;
+
+static void icount_done(uint64_t count, void *arg)
+{
+	sim_stats_instrs((uintptr_t)arg, count);
+	icount_polling--;
+}
+
+static void stats_cycle(uint64_t cycle)
+{
+	if (!icount_polling) {
+		for (uintptr_t i = 0; i < NCPUS; i++)
+			if (dmi_queue(DBG_CORE_ICOUNT(i), false, 0, icount_done,
+				      (void *)i))
+				icount_polling++;
+	}
+
+	sim_stats_tick(cycle);
+}
+
+/*
+ * Profiling samples are read over DMI too, so they are taken a few
+ * cycles after the interval is up, and LR a few cycles after NIA.
+ */
+#define GSPR_LR		0x20
+
+static uint64_t profile_interval;
+static uint64_t next_sample;
+static unsigned int samples_pending;
+static uint64_t sample_nia[NCPUS];
+
+static void sample_done(uint64_t sample, void *arg)
+{
+	sample_nia[(uintptr_t)arg] = sample;
+}
+
+static void sample_lr_done(uint64_t lr, void *arg)
+{
+	uint64_t sample = sample_nia[(uintptr_t)arg];
+
+	sim_profile_sample((uintptr_t)arg, sample & ~3ULL, lr, sample & 1);
+	samples_pending--;
+}
+
+static void profile_cycle(uint64_t cycle)
+{
+	if (cycle < next_sample || samples_pending)
+		return;
+
+	next_sample = cycle + sim_profile_next();
+	for (uintptr_t i = 0; i < NCPUS; i++)
+		if (dmi_queue(DBG_CORE_SAMPLE(i), false, 0, sample_done,
+			      (void *)i) &&
+		    dmi_queue(DBG_CORE_GSPR_INDEX(i), true, GSPR_LR,
+			      NULL, NULL) &&
+		    dmi_queue(DBG_CORE_GSPR_DATA(i), false, 0, sample_lr_done,
+			      (void *)i))
+			samples_pending++;
+}
+
+static void usage(const char *cmd)
+{
+	fprintf(stderr, "Usage: %s [options] [+verilator+...]\n", cmd);
+	fprintf(stderr, "       %s --batch [options] <test.bin>...\n", cmd);
+
+	fprintf(stderr, "\n");
+	fprintf(stderr, "  -l, --load <file>[@addr]	load a .bin, .hex or ELF image into RAM\n");
+	fprintf(stderr, "				(may be repeated, address defaults to 0,\n");
+	fprintf(stderr, "				ELF images use their physical addresses)\n");
+	fprintf(stderr, "  -m, --max-cycles <n>		stop after n cycles (each test with --batch)\n");
+	fprintf(stderr, "  -b, --batch			run each test image and check it against its .out\n");
+	fprintf(stderr, "  -s, --save-checkpoint-at <trigger>\n");
+	fprintf(stderr, "				save a checkpoint when trigger fires\n");
+	fprintf(stderr, "  -c, --checkpoint <file>	checkpoint to write (default %s)\n",
+		DEFAULT_CHECKPOINT);
+	fprintf(stderr, "  -r, --restore <file>		start from a saved checkpoint\n");
+	fprintf(stderr, "      --stats <n>		print simulation speed every n cycles\n");
+	fprintf(stderr, "				(0 for only at exit)\n");
+	fprintf(stderr, "      --stats-json <file>	write simulation speed as JSON at exit\n");
+	fprintf(stderr, "      --profile <n>		sample each core's NIA and LR every n cycles\n");
+	fprintf(stderr, "      --profile-file <file>	profile to write at exit (default sim_profile.txt)\n");
+	fprintf(stderr, "      --fast-forward		skip ahead while all cores are waiting\n");
+	fprintf(stderr, "      --debug-socket[=<port>|unix:<path>]\n");
+	fprintf(stderr, "				accept mw_debug -b sim connections\n");
+	fprintf(stderr, "  -t, --trace-file <file>	trace file name\n");
+	fprintf(stderr, "      --trace-start <trigger>	start tracing when trigger fires\n");
+	fprintf(stderr, "      --trace-stop <trigger>	stop tracing when trigger fires\n");
+	fprintf(stderr, "      --trace-ring <n>		only keep about the last n cycles of trace\n");
+	fprintf(stderr, "  -h, --help\n");
+	fprintf(stderr, "\n");
+	fprintf(stderr, "A trigger is a cycle count, nia:<addr> (core 0 fetching from addr)\n");
+	fprintf(stderr, "or uart:<text> (text appearing on the console)\n");
+
+	exit(1);
+}
 
 int main(int argc, char **argv)
 {
 	Verilated::commandArgs(argc, argv);
 
+	uint64_t stats_interval = 0;
+	const char *stats_json = NULL;
+	bool batch = false;
+	const char *profile_file = NULL;
+
+	while (1) {
+		int c, oindex;
+		static struct option lopts[] = {
+			{ "help",	no_argument,       0, 'h' },
+			{ "load",	required_argument, 0, 'l' },
+			{ "max-cycles",	required_argument, 0, 'm' },
+			{ "batch",	no_argument,	   0, 'b' },
+			{ "save-checkpoint-at", required_argument, 0, 's' },
+			{ "checkpoint",	required_argument, 0, 'c' },
+			{ "restore",	required_argument, 0, 'r' },
+			{ "trace-file",	required_argument, 0, 't' },
+			{ "trace-start", required_argument, 0, 'S' },
+			{ "trace-stop",	required_argument, 0, 'E' },
+			{ "trace-ring",	required_argument, 0, 'R' },
+			{ "stats",	required_argument, 0, 'i' },
+			{ "stats-json",	required_argument, 0, 'j' },
+			{ "profile",	required_argument, 0, 'p' },
+			{ "profile-file", required_argument, 0, 'P' },
+			{ "fast-forward", no_argument,	   0, 'f' },
+			{ "debug-socket", optional_argument, 0, 'd' },
+			{ 0, 0, 0, 0 }
+		};
+		c = getopt_long(argc, argv, "hl:m:bs:c:r:t:", lopts, &oindex);
+		if (c < 0)
+			break;
+		switch (c) {
+		case 'l':
+			mem_add_load(optarg);
+			break;
+		case 'm':
+			max_cycles = strtoull(optarg, NULL, 0);
+			break;
+		case 'b':
+			batch = true;
+			break;
+		case 's':
+			trigger_parse(&save_at, optarg);
+			break;
+		case 'c':
+			checkpoint_file = optarg;
+			break;
+		case 'r':
+			restore_file = optarg;
+			break;
+		case 't':
+			trace_set_file(optarg);
+			break;
+		case 'S':
+			trace_set_start(optarg);
+			break;
+		case 'E':
+			trace_set_stop(optarg);
+			break;
+		case 'R':
+			trace_set_ring(strtoull(optarg, NULL, 0));
+			break;
+		case 'i':
+			stats = true;
+			stats_interval = strtoull(optarg, NULL, 0);
+			break;
+		case 'j':
+			stats = true;
+			stats_json = optarg;
+			break;
+		case 'p':
+			profile_interval = strtoull(optarg, NULL, 0);
+			break;
+		case 'P':
+			profile_file = optarg;
+			break;
+		case 'f':
+			idle_enable();
+			break;
+		case 'd':
+			dmi_socket_enable(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+		}
+	}
+
+#if !VM_SAVABLE
+	if (trigger_armed(&save_at) || restore_file) {
+		fprintf(stderr, "Checkpoints need a build with VERILATOR_SAVABLE=1\n");
+		exit(1);
+	}
+#endif
+
+	if (stats)
+		sim_stats_enable(stats_interval, stats_json);
+	if (profile_interval)
+		sim_profile_enable(profile_interval, profile_file);
+
+	if (batch) {
+		if (optind == argc)
+			usage(argv[0]);
+		mem_add_load(argv[optind]);
+	}
+
 	// init top verilog instance
 	Vtoplevel* top = new Vtoplevel;
 
-#if VM_TRACE
-	// init trace dump
-	Verilated::traceEverOn(true);
-	tfp = new VerilatedVcdC;
-	top->trace(tfp, 99);
-	tfp->open("microwatt-verilator.vcd");
-#endif
+	if (batch) {
+		int rc = batch_run(top, argc - optind, argv + optind, max_cycles);
 
-	// Reset
-	top->ext_rst = 0;
-	for (unsigned long i = 0; i < 5; i++)
-		tick(top);
-	top->ext_rst = 1;
+		delete top;
+		return rc;
+	}
+
+	if (restore_file)
+		restore_checkpoint(top);
+
+	trace_init(top, main_time / 2);
+
+	if (!restore_file) {
+		// Reset
+		top->ext_rst = 0;
+		for (unsigned long i = 0; i < 5; i++)
+			tick(top);
+		top->ext_rst = 1;
+	}
 
 	while(!Verilated::gotFinish()) {
+		uint64_t cycle;
+
 		tick(top);
+		cycle = main_time / 2;
+
+		dmi_socket_cycle();
+		trigger_update();
+		/* A checkpoint waits for the DMI bus to go idle */
+		if (trigger_fired(&save_at, cycle)) {
+			dmi_drain(true);
+			save_pending = true;
+		}
+		if (save_pending && dmi_idle()) {
+			save_checkpoint(top);
+			dmi_drain(false);
+			save_pending = false;
+		}
+		trace_cycle(cycle);
+		if (stats)
+			stats_cycle(cycle);
+		if (profile_interval)
+			profile_cycle(cycle);
+		main_time += 2 * idle_cycle(cycle, max_cycles);
 
+		if (max_cycles && cycle >= max_cycles)
+			break;
+		if (trace_interrupted())
+			break;
+
+#if !FAST_UART
 		uart_tx(top->uart0_txd);
 		top->uart0_rxd = uart_rx();
-	}
-
-#if VM_TRACE
-	tfp->close();
-	delete tfp;
 #endif
+	}
 
+	trace_close();
 	delete top;
 }
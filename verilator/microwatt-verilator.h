@@ -0,0 +1,129 @@
+#ifndef MICROWATT_VERILATOR_H
+#define MICROWATT_VERILATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifndef NCPUS
+#define NCPUS 1
+#endif
+
+#if VM_SAVABLE
+#include "verilated_save.h"
+
+#define SAVE(os, v)	(os).write(&(v), sizeof(v))
+#define RESTORE(is, v)	(is).read(&(v), sizeof(v))
+#endif
+
+class Vtoplevel;
+
+/* microwatt-verilator.cpp */
+extern uint64_t main_time;
+void tick(Vtoplevel *top);
+
+/* uart-verilator.c */
+void uart_tx(unsigned char tx);
+unsigned char uart_rx(void);
+bool uart_idle(bool check_input);
+
+/* mem-verilator.cpp */
+void mem_add_load(const char *spec);
+void mem_reload(const char *filename);
+uint64_t mem_change_count(void);
+
+/* dmi-verilator.cpp, addresses as in scripts/mw_debug/mw_debug.c */
+#define DBG_CORE_STAT(core)	(0x11 + ((core) << 4))
+#define DBG_CORE_NIA(core)	(0x12 + ((core) << 4))
+#define DBG_CORE_MSR(core)	(0x13 + ((core) << 4))
+#define DBG_CORE_GSPR_INDEX(core)	(0x14 + ((core) << 4))
+#define DBG_CORE_GSPR_DATA(core)	(0x15 + ((core) << 4))
+#define DBG_CORE_ICOUNT(core)	(0x1a + ((core) << 4))
+#define DBG_CORE_TB_SKIP(core)	(0x1b + ((core) << 4))
+#define DBG_CORE_SAMPLE(core)	(0x1c + ((core) << 4))
+#define DBG_CORE_NIA_TRIGGER(core)	(0x1d + ((core) << 4))
+
+#define DBG_CORE_STAT_STOPPED	(1 << 1)
+#define DBG_CORE_STAT_TERM	(1 << 2)
+#define DBG_CORE_STAT_WAITING	(1 << 3)
+#define DBG_CORE_STAT_IRQ	(1 << 4)
+
+#define DBG_CORE_NIA_TRIGGER_ENABLE	(1 << 0)
+#define DBG_CORE_NIA_TRIGGER_HIT	(1 << 1)
+
+typedef void (*dmi_done_fn)(uint64_t data, void *arg);
+
+bool dmi_queue(uint8_t addr, bool wr, uint64_t data, dmi_done_fn done,
+	       void *arg);
+void dmi_drain(bool drain);
+bool dmi_draining(void);
+bool dmi_idle(void);
+
+/* dmi-socket-verilator.cpp */
+void dmi_socket_enable(const char *spec);
+bool dmi_socket_connected(void);
+void dmi_socket_cycle(void);
+
+/* ../sim_jtag_socket_c.c */
+void sim_debug_socket_open(const char *spec);
+bool sim_debug_socket_connected(void);
+int sim_debug_socket_next(uint8_t *msg, unsigned int *len, uint8_t *addr,
+			  uint64_t *data);
+void sim_debug_socket_reply(const uint8_t *msg, unsigned int len);
+void sim_debug_socket_done(bool ok, uint64_t data);
+
+/* ../sim_stats_c.c */
+void sim_stats_enable(uint64_t every, const char *json);
+void sim_stats_instrs(unsigned int cpu, uint64_t count);
+void sim_stats_tick(uint64_t cycle);
+
+/* ../sim_profile_c.c */
+void sim_profile_enable(uint64_t every, const char *file);
+uint64_t sim_profile_next(void);
+void sim_profile_sample(unsigned int cpu, uint64_t nia, uint64_t lr, bool pr);
+
+/* trigger-verilator.cpp */
+enum trigger_type {
+	TRIGGER_NONE, TRIGGER_CYCLE, TRIGGER_NIA, TRIGGER_UART
+};
+
+struct trigger {
+	enum trigger_type type;
+	uint64_t value;
+	const char *match;
+	char *window;
+	size_t len;
+	bool hit;
+};
+
+void trigger_parse(struct trigger *t, const char *spec);
+bool trigger_armed(struct trigger *t);
+bool trigger_fired(struct trigger *t, uint64_t cycle);
+void trigger_update(void);
+void trigger_uart(unsigned char c);
+
+/* idle-verilator.cpp */
+void idle_enable(void);
+uint64_t idle_cycle(uint64_t cycle, uint64_t max_cycles);
+
+/* batch-verilator.cpp */
+int batch_run(Vtoplevel *top, int count, char **files, uint64_t cycles);
+
+/* trace-verilator.cpp */
+void trace_set_file(const char *file);
+void trace_set_start(const char *spec);
+void trace_set_stop(const char *spec);
+void trace_set_ring(uint64_t cycles);
+void trace_init(Vtoplevel *top, uint64_t cycle);
+void trace_dump(uint64_t time);
+void trace_cycle(uint64_t cycle);
+bool trace_interrupted(void);
+void trace_close(void);
+
+#if VM_SAVABLE
+void uart_save(VerilatedSerialize &os);
+void uart_restore(VerilatedDeserialize &is);
+void mem_save(VerilatedSerialize &os);
+void mem_restore(VerilatedDeserialize &is);
+#endif
+
+#endif
@@ -0,0 +1,247 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "Vtoplevel.h"
+#include "verilated.h"
+#include "microwatt-verilator.h"
+
+/*
+ * Waveform tracing. By default everything from reset is dumped, which on
+ * a long run is both huge and slow. A start and a stop trigger narrow it
+ * down to one window, and a ring limits it to the last so many cycles:
+ * the trace then alternates between two files, each holding up to that
+ * many cycles, so whatever state the run ends in the last stretch
+ * before it is on disk.
+ *
+ * ctrl-c and SIGTERM only set a flag, and the main loop ends the run
+ * normally so the open file gets closed. Nothing can be flushed safely
+ * from a crash, so then only the segment before the one being written is
+ * complete.
+ */
+
+#if VM_TRACE
+#if VM_TRACE_FST
+#include "verilated_fst_c.h"
+typedef VerilatedFstC TraceFile;
+#define TRACE_SUFFIX	".fst"
+#else
+#include "verilated_vcd_c.h"
+typedef VerilatedVcdC TraceFile;
+#define TRACE_SUFFIX	".vcd"
+#endif
+
+static TraceFile *tfp;
+static bool tracing;
+static const char *trace_file = "microwatt-verilator" TRACE_SUFFIX;
+static struct trigger start;
+static struct trigger stop;
+static uint64_t ring_cycles;
+static uint64_t segment_start;
+static unsigned int segment;
+static bool wrapped;
+static char *segment_file[2];
+
+void trace_set_file(const char *file)
+{
+	trace_file = file;
+}
+
+void trace_set_start(const char *spec)
+{
+	trigger_parse(&start, spec);
+}
+
+void trace_set_stop(const char *spec)
+{
+	trigger_parse(&stop, spec);
+}
+
+void trace_set_ring(uint64_t cycles)
+{
+	ring_cycles = cycles;
+}
+
+/* foo.fst becomes foo.0.fst and foo.1.fst */
+static char *segment_name(unsigned int n)
+{
+	size_t len = strlen(trace_file);
+	size_t slen = strlen(TRACE_SUFFIX);
+	char *name = (char *)malloc(len + 3);
+
+	if (len >= slen && !strcmp(trace_file + len - slen, TRACE_SUFFIX))
+		len -= slen;
+
+	sprintf(name, "%.*s.%u%s", (int)len, trace_file, n,
+		trace_file + len);
+	return name;
+}
+
+static void trace_begin(uint64_t cycle)
+{
+	const char *name = trace_file;
+
+	if (ring_cycles)
+		name = segment_file[segment];
+
+	tfp->open(name);
+	if (!tfp->isOpen()) {
+		fprintf(stderr, "Could not create %s\n", name);
+		exit(1);
+	}
+	tracing = true;
+	segment_start = cycle;
+}
+
+static void trace_end(void)
+{
+	if (!tracing)
+		return;
+	tfp->close();
+	tracing = false;
+}
+
+static volatile sig_atomic_t interrupted;
+
+static void stop_signal(int sig)
+{
+	interrupted = 1;
+}
+
+static void fatal_signal(int sig)
+{
+	static const char msg[] = "\r\nTrace file left incomplete\r\n";
+
+	if (tracing)
+		write(STDERR_FILENO, msg, sizeof(msg) - 1);
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/* Once the main loop has seen it, a second ctrl-c kills the run outright */
+bool trace_interrupted(void)
+{
+	if (interrupted) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+	}
+	return interrupted;
+}
+
+void trace_init(Vtoplevel *top, uint64_t cycle)
+{
+	Verilated::traceEverOn(true);
+	tfp = new TraceFile;
+	top->trace(tfp, 99);
+
+	if (ring_cycles) {
+		segment_file[0] = segment_name(0);
+		segment_file[1] = segment_name(1);
+	}
+
+	signal(SIGSEGV, fatal_signal);
+	signal(SIGBUS, fatal_signal);
+	signal(SIGABRT, fatal_signal);
+	signal(SIGINT, stop_signal);
+	signal(SIGTERM, stop_signal);
+
+	if (!trigger_armed(&start))
+		trace_begin(cycle);
+}
+
+void trace_dump(uint64_t time)
+{
+	if (tracing)
+		tfp->dump(time);
+}
+
+void trace_cycle(uint64_t cycle)
+{
+	if (!tracing) {
+		if (trigger_fired(&start, cycle)) {
+			fprintf(stderr, "\r\nTrace started at cycle %llu\r\n",
+				(unsigned long long)cycle);
+			trace_begin(cycle);
+		}
+		return;
+	}
+
+	if (trigger_fired(&stop, cycle)) {
+		fprintf(stderr, "\r\nTrace stopped at cycle %llu\r\n",
+			(unsigned long long)cycle);
+		trace_end();
+		return;
+	}
+
+	if (ring_cycles && cycle - segment_start >= ring_cycles) {
+		trace_end();
+		segment ^= 1;
+		wrapped = true;
+		trace_begin(cycle);
+	}
+}
+
+void trace_close(void)
+{
+	bool was_tracing = tracing;
+
+	trace_end();
+	if (ring_cycles && was_tracing) {
+		fprintf(stderr, "\r\nLast trace segment is %s", segment_file[segment]);
+		if (wrapped)
+			fprintf(stderr, ", preceded by %s", segment_file[segment ^ 1]);
+		fprintf(stderr, "\r\n");
+	}
+	delete tfp;
+}
+#else
+static void trace_unsupported(void)
+{
+	fprintf(stderr, "Tracing needs a build with VERILATOR_TRACE=1 or VERILATOR_TRACE_FST=1\n");
+	exit(1);
+}
+
+void trace_set_file(const char *file)
+{
+	trace_unsupported();
+}
+
+void trace_set_start(const char *spec)
+{
+	trace_unsupported();
+}
+
+void trace_set_stop(const char *spec)
+{
+	trace_unsupported();
+}
+
+void trace_set_ring(uint64_t cycles)
+{
+	trace_unsupported();
+}
+
+void trace_init(Vtoplevel *top, uint64_t cycle)
+{
+}
+
+void trace_dump(uint64_t time)
+{
+}
+
+void trace_cycle(uint64_t cycle)
+{
+}
+
+bool trace_interrupted(void)
+{
+	return false;
+}
+
+void trace_close(void)
+{
+}
+#endif
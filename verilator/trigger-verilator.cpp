@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "microwatt-verilator.h"
+
+/*
+ * Conditions that make the harness do something part way through a run,
+ * like saving a checkpoint or starting a trace. They are written as a
+ * cycle count, nia:<addr> for core 0 fetching from an address, or
+ * uart:<text> for a string showing up on the console. Each one fires
+ * once.
+ *
+ * Core 0 compares its fetch NIA against one NIA trigger at a time every
+ * cycle (DBG_CORE_NIA_TRIGGER), so a short visit isn't missed. The hit
+ * is polled over DMI, so the trigger fires a few cycles after fetch got
+ * there.
+ */
+
+#define MAX_TRIGGERS 8
+
+static struct trigger *triggers[MAX_TRIGGERS];
+static unsigned long trigger_nr;
+static struct trigger *nia_watched;
+static bool nia_polling;
+
+void trigger_parse(struct trigger *t, const char *spec)
+{
+	char *end;
+
+	if (trigger_nr == MAX_TRIGGERS) {
+		fprintf(stderr, "%s: too many triggers, bump MAX_TRIGGERS\n",
+			__func__);
+		exit(1);
+	}
+
+	memset(t, 0, sizeof(*t));
+
+	if (!strncmp(spec, "uart:", 5)) {
+		t->type = TRIGGER_UART;
+		t->match = spec + 5;
+		t->len = strlen(t->match);
+		t->window = (char *)calloc(1, t->len + 1);
+		if (!t->len || !t->window) {
+			fprintf(stderr, "Bad trigger %s\n", spec);
+			exit(1);
+		}
+	} else {
+		const char *p = spec;
+
+		t->type = TRIGGER_CYCLE;
+		if (!strncmp(p, "nia:", 4)) {
+			t->type = TRIGGER_NIA;
+			p += 4;
+		}
+
+		t->value = strtoull(p, &end, 0);
+		if (end == p || *end) {
+			fprintf(stderr, "Bad trigger %s\n", spec);
+			exit(1);
+		}
+	}
+
+	triggers[trigger_nr++] = t;
+}
+
+bool trigger_armed(struct trigger *t)
+{
+	return t->type != TRIGGER_NONE;
+}
+
+bool trigger_fired(struct trigger *t, uint64_t cycle)
+{
+	if (t->type == TRIGGER_NONE)
+		return false;
+
+	if (t->type == TRIGGER_CYCLE && cycle >= t->value)
+		t->hit = true;
+
+	if (!t->hit)
+		return false;
+
+	t->type = TRIGGER_NONE;
+	return true;
+}
+
+static void nia_done(uint64_t val, void *arg)
+{
+	uint64_t nia = nia_watched->value;
+
+	nia_polling = false;
+	if (!(val & DBG_CORE_NIA_TRIGGER_HIT))
+		return;
+
+	for (unsigned long i = 0; i < trigger_nr; i++) {
+		struct trigger *t = triggers[i];
+
+		if (t->type == TRIGGER_NIA && t->value == nia)
+			t->hit = true;
+	}
+	nia_watched = NULL;
+}
+
+/* Called once a cycle to arm the next NIA trigger and poll for a hit */
+void trigger_update(void)
+{
+	if (nia_polling)
+		return;
+
+	if (!nia_watched) {
+		struct trigger *t = NULL;
+
+		for (unsigned long i = 0; i < trigger_nr; i++) {
+			if (triggers[i]->type == TRIGGER_NIA && !triggers[i]->hit) {
+				t = triggers[i];
+				break;
+			}
+		}
+		if (!t)
+			return;
+
+		if (!dmi_queue(DBG_CORE_NIA_TRIGGER(0), true,
+			       (t->value & ~3ULL) | DBG_CORE_NIA_TRIGGER_ENABLE,
+			       NULL, NULL))
+			return;
+		nia_watched = t;
+	}
+
+	nia_polling = dmi_queue(DBG_CORE_NIA_TRIGGER(0), false, 0, nia_done, NULL);
+}
+
+/* Called with every character written to the console */
+void trigger_uart(unsigned char c)
+{
+	for (unsigned long i = 0; i < trigger_nr; i++) {
+		struct trigger *t = triggers[i];
+
+		if (t->type != TRIGGER_UART)
+			continue;
+
+		memmove(t->window, t->window + 1, t->len - 1);
+		t->window[t->len - 1] = c;
+		if (!memcmp(t->window, t->match, t->len))
+			t->hit = true;
+	}
+}
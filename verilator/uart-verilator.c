@@ -6,6 +6,8 @@
 #include <termios.h>
 #include <stdlib.h>
 
+#include "microwatt-verilator.h"
+
 /* Should we exit simulation on ctrl-c or pass it through? */
 #define EXIT_ON_CTRL_C
 
@@ -25,6 +27,12 @@ enum state {
 	IDLE, START_BIT, BITS, STOP_BIT, ERROR
 };
 
+static void uart_putc(unsigned char c)
+{
+	write(STDOUT_FILENO, &c, 1);
+	trigger_uart(c);
+}
+
 static enum state tx_state = IDLE;
 static unsigned long tx_countbits;
 static unsigned char tx_bits;
@@ -109,12 +117,12 @@ void uart_tx(unsigned char tx)
 					break;
 				}
 				/* Go straight to idle */
-				write(STDOUT_FILENO, &tx_byte, 1);
+				uart_putc(tx_byte);
 				tx_state = IDLE;
 			}
 
 			if (tx_countbits == 0) {
-				write(STDOUT_FILENO, &tx_byte, 1);
+				uart_putc(tx_byte);
 				tx_state = IDLE;
 			}
 			break;
@@ -251,3 +259,107 @@ unsigned char uart_rx(void)
 
 	return rx;
 }
+
+#if FAST_UART
+#include "Vtoplevel__Dpi.h"
+
+/*
+ * Byte level console for fast_uart/uart_top.v. stdin is still only
+ * polled every RX_INTERVAL calls while it is idle, but once a byte has
+ * been taken we look again straight away so pasted input doesn't wait.
+ */
+static int rx_pending = -1;
+
+void uart_dpi_tx(char c)
+{
+	uart_putc(c);
+}
+
+svBit uart_dpi_rx_ready(void)
+{
+	unsigned char c;
+
+	if (rx_pending < 0 && rx_sometimes++ >= RX_INTERVAL) {
+		rx_sometimes = 0;
+		if (nonblocking_read(&c))
+			rx_pending = c;
+	}
+
+	return rx_pending >= 0;
+}
+
+char uart_dpi_rx(void)
+{
+	char c = rx_pending;
+
+	rx_pending = -1;
+	rx_sometimes = RX_INTERVAL;
+	return c;
+}
+#endif
+
+/*
+ * Nothing on the line in either direction and, if asked, no input
+ * waiting on stdin. Used by the idle fast forward.
+ */
+bool uart_idle(bool check_input)
+{
+	struct pollfd fdset[1];
+
+	if (tx_state != IDLE || rx_state != IDLE)
+		return false;
+#if FAST_UART
+	if (rx_pending >= 0)
+		return false;
+#endif
+	if (!check_input)
+		return true;
+
+	memset(fdset, 0, sizeof(fdset));
+	fdset[0].fd = STDIN_FILENO;
+	fdset[0].events = POLLIN;
+
+	return poll(fdset, 1, 0) == 0;
+}
+
+#if VM_SAVABLE
+/*
+ * The terminal itself isn't part of a checkpoint, only where the bit
+ * level state machines were.
+ */
+void uart_save(VerilatedSerialize &os)
+{
+	SAVE(os, tx_state);
+	SAVE(os, tx_countbits);
+	SAVE(os, tx_bits);
+	SAVE(os, tx_byte);
+	SAVE(os, tx_prev);
+	SAVE(os, rx_state);
+	SAVE(os, rx_char);
+	SAVE(os, rx_countbits);
+	SAVE(os, rx_bit);
+	SAVE(os, rx);
+	SAVE(os, rx_sometimes);
+#if FAST_UART
+	SAVE(os, rx_pending);
+#endif
+}
+
+void uart_restore(VerilatedDeserialize &is)
+{
+	RESTORE(is, tx_state);
+	RESTORE(is, tx_countbits);
+	RESTORE(is, tx_bits);
+	RESTORE(is, tx_byte);
+	RESTORE(is, tx_prev);
+	RESTORE(is, rx_state);
+	RESTORE(is, rx_char);
+	RESTORE(is, rx_countbits);
+	RESTORE(is, rx_bit);
+	RESTORE(is, rx);
+	RESTORE(is, rx_sometimes);
+#if FAST_UART
+	RESTORE(is, rx_pending);
+#endif
+}
+#endif